@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cfloat>
+#include "Defs.h"
+
+/**
+ * @struct	AABB
+ * @brief	An axis aligned bounding box in 3D, given by its two extreme corners.
+ * 			A default constructed box is empty; infinite() covers all of space
+ * 			and is used for shapes, like planes, that have no finite bounds.
+ */
+
+struct AABB {
+	glm::vec3 lo;	//!< corner with the smallest x, y and z values
+	glm::vec3 hi;	//!< corner with the largest x, y and z values
+
+	/**
+	 * @fn	AABB()
+	 * @brief	Constructs an empty box.
+	 */
+
+	AABB() : lo(FLT_MAX, FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX, -FLT_MAX) {
+	}
+
+	/**
+	 * @fn	AABB(const glm::vec3 &low, const glm::vec3 &high)
+	 * @brief	Constructs a box from its two extreme corners.
+	 * @param	low 	Corner with the smallest coordinates.
+	 * @param	high	Corner with the largest coordinates.
+	 */
+
+	AABB(const glm::vec3 &low, const glm::vec3 &high) : lo(low), hi(high) {
+	}
+
+	/**
+	 * @fn	static AABB infinite()
+	 * @brief	A box that covers all of space.
+	 * @return	The infinite box.
+	 */
+
+	static AABB infinite() {
+		return AABB(glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX), glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX));
+	}
+
+	bool isEmpty() const {
+		return lo.x > hi.x || lo.y > hi.y || lo.z > hi.z;
+	}
+
+	bool isInfinite() const {
+		return lo.x == -FLT_MAX || lo.y == -FLT_MAX || lo.z == -FLT_MAX ||
+				hi.x == FLT_MAX || hi.y == FLT_MAX || hi.z == FLT_MAX;
+	}
+
+	void extend(const glm::vec3 &pt) {
+		lo = glm::min(lo, pt);
+		hi = glm::max(hi, pt);
+	}
+
+	bool contains(const glm::vec3 &pt) const {
+		return lo.x <= pt.x && pt.x <= hi.x && lo.y <= pt.y && pt.y <= hi.y && lo.z <= pt.z && pt.z <= hi.z;
+	}
+
+	void extend(const AABB &box) {
+		lo = glm::min(lo, box.lo);
+		hi = glm::max(hi, box.hi);
+	}
+
+	/**
+	 * @fn	void pad(float amount)
+	 * @brief	Grows the box by a small amount so that intersections computed
+	 * 			exactly on a face of the box are not lost to round off.
+	 * @param	amount	Relative amount to grow each side by.
+	 */
+
+	void pad(float amount) {
+		glm::vec3 delta = (hi - lo) * amount + glm::vec3(amount, amount, amount);
+		lo -= delta;
+		hi += delta;
+	}
+
+	glm::vec3 centroid() const {
+		return 0.5f * (lo + hi);
+	}
+
+	glm::vec3 extent() const {
+		return hi - lo;
+	}
+
+	float surfaceArea() const {
+		if (isEmpty()) return 0.0f;
+		glm::vec3 d = hi - lo;
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	int longestAxis() const {
+		glm::vec3 d = hi - lo;
+		if (d.x >= d.y && d.x >= d.z) return 0;
+		return d.y >= d.z ? 1 : 2;
+	}
+
+	/**
+	 * @fn	bool intersect(const glm::vec3 &origin, const glm::vec3 &invDir, float tMax, float &tEnter) const
+	 * @brief	Slab test of a ray against the box.
+	 * @param 		  	origin	Origin of the ray.
+	 * @param 		  	invDir	1 / direction of the ray, per component.
+	 * @param 		  	tMax  	Intersections beyond tMax are ignored.
+	 * @param [in,out]	tEnter	The t value where the ray enters the box (0 if
+	 * 							the origin is inside the box).
+	 * @return	true iff the ray overlaps the box somewhere in [0, tMax].
+	 */
+
+	bool intersect(const glm::vec3 &origin, const glm::vec3 &invDir, float tMax, float &tEnter) const {
+		float tNear = 0.0f;
+		float tFar = tMax;
+		for (int a = 0; a < 3; a++) {
+			float t0 = (lo[a] - origin[a]) * invDir[a];
+			float t1 = (hi[a] - origin[a]) * invDir[a];
+			if (invDir[a] < 0.0f) {
+				float tmp = t0;
+				t0 = t1;
+				t1 = tmp;
+			}
+			// Written so that a NaN (origin on a slab, ray parallel to it) leaves
+			// the interval unchanged.
+			tNear = t0 > tNear ? t0 : tNear;
+			tFar = t1 < tFar ? t1 : tFar;
+		}
+		tEnter = tNear;
+		return tNear <= tFar;
+	}
+};
@@ -0,0 +1,231 @@
+#include <algorithm>
+#include "BVH.h"
+
+/**
+ * @fn	void BVH::clear()
+ * @brief	Removes all nodes.
+ */
+
+void BVH::clear() {
+	nodes.clear();
+	primIndices.clear();
+	parents.clear();
+	slotLeaves.clear();
+	sahArea = 0.0;
+}
+
+/**
+ * @fn	void BVH::build(const std::vector<AABB> &primBounds)
+ * @brief	Builds the hierarchy. Primitive i is represented by primBounds[i].
+ * @param	primBounds	The bounds of each primitive.
+ */
+
+void BVH::build(const std::vector<AABB> &primBounds) {
+	clear();
+	const int N = (int)primBounds.size();
+	if (N == 0) return;
+
+	std::vector<AABB> bounds(primBounds);
+	std::vector<glm::vec3> centroids(N);
+	primIndices.resize(N);
+	for (int i = 0; i < N; i++) {
+		primIndices[i] = i;
+		centroids[i] = bounds[i].centroid();
+	}
+	nodes.reserve(2 * N);
+	buildRecursive(bounds, centroids, 0, N, 0);
+	nodes.shrink_to_fit();
+	for (const BVHNode &node : nodes) {
+		sahArea += nodeSAHArea(node);
+	}
+}
+
+/**
+ * @fn	int BVH::buildRecursive(std::vector<AABB> &bounds, std::vector<glm::vec3> &centroids, int first, int count, int depth)
+ * @brief	Builds the subtree over primIndices[first, first + count). The split
+ * 			is chosen by binning centroids along each axis and picking the plane
+ * 			with the lowest surface area heuristic cost. bounds and centroids are
+ * 			kept in the same order as primIndices.
+ * @param [in,out]	bounds   	Bounds of the primitives.
+ * @param [in,out]	centroids	Centroids of the primitives.
+ * @param 		  	first	 	First primitive of this subtree.
+ * @param 		  	count	 	Number of primitives in this subtree.
+ * @param 		  	depth	 	Depth of this node.
+ * @return	The index of the new node.
+ */
+
+int BVH::buildRecursive(std::vector<AABB> &bounds, std::vector<glm::vec3> &centroids,
+						int first, int count, int depth) {
+	int nodeIndex = (int)nodes.size();
+	nodes.push_back(BVHNode());
+
+	AABB box, centroidBox;
+	for (int i = first; i < first + count; i++) {
+		box.extend(bounds[i]);
+		centroidBox.extend(centroids[i]);
+	}
+	nodes[nodeIndex].box = box;
+	nodes[nodeIndex].first = first;
+	nodes[nodeIndex].count = count;
+	nodes[nodeIndex].rightChild = -1;
+
+	// Traversal never holds more than depth + 1 entries on its stack.
+	if (count == 1 || depth >= MAX_DEPTH - 2) {
+		return nodeIndex;
+	}
+
+	// Find the cheapest binned split over all three axes.
+	const float leafCost = (float)count;
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	int bestBin = -1;
+	for (int axis = 0; axis < 3; axis++) {
+		float cmin = centroidBox.lo[axis];
+		float cmax = centroidBox.hi[axis];
+		if (cmax <= cmin) continue;
+		float scale = NUM_BINS / (cmax - cmin);
+
+		AABB binBoxes[NUM_BINS];
+		int binCounts[NUM_BINS] = { 0 };
+		for (int i = first; i < first + count; i++) {
+			int b = std::min(NUM_BINS - 1, (int)((centroids[i][axis] - cmin) * scale));
+			binCounts[b]++;
+			binBoxes[b].extend(bounds[i]);
+		}
+
+		// Sweep from the right to get the area and count of every right side.
+		float rightArea[NUM_BINS];
+		int rightCount[NUM_BINS];
+		AABB acc;
+		int n = 0;
+		for (int b = NUM_BINS - 1; b > 0; b--) {
+			acc.extend(binBoxes[b]);
+			n += binCounts[b];
+			rightArea[b] = acc.surfaceArea();
+			rightCount[b] = n;
+		}
+
+		acc = AABB();
+		n = 0;
+		for (int b = 0; b < NUM_BINS - 1; b++) {
+			acc.extend(binBoxes[b]);
+			n += binCounts[b];
+			if (n == 0 || rightCount[b + 1] == 0) continue;
+			float cost = acc.surfaceArea() * n + rightArea[b + 1] * rightCount[b + 1];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+			}
+		}
+	}
+
+	// SAH with a traversal cost of one primitive test; relative to the parent.
+	float parentArea = box.surfaceArea();
+	if (parentArea > 0.0f && bestAxis >= 0) {
+		bestCost = 1.0f + bestCost / parentArea;
+	}
+	if (count <= MAX_LEAF_SIZE && (bestAxis < 0 || bestCost >= leafCost)) {
+		return nodeIndex;
+	}
+
+	// Partition in place.
+	int mid;
+	if (bestAxis >= 0) {
+		float cmin = centroidBox.lo[bestAxis];
+		float scale = NUM_BINS / (centroidBox.hi[bestAxis] - cmin);
+		int i = first;
+		int j = first + count - 1;
+		while (i <= j) {
+			int b = std::min(NUM_BINS - 1, (int)((centroids[i][bestAxis] - cmin) * scale));
+			if (b <= bestBin) {
+				i++;
+			} else {
+				std::swap(centroids[i], centroids[j]);
+				std::swap(bounds[i], bounds[j]);
+				std::swap(primIndices[i], primIndices[j]);
+				j--;
+			}
+		}
+		mid = i;
+	} else {
+		// All centroids coincide; split the list in half.
+		mid = first + count / 2;
+	}
+	if (mid == first || mid == first + count) {
+		mid = first + count / 2;
+	}
+
+	nodes[nodeIndex].count = 0;
+	buildRecursive(bounds, centroids, first, mid - first, depth + 1);
+	int right = buildRecursive(bounds, centroids, mid, first + count - mid, depth + 1);
+	nodes[nodeIndex].rightChild = right;
+	return nodeIndex;
+}
+
+/**
+ * @fn	double BVH::nodeSAHArea(const BVHNode &node) const
+ * @brief	A node's term in the surface area heuristic, before dividing by the
+ * 			root's area: its area, times its number of primitives for a leaf.
+ * @param	node	The node.
+ * @return	The node's term.
+ */
+
+double BVH::nodeSAHArea(const BVHNode &node) const {
+	return (double)node.box.surfaceArea() * (node.isLeaf() ? node.count : 1);
+}
+
+/**
+ * @fn	float BVH::sahCost() const
+ * @brief	The expected cost of a ray through the whole tree under the surface
+ * 			area heuristic, in primitive tests, with a node visit costing one
+ * 			test. Kept up to date by refit.
+ * @return	The cost; 0 for an empty tree.
+ */
+
+float BVH::sahCost() const {
+	if (nodes.empty()) return 0.0f;
+	float rootArea = nodes[0].box.surfaceArea();
+	return rootArea > 0.0f ? (float)(sahArea / rootArea) : (float)primIndices.size();
+}
+
+/**
+ * @fn	void BVH::linkParents()
+ * @brief	Records the parent of every node and the leaf of every slot, which
+ * 			refit needs to walk up from a primitive.
+ */
+
+void BVH::linkParents() {
+	parents.assign(nodes.size(), -1);
+	slotLeaves.assign(primIndices.size(), -1);
+	for (int i = 0; i < (int)nodes.size(); i++) {
+		const BVHNode &node = nodes[i];
+		if (node.isLeaf()) {
+			for (int slot = node.first; slot < node.first + node.count; slot++) {
+				slotLeaves[slot] = i;
+			}
+		} else {
+			parents[i + 1] = i;
+			parents[node.rightChild] = i;
+		}
+	}
+}
+
+/**
+ * @fn	bool BVH::setBox(int nodeIndex, const AABB &box)
+ * @brief	Changes a node's box and keeps sahArea up to date.
+ * @param	nodeIndex	The node.
+ * @param	box		 	The new box.
+ * @return	false if the box was already box.
+ */
+
+bool BVH::setBox(int nodeIndex, const AABB &box) {
+	BVHNode &node = nodes[nodeIndex];
+	if (node.box.lo == box.lo && node.box.hi == box.hi) {
+		return false;
+	}
+	sahArea -= nodeSAHArea(node);
+	node.box = box;
+	sahArea += nodeSAHArea(node);
+	return true;
+}
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <vector>
+#include "AABB.h"
+#include "RayPacket.h"
+
+/**
+ * @struct	BVHNode
+ * @brief	A node of a flattened bounding volume hierarchy. The left child of an
+ * 			interior node immediately follows it in the node array.
+ */
+
+struct BVHNode {
+	AABB box;			//!< bounds of everything below this node
+	int rightChild;		//!< index of the right child (interior nodes only)
+	int first;			//!< first entry in BVH::primIndices (leaves only)
+	int count;			//!< number of primitives; 0 for interior nodes
+	bool isLeaf() const { return count > 0; }
+};
+
+/**
+ * @struct	BVH
+ * @brief	Bounding volume hierarchy over a set of primitives, each given only
+ * 			by its bounding box. Built top down with binned surface area
+ * 			heuristic (SAH) splits. The BVH does not know what the primitives
+ * 			are; traversal calls back with primitive indices. When primitives
+ * 			move, refit updates the boxes above them without rebuilding.
+ */
+
+struct BVH {
+	std::vector<BVHNode> nodes;		//!< flattened tree; nodes[0] is the root
+	std::vector<int> primIndices;	//!< primitive indices, grouped by leaf
+
+	static const int NUM_BINS = 12;			//!< bins per axis when evaluating splits
+	static const int MAX_LEAF_SIZE = 4;		//!< larger leaves are split unless the depth limit is hit
+	static const int MAX_DEPTH = 64;		//!< traversal stack size
+
+	void build(const std::vector<AABB> &primBounds);
+	void clear();
+	bool isEmpty() const { return nodes.empty(); }
+	float sahCost() const;
+
+	template <class PrimBounds>
+	void refit(const std::vector<int> &slots, PrimBounds primBounds);
+
+	template <class IntersectPrim>
+	void intersect(const glm::vec3 &origin, const glm::vec3 &direction, float &tMax,
+					IntersectPrim intersectPrim) const;
+	template <class IntersectLeaf>
+	void intersectLeaves(const glm::vec3 &origin, const glm::vec3 &direction, float &tMax,
+					IntersectLeaf intersectLeaf) const;
+	template <class IntersectLeaf>
+	void intersectPacket(const RayPacket &packet, float tMax[RayPacket::SIZE],
+					IntersectLeaf intersectLeaf) const;
+	template <class VisitPrim>
+	bool findContaining(const glm::vec3 &point, VisitPrim visitPrim) const;
+	template <class OccludesPrim>
+	bool occluded(const glm::vec3 &origin, const glm::vec3 &direction, float tMax,
+					OccludesPrim occludesPrim) const;
+protected:
+	std::vector<int> parents;		//!< parent of each node, -1 for the root; made by the first refit
+	std::vector<int> slotLeaves;	//!< leaf holding each slot of primIndices; made by the first refit
+	double sahArea = 0.0;			//!< sum over nodes of area times cost (1 for interior nodes, count for leaves)
+
+	int buildRecursive(std::vector<AABB> &bounds, std::vector<glm::vec3> &centroids,
+					int first, int count, int depth);
+	void linkParents();
+	double nodeSAHArea(const BVHNode &node) const;
+	bool setBox(int nodeIndex, const AABB &box);
+};
+
+/**
+ * @fn	template <class PrimBounds> void BVH::refit(const std::vector<int> &slots, PrimBounds primBounds)
+ * @brief	Updates the boxes after some primitives moved, keeping the tree as
+ * 			it is. Each moved primitive's leaf is recomputed, then its ancestors
+ * 			bottom up; the walk stops at the first box that does not change, so
+ * 			the cost is O(moved primitives * depth). The tree may fit the new
+ * 			positions less well than a rebuilt one would; sahCost tells how much.
+ * @param	slots	  	The slots in primIndices of the primitives that moved.
+ * @param	primBounds	Called as primBounds(primIndices[i]) for the primitives of each
+ * 						leaf recomputed; returns the primitive's box.
+ */
+
+template <class PrimBounds>
+void BVH::refit(const std::vector<int> &slots, PrimBounds primBounds) {
+	if (nodes.empty()) return;
+	if (parents.empty()) {
+		linkParents();
+	}
+	for (int slot : slots) {
+		int nodeIndex = slotLeaves[slot];
+		const BVHNode &leaf = nodes[nodeIndex];
+		AABB box;
+		for (int i = leaf.first; i < leaf.first + leaf.count; i++) {
+			box.extend(primBounds(primIndices[i]));
+		}
+		while (setBox(nodeIndex, box) && parents[nodeIndex] >= 0) {
+			nodeIndex = parents[nodeIndex];
+			box = nodes[nodeIndex + 1].box;
+			box.extend(nodes[nodes[nodeIndex].rightChild].box);
+		}
+	}
+}
+
+/**
+ * @fn	template <class IntersectPrim> void BVH::intersect(const glm::vec3 &origin, const glm::vec3 &direction, float &tMax, IntersectPrim intersectPrim) const
+ * @brief	Finds the closest primitive along a ray. Children are visited near to
+ * 			far and subtrees that start beyond the closest hit so far are skipped.
+ * @param 		  	origin		 	Origin of the ray.
+ * @param 		  	direction	 	Direction of the ray.
+ * @param [in,out]	tMax		 	Closest hit so far; intersectPrim lowers it.
+ * @param 		  	intersectPrim	Called as intersectPrim(primIndex, tMax) for each
+ * 									candidate primitive. It must lower tMax if it
+ * 									finds a hit that is not beyond tMax.
+ */
+
+template <class IntersectPrim>
+void BVH::intersect(const glm::vec3 &origin, const glm::vec3 &direction, float &tMax,
+					IntersectPrim intersectPrim) const {
+	intersectLeaves(origin, direction, tMax, [&](int first, int count, float &t) {
+		for (int i = first; i < first + count; i++) {
+			intersectPrim(primIndices[i], t);
+		}
+	});
+}
+
+/**
+ * @fn	template <class IntersectLeaf> void BVH::intersectLeaves(const glm::vec3 &origin, const glm::vec3 &direction, float &tMax, IntersectLeaf intersectLeaf) const
+ * @brief	Same traversal as intersect, but hands over whole leaves, so the
+ * 			caller can test a leaf's primitives together (e.g., with SIMD).
+ * @param 		  	origin		 	Origin of the ray.
+ * @param 		  	direction	 	Direction of the ray.
+ * @param [in,out]	tMax		 	Closest hit so far; intersectLeaf lowers it.
+ * @param 		  	intersectLeaf	Called as intersectLeaf(first, count, tMax) for
+ * 									each candidate leaf, whose primitives are
+ * 									primIndices[first, first + count).
+ */
+
+template <class IntersectLeaf>
+void BVH::intersectLeaves(const glm::vec3 &origin, const glm::vec3 &direction, float &tMax,
+					IntersectLeaf intersectLeaf) const {
+	if (nodes.empty()) return;
+
+	const glm::vec3 invDir(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	int stack[MAX_DEPTH];
+	int top = 0;
+	float tEnter;
+
+	if (!nodes[0].box.intersect(origin, invDir, tMax, tEnter)) return;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		int nodeIndex = stack[--top];
+		const BVHNode &node = nodes[nodeIndex];
+		if (node.isLeaf()) {
+			intersectLeaf(node.first, node.count, tMax);
+			continue;
+		}
+		int leftIndex = nodeIndex + 1;
+		int rightIndex = node.rightChild;
+		float tLeft, tRight;
+		bool hitLeft = nodes[leftIndex].box.intersect(origin, invDir, tMax, tLeft);
+		bool hitRight = nodes[rightIndex].box.intersect(origin, invDir, tMax, tRight);
+		if (hitLeft && hitRight) {
+			// push the far child first so the near one is popped next
+			if (tLeft <= tRight) {
+				stack[top++] = rightIndex;
+				stack[top++] = leftIndex;
+			} else {
+				stack[top++] = leftIndex;
+				stack[top++] = rightIndex;
+			}
+		} else if (hitLeft) {
+			stack[top++] = leftIndex;
+		} else if (hitRight) {
+			stack[top++] = rightIndex;
+		}
+	}
+}
+
+/**
+ * @fn	template <class IntersectLeaf> void BVH::intersectPacket(const RayPacket &packet, float tMax[RayPacket::SIZE], IntersectLeaf intersectLeaf) const
+ * @brief	Traverses the hierarchy once for a whole packet of rays. A node is
+ * 			entered if any ray that reached it overlaps its box, and each leaf is
+ * 			handed over with the mask of the rays that reach it. Children are
+ * 			visited in the order that is nearer for the packet as a whole.
+ * @param 		  	packet		 	The rays.
+ * @param [in,out]	tMax		 	Closest hit so far, per ray; intersectLeaf lowers it.
+ * @param 		  	intersectLeaf	Called as intersectLeaf(first, count, mask) for
+ * 									each leaf some ray reaches. It must lower
+ * 									tMax[i] for each ray i in mask that hits a
+ * 									primitive in primIndices[first, first + count).
+ */
+
+template <class IntersectLeaf>
+void BVH::intersectPacket(const RayPacket &packet, float tMax[RayPacket::SIZE],
+					IntersectLeaf intersectLeaf) const {
+	if (nodes.empty()) return;
+
+	int stack[MAX_DEPTH];
+	unsigned stackMasks[MAX_DEPTH];
+	int top = 0;
+	float tEnter[RayPacket::SIZE];
+
+	unsigned rootMask = packet.intersect(nodes[0].box, tMax, packet.allLanes(), tEnter);
+	if (rootMask == 0) return;
+	stack[top] = 0;
+	stackMasks[top++] = rootMask;
+
+	while (top > 0) {
+		--top;
+		int nodeIndex = stack[top];
+		unsigned mask = stackMasks[top];
+		const BVHNode &node = nodes[nodeIndex];
+		if (node.isLeaf()) {
+			intersectLeaf(node.first, node.count, mask);
+			continue;
+		}
+		int leftIndex = nodeIndex + 1;
+		int rightIndex = node.rightChild;
+		float tLeft[RayPacket::SIZE], tRight[RayPacket::SIZE];
+		unsigned leftMask = packet.intersect(nodes[leftIndex].box, tMax, mask, tLeft);
+		unsigned rightMask = packet.intersect(nodes[rightIndex].box, tMax, mask, tRight);
+
+		// The child entered first by the first ray that reaches both is visited first.
+		bool leftFirst = true;
+		unsigned bothMask = leftMask & rightMask;
+		for (int i = 0; i < RayPacket::SIZE; i++) {
+			if ((bothMask >> i) & 1) {
+				leftFirst = tLeft[i] <= tRight[i];
+				break;
+			}
+		}
+		if (leftFirst) {
+			if (rightMask) { stack[top] = rightIndex; stackMasks[top++] = rightMask; }
+			if (leftMask) { stack[top] = leftIndex; stackMasks[top++] = leftMask; }
+		} else {
+			if (leftMask) { stack[top] = leftIndex; stackMasks[top++] = leftMask; }
+			if (rightMask) { stack[top] = rightIndex; stackMasks[top++] = rightMask; }
+		}
+	}
+}
+
+/**
+ * @fn	template <class VisitPrim> bool BVH::findContaining(const glm::vec3 &point, VisitPrim visitPrim) const
+ * @brief	Visits the primitives of the leaves whose boxes contain a point,
+ * 			until visitPrim accepts one. Only the few nodes around the point
+ * 			are entered, so this is much cheaper than tracing a ray.
+ * @param	point		The point.
+ * @param	visitPrim	Called as visitPrim(primIndex) for each candidate
+ * 						primitive; returns true to stop.
+ * @return	true iff visitPrim returned true.
+ */
+
+template <class VisitPrim>
+bool BVH::findContaining(const glm::vec3 &point, VisitPrim visitPrim) const {
+	if (nodes.empty()) return false;
+
+	int stack[MAX_DEPTH];
+	int top = 0;
+
+	stack[top++] = 0;
+	while (top > 0) {
+		int nodeIndex = stack[--top];
+		const BVHNode &node = nodes[nodeIndex];
+		if (!node.box.contains(point)) continue;
+		if (node.isLeaf()) {
+			for (int i = node.first; i < node.first + node.count; i++) {
+				if (visitPrim(primIndices[i])) return true;
+			}
+			continue;
+		}
+		stack[top++] = node.rightChild;
+		stack[top++] = nodeIndex + 1;
+	}
+	return false;
+}
+
+/**
+ * @fn	template <class OccludesPrim> bool BVH::occluded(const glm::vec3 &origin, const glm::vec3 &direction, float tMax, OccludesPrim occludesPrim) const
+ * @brief	Determines if any primitive blocks a ray before tMax. Stops at the
+ * 			first blocker found, so children are visited in whatever order is
+ * 			cheapest.
+ * @param	origin			Origin of the ray.
+ * @param	direction   	Direction of the ray.
+ * @param	tMax			Blockers at or beyond tMax do not count.
+ * @param	occludesPrim	Called as occludesPrim(primIndex) for each candidate
+ * 							primitive; returns true if it blocks the ray.
+ * @return	true iff some primitive blocks the ray.
+ */
+
+template <class OccludesPrim>
+bool BVH::occluded(const glm::vec3 &origin, const glm::vec3 &direction, float tMax,
+					OccludesPrim occludesPrim) const {
+	if (nodes.empty()) return false;
+
+	const glm::vec3 invDir(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	int stack[MAX_DEPTH];
+	int top = 0;
+	float tEnter;
+
+	stack[top++] = 0;
+	while (top > 0) {
+		int nodeIndex = stack[--top];
+		const BVHNode &node = nodes[nodeIndex];
+		if (!node.box.intersect(origin, invDir, tMax, tEnter)) continue;
+		if (node.isLeaf()) {
+			for (int i = node.first; i < node.first + node.count; i++) {
+				if (occludesPrim(primIndices[i])) return true;
+			}
+			continue;
+		}
+		stack[top++] = node.rightChild;
+		stack[top++] = nodeIndex + 1;
+	}
+	return false;
+}
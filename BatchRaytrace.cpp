@@ -0,0 +1,256 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "Defs.h"
+#include "IShape.h"
+#include "FrameBuffer.h"
+#include "Raytracer.h"
+#include "ProgressiveRenderer.h"
+#include "IScene.h"
+#include "Light.h"
+#include "Image.h"
+#include "Camera.h"
+
+/*
+ * Headless version of ProjectRaytrace.cpp. Builds the same scene, renders a
+ * number of frames without creating a window or an OpenGL context, and
+ * writes each frame to disk. Usage:
+ *
+ *   BatchRaytrace [-w width] [-h height] [-aa 1|3|adaptive] [-depth n]
+ *                 [-frames n] [-threads n] [-tile n] [-nopackets] [-animate]
+ *                 [-roulette n] [-wavefront] [-progressive] [-png] [-o prefix]
+ *
+ * Frame i is written to <prefix>_<i>.ppm (or .png). An empty prefix, -o "",
+ * skips writing, which is handy for timing runs. -aa adaptive traces one ray
+ * per pixel and supersamples only pixels that differ from their neighbors.
+ * -roulette n turns on Russian roulette for reflections past the n-th.
+ * -wavefront traces each tile in stages (RayTracer::wavefront) and prints
+ * the size, packet occupancy and time of each stage after the last frame.
+ * -progressive renders each frame with ProgressiveRenderer, as the window
+ * does, and reports when each pass was ready.
+ */
+
+struct BatchOptions {
+	int width = WINDOW_WIDTH;
+	int height = WINDOW_HEIGHT;
+	int antiAliasing = 1;
+	bool adaptive = false;
+	int depth = 0;
+	int frames = 1;
+	int numThreads = 0;
+	int tileSize = 16;
+	int rouletteMinDepth = -1;
+	bool usePackets = true;
+	bool animate = false;
+	bool png = false;
+	bool progressive = false;
+	bool wavefront = false;
+	std::string prefix = "frame";
+};
+
+Image im("usflag.ppm");
+
+std::vector<PositionalLightPtr> lights = {
+						new PositionalLight(glm::vec3(3, 30, 10), pureWhiteLight),
+						new SpotLight(glm::vec3(2, 30, 4), glm::vec3(0,-1,0), glm::radians(45.0f), pureWhiteLight)
+};
+
+RayTracer rayTrace(lightGray);
+PerspectiveCamera pCamera(glm::vec3(0, 10, 10), ORIGIN3D, Y_AXIS, M_PI_2);
+IScene scene(&pCamera, false);
+
+IShape *plane = new IPlane(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+IPlane *plane2 = new IPlane(glm::vec3(0.0f, -2.0f, -4.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+ISphere *sphere = new ISphere(glm::vec3(-6.0f, 3.0f, 0.0f), 6.0f);
+IEllipsoid *ellipsoid = new IEllipsoid(glm::vec3(-3.0f, 2.0f, 11.0f), glm::vec3(4.0f, 4.0f, 3.0f));
+ICylinderX *cylinderX = new ICylinderX(glm::vec3(16.0f, 2.0f, 8.0f), 2.0f, 8.0f);
+ICloseCylinderY *closedCylinderY = new ICloseCylinderY(glm::vec3(10.0f, 6.0f, 0.0f), 4.0f, 12.0f);
+IConeY *coneY = new IConeY(glm::vec3(20.0f, 6.0f, 0.0f), 1.0f, 8.0f);
+
+void buildScene() {
+	scene.addObject(new VisibleIShape(plane, tin));
+	scene.addObject(new VisibleIShape(sphere, polishedSilver));
+	scene.addObject(new VisibleIShape(ellipsoid, redPlastic));
+	scene.addObject(new VisibleIShape(cylinderX, cyanRubber));
+	scene.addObject(new VisibleIShape(coneY, gold));
+
+	scene.addTransparentObject(new VisibleIShape(plane2, red), 0.4f);
+
+	VisibleIShapePtr p;
+	p = new VisibleIShape(closedCylinderY, gold);
+	p->setTexture(&im);
+	scene.addObject(p);
+
+	scene.addObject(lights[0]);
+	scene.addObject(lights[1]);
+
+	scene.buildBVH();
+}
+
+/**
+ * @fn	void advanceAnimation()
+ * @brief	Moves the transparent plane back and forth in front of the closed
+ * 			cylinder, the same motion as the timer in ProjectRaytrace.cpp.
+ */
+
+void advanceAnimation() {
+	static bool movTowardFront = true;
+	float cylinderYZAxis = closedCylinderY->center.z;
+	if (plane2->a.z > cylinderYZAxis + closedCylinderY->radius + 8.0f) {
+		movTowardFront = false;
+	}
+	if (plane2->a.z < cylinderYZAxis - closedCylinderY->radius - 2.0f) {
+		movTowardFront = true;
+	}
+	plane2->a.z += movTowardFront ? 0.3f : -0.3f;
+}
+
+/**
+ * @fn	void printStages(const RenderStats &stats)
+ * @brief	Prints the counts of each stage of the wavefront pipeline.
+ * @param	stats	The counts, summed over all frames.
+ */
+
+void printStages(const RenderStats &stats) {
+	const char *names[] = { "primary", "shade", "shadow", "reflection" };
+	const StageStats *stages[] = { &stats.primaryStage, &stats.shadeStage, &stats.shadowStage, &stats.reflectionStage };
+	for (int i = 0; i < 4; i++) {
+		std::printf("%-10s %9lld batches %12lld rays %9.1f rays/batch", names[i],
+					stages[i]->batches, stages[i]->rays, stages[i]->meanQueueSize());
+		if (stages[i]->lanes > 0) {
+			std::printf(" %5.1f%% occupancy", 100.0 * stages[i]->occupancy());
+		}
+		std::printf(" %8.3f sec\n", stages[i]->seconds);
+	}
+}
+
+/**
+ * @fn	bool parseOptions(int argc, char *argv[], BatchOptions &options)
+ * @brief	Parses the command line.
+ * @param 		  	argc   	Number of arguments.
+ * @param 		  	argv   	The arguments.
+ * @param [in,out]	options	Receives the options given on the command line.
+ * @return	True iff the command line was valid.
+ */
+
+bool parseOptions(int argc, char *argv[], BatchOptions &options) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "-nopackets") {
+			options.usePackets = false;
+		} else if (arg == "-animate") {
+			options.animate = true;
+		} else if (arg == "-wavefront") {
+			options.wavefront = true;
+		} else if (arg == "-progressive") {
+			options.progressive = true;
+		} else if (arg == "-png") {
+			options.png = true;
+		} else if (arg == "-aa" && hasValue && std::string(argv[i + 1]) == "adaptive") {
+			options.adaptive = true;
+			i++;
+		} else if (arg == "-o" && hasValue) {
+			options.prefix = argv[++i];
+		} else if (hasValue && (arg == "-w" || arg == "-h" || arg == "-aa" || arg == "-depth" ||
+								arg == "-frames" || arg == "-threads" || arg == "-tile" || arg == "-roulette")) {
+			int value = std::atoi(argv[++i]);
+			if (arg == "-w") options.width = value;
+			else if (arg == "-h") options.height = value;
+			else if (arg == "-aa") options.antiAliasing = value;
+			else if (arg == "-depth") options.depth = value;
+			else if (arg == "-frames") options.frames = value;
+			else if (arg == "-threads") options.numThreads = value;
+			else if (arg == "-roulette") options.rouletteMinDepth = value;
+			else options.tileSize = value;
+		} else {
+			std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+			return false;
+		}
+	}
+	if (options.width <= 0 || options.height <= 0 || options.frames <= 0 || options.tileSize <= 0) {
+		std::cerr << "Width, height, frames and tile size must be positive." << std::endl;
+		return false;
+	}
+	if (options.antiAliasing != 1 && options.antiAliasing != 3) {
+		std::cerr << "Anti aliasing must be 1 or 3." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	BatchOptions options;
+	if (!parseOptions(argc, argv, options)) {
+		std::cerr << "Usage: " << argv[0] << " [-w width] [-h height] [-aa 1|3|adaptive] [-depth n] [-frames n]"
+					<< " [-threads n] [-tile n] [-nopackets] [-animate] [-roulette n] [-wavefront] [-progressive] [-png] [-o prefix]" << std::endl;
+		return 1;
+	}
+
+	FrameBuffer frameBuffer(options.width, options.height);
+	rayTrace.antiAliasing = options.antiAliasing;
+	rayTrace.adaptiveAntiAliasing = options.adaptive;
+	rayTrace.numThreads = options.numThreads;
+	rayTrace.tileSize = options.tileSize;
+	rayTrace.usePackets = options.usePackets;
+	rayTrace.wavefront = options.wavefront;
+	rayTrace.russianRoulette = options.rouletteMinDepth >= 0;
+	rayTrace.rouletteMinDepth = options.rouletteMinDepth;
+	buildScene();
+
+	ProgressiveRenderer progressive;
+	double totalSec = 0.0;
+	double totalRays = 0.0;
+	RenderStats totalStats;
+	for (int frame = 0; frame < options.frames; frame++) {
+		if (options.animate && frame > 0) {
+			advanceAnimation();
+		}
+		auto frameStart = std::chrono::steady_clock::now();
+		pCamera.calculateViewingParameters(frameBuffer.getWindowWidth() / 2, frameBuffer.getWindowHeight());
+		pCamera.changeConfiguration(glm::vec3(12, 20, 18), ORIGIN3D, Y_AXIS);
+		if (options.progressive) {
+			progressive.start(rayTrace, options.width, options.height, options.depth, scene);
+			progressive.wait();
+			progressive.present(frameBuffer);
+			double frameSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count();
+			totalSec += frameSec;
+			std::cout << "Frame " << frame << ": " << frameSec << " sec, passes ready after";
+			for (int pass = 0; pass < progressive.numPasses(); pass++) {
+				std::cout << " " << progressive.passSeconds(pass);
+			}
+			std::cout << " sec" << std::endl;
+		} else {
+			RenderStats stats = rayTrace.raytraceScene(frameBuffer, options.depth, scene);
+			double frameSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count();
+			totalSec += frameSec;
+			totalRays += (double)stats.primaryRays;
+			totalStats += stats;
+			std::cout << "Frame " << frame << ": " << frameSec << " sec, "
+						<< stats.primaryRays / frameSec / 1.0e6 << " M primary rays/sec" << std::endl;
+		}
+
+		if (!options.prefix.empty()) {
+			char suffix[32];
+			std::snprintf(suffix, sizeof(suffix), "_%04d.%s", frame, options.png ? "png" : "ppm");
+			std::string fileName = options.prefix + suffix;
+			bool written = options.png ? frameBuffer.writePNG(fileName) : frameBuffer.writePPM(fileName);
+			if (!written) {
+				std::cerr << "Could not write " << fileName << std::endl;
+				return 1;
+			}
+		}
+	}
+
+	std::cout << "Total: " << totalSec << " sec for " << options.frames << " frames";
+	if (!options.progressive) {
+		std::cout << ", " << totalRays / totalSec / 1.0e6 << " M primary rays/sec";
+	}
+	std::cout << std::endl;
+	if (options.wavefront && !options.progressive) {
+		printStages(totalStats);
+	}
+	return 0;
+}
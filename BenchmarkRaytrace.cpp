@@ -0,0 +1,887 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include "Defs.h"
+#include "IShape.h"
+#include "FrameBuffer.h"
+#include "Raytracer.h"
+#include "IScene.h"
+#include "Light.h"
+#include "Image.h"
+#include "Camera.h"
+#include "QuadricKernel.h"
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+/*
+ * Ray tracing benchmark. Renders a fixed set of scenes over a sweep of
+ * resolutions, anti-aliasing levels and reflection depths, and writes one
+ * JSON record per render. Usage:
+ *
+ *   BenchmarkRaytrace [-scenes project,spheres,mesh,lights] [-res 500x250,...]
+ *                     [-aa 1,3,adaptive] [-depth 0,2] [-repeat n] [-threads n] [-animate n]
+ *                     [-lighttree cutoff]
+ *                     [-pipeline ray,wavefront] [-o results.json] [-images prefix]
+ *
+ * The scenes are generated with a fixed seed, so every build renders the same
+ * images and the counts of rays and intersection tests only change when the
+ * algorithms do. Each configuration is rendered repeat times; the fastest
+ * time is reported, along with the mean. In the output, adaptive
+ * anti-aliasing is reported as "aa": 0. ns_per_intersection_test is the
+ * render time divided by the number of ray-object tests, so it also carries
+ * the cost of traversal and shading. shadow_rays_avoided counts the lights
+ * shaded without a shadow ray, because RayTracer::castsShadowRay found they
+ * could add nothing visible. occluder_cache_hit_rate is the share of
+ * shadow rays, among those tried first against the object that last blocked
+ * their light, that it blocked. With -images, the last render of each
+ * configuration is saved as a PNG, to check the scenes by eye. Runs with
+ * -pipeline wavefront also report, for each stage of RayTracer::wavefront,
+ * the batches, rays, mean queue size, packet occupancy and seconds. Three more
+ * scenes can be named with -scenes: trimesh, the mesh scene with each sphere
+ * one ITriangleMesh; bigmesh, the same with 3.9 million triangles; and
+ * instances, 10,000 instances of one mesh. With -animate n, n quadrics of the
+ * scene move before each render and the BVH is refit; refit_sec is the mean
+ * time that took, and rebuilds counts the refits that rebuilt instead. The
+ * rig scene has 320 attenuated lights; -lighttree cutoff lights each hit
+ * only with the lights IScene::lightTree selects with that cutoff. The soft
+ * scene is lit by a rectangle and a disk area light; area_light_refinements
+ * counts the hits in a penumbra, where every stratum was sampled.
+ *
+ * Each scene is freed once its sweep is done. scene_memory_bytes is how much
+ * the resident set grew while the scene was built. peak_memory_bytes in a run
+ * is the largest resident set since its scene started building; on Linux
+ * the high-water mark is reset for each scene, but elsewhere it cannot be,
+ * so there it is the largest over all the scenes so far. The top-level
+ * peak_memory_bytes is the largest over the whole sweep.
+ */
+
+/**
+ * @struct	BenchmarkScene
+ * @brief	One of the benchmark scenes, with the camera that views it.
+ */
+
+struct BenchmarkScene {
+	std::string name;				//!< name used on the command line and in the output
+	PerspectiveCamera *camera;		//!< camera looking at the scene
+	IScene *scene;					//!< the scene, with its BVH built
+	bool halfWidthView = false;		//!< ProjectRaytrace sets its camera up for half the window width
+	std::vector<const IShape *> sharedShapes;	//!< shapes used by instances, freed once each by freeScene
+};
+
+/**
+ * @struct	BenchmarkOptions
+ * @brief	The sweep to run, from the command line.
+ */
+
+struct BenchmarkOptions {
+	static const int ADAPTIVE = 0;	//!< antiAliasing entry for adaptive anti-aliasing
+	std::vector<std::string> scenes = { "project", "spheres", "mesh", "lights" };
+	std::vector<std::pair<int, int>> resolutions = { { WINDOW_WIDTH, WINDOW_HEIGHT } };
+	std::vector<int> antiAliasing = { 1, 3, ADAPTIVE };
+	std::vector<int> depths = { 0, 2 };
+	std::vector<std::string> pipelines = { "ray" };
+	int repeat = 3;
+	int numThreads = 0;
+	int animate = 0;
+	float lightCutoff = -1.0f;		//!< with -lighttree, RayTracer::lightCutoff; negative leaves the light tree off
+	std::string outputFile;
+	std::string imagePrefix;
+};
+
+Image im("usflag.ppm");
+
+/**
+ * @fn	float nextFloat(std::mt19937 &rng)
+ * @brief	A random number in [0, 1). Computed straight from the generator's
+ * 			output, which the standard fixes, unlike the distributions, so all
+ * 			compilers build identical scenes.
+ */
+
+float nextFloat(std::mt19937 &rng) {
+	return (rng() >> 8) * (1.0f / 16777216.0f);
+}
+
+/**
+ * @fn	BenchmarkScene buildProjectScene()
+ * @brief	The scene of ProjectRaytrace.cpp: a handful of quadrics, a textured
+ * 			closed cylinder, a transparent plane and two lights.
+ */
+
+BenchmarkScene buildProjectScene() {
+	BenchmarkScene result;
+	result.name = "project";
+	result.camera = new PerspectiveCamera(glm::vec3(12, 20, 18), ORIGIN3D, Y_AXIS, M_PI_2);
+	result.scene = new IScene(result.camera, false);
+	result.halfWidthView = true;
+	IScene &scene = *result.scene;
+
+	scene.addObject(new VisibleIShape(new IPlane(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)), tin));
+	scene.addObject(new VisibleIShape(new ISphere(glm::vec3(-6.0f, 3.0f, 0.0f), 6.0f), polishedSilver));
+	scene.addObject(new VisibleIShape(new IEllipsoid(glm::vec3(-3.0f, 2.0f, 11.0f), glm::vec3(4.0f, 4.0f, 3.0f)), redPlastic));
+	scene.addObject(new VisibleIShape(new ICylinderX(glm::vec3(16.0f, 2.0f, 8.0f), 2.0f, 8.0f), cyanRubber));
+	scene.addObject(new VisibleIShape(new IConeY(glm::vec3(20.0f, 6.0f, 0.0f), 1.0f, 8.0f), gold));
+	scene.addTransparentObject(new VisibleIShape(new IPlane(glm::vec3(0.0f, -2.0f, -4.0f), glm::vec3(0.0f, 0.0f, 1.0f)), red), 0.4f);
+
+	VisibleIShapePtr p = new VisibleIShape(new ICloseCylinderY(glm::vec3(10.0f, 6.0f, 0.0f), 4.0f, 12.0f), gold);
+	p->setTexture(&im);
+	scene.addObject(p);
+
+	scene.addObject(new PositionalLight(glm::vec3(3, 30, 10), pureWhiteLight));
+	scene.addObject(new SpotLight(glm::vec3(2, 30, 4), glm::vec3(0, -1, 0), glm::radians(45.0f), pureWhiteLight));
+	scene.buildBVH();
+	return result;
+}
+
+/**
+ * @fn	BenchmarkScene buildSphereScene()
+ * @brief	A field of 10,000 small spheres on a 100 x 100 grid with random
+ * 			jitter, radii and materials, over a ground plane, lit by two lights.
+ */
+
+BenchmarkScene buildSphereScene() {
+	BenchmarkScene result;
+	result.name = "spheres";
+	result.camera = new PerspectiveCamera(glm::vec3(0, 30, 60), glm::vec3(0, 0, 5), Y_AXIS, glm::radians(60.0f));
+	result.scene = new IScene(result.camera, false);
+	IScene &scene = *result.scene;
+
+	const Material palette[] = { polishedSilver, redPlastic, cyanRubber, gold, jade, ruby };
+	const int N = 100;
+	const float SPACING = 1.0f;
+	std::mt19937 rng(287);
+	scene.addObject(new VisibleIShape(new IPlane(ORIGIN3D, Y_AXIS), tin));
+	for (int i = 0; i < N; i++) {
+		for (int j = 0; j < N; j++) {
+			float radius = 0.2f + 0.25f * nextFloat(rng);
+			float x = (i - N / 2) * SPACING + 0.3f * (nextFloat(rng) - 0.5f);
+			float z = (j - N / 2) * SPACING + 0.3f * (nextFloat(rng) - 0.5f);
+			const Material &material = palette[rng() % (sizeof(palette) / sizeof(palette[0]))];
+			scene.addObject(new VisibleIShape(new ISphere(glm::vec3(x, radius, z), radius), material));
+		}
+	}
+	scene.addObject(new PositionalLight(glm::vec3(-20, 40, 30), pureWhiteLight));
+	scene.addObject(new PositionalLight(glm::vec3(30, 25, -10), pureWhiteLight));
+	scene.buildBVH();
+	return result;
+}
+
+/**
+ * @struct	Face
+ * @brief	A triangle of a mesh, as three vertex indices.
+ */
+
+struct Face {
+	int a, b, c;
+	Face(int A, int B, int C) : a(A), b(B), c(C) {}
+};
+
+/**
+ * @fn	void makeIcosphere(int subdivisions, std::vector<glm::vec3> &vertices, std::vector<Face> &faces)
+ * @brief	Makes a unit sphere out of triangles: an icosahedron whose faces are
+ * 			split into four, subdivisions times, with the new vertices pushed
+ * 			out onto the sphere. Gives 20 * 4^subdivisions triangles.
+ * @param 		  	subdivisions	Number of times the faces are split.
+ * @param [in,out]	vertices		The vertices, on the unit sphere.
+ * @param [in,out]	faces			The triangles.
+ */
+
+void makeIcosphere(int subdivisions, std::vector<glm::vec3> &vertices, std::vector<Face> &faces) {
+	const float T = (1.0f + std::sqrt(5.0f)) / 2.0f;
+	vertices = {
+		{ -1, T, 0 }, { 1, T, 0 }, { -1, -T, 0 }, { 1, -T, 0 },
+		{ 0, -1, T }, { 0, 1, T }, { 0, -1, -T }, { 0, 1, -T },
+		{ T, 0, -1 }, { T, 0, 1 }, { -T, 0, -1 }, { -T, 0, 1 } };
+	for (glm::vec3 &v : vertices) {
+		v = glm::normalize(v);
+	}
+	faces = {
+		{ 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+		{ 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+		{ 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+		{ 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 } };
+
+	for (int level = 0; level < subdivisions; level++) {
+		std::map<std::pair<int, int>, int> midpoints;
+		auto midpoint = [&](int a, int b) {
+			std::pair<int, int> key(std::min(a, b), std::max(a, b));
+			auto found = midpoints.find(key);
+			if (found != midpoints.end()) {
+				return found->second;
+			}
+			vertices.push_back(glm::normalize(vertices[a] + vertices[b]));
+			int index = (int)vertices.size() - 1;
+			midpoints[key] = index;
+			return index;
+		};
+		std::vector<Face> split;
+		for (const Face &f : faces) {
+			int ab = midpoint(f.a, f.b);
+			int bc = midpoint(f.b, f.c);
+			int ca = midpoint(f.c, f.a);
+			split.push_back(Face(f.a, ab, ca));
+			split.push_back(Face(f.b, bc, ab));
+			split.push_back(Face(f.c, ca, bc));
+			split.push_back(Face(ab, bc, ca));
+		}
+		faces.swap(split);
+	}
+}
+
+/**
+ * @fn	void addIcosphere(IScene &scene, const glm::vec3 &center, float radius, int subdivisions, const Material &material)
+ * @brief	Adds an icosphere to the scene, one ITriangle per face.
+ * @param [in,out]	scene			The scene.
+ * @param 		  	center			Center of the sphere.
+ * @param 		  	radius			Radius of the sphere.
+ * @param 		  	subdivisions	Number of times the faces are split.
+ * @param 		  	material		Material of every triangle.
+ */
+
+void addIcosphere(IScene &scene, const glm::vec3 &center, float radius, int subdivisions, const Material &material) {
+	std::vector<glm::vec3> vertices;
+	std::vector<Face> faces;
+	makeIcosphere(subdivisions, vertices, faces);
+	for (const Face &f : faces) {
+		scene.addObject(new VisibleIShape(new ITriangle(center + radius * vertices[f.a],
+														center + radius * vertices[f.b],
+														center + radius * vertices[f.c]), material));
+	}
+}
+
+/**
+ * @fn	ITriangleMesh *makeIcosphereMesh(const glm::vec3 &center, float radius, int subdivisions)
+ * @brief	Makes an icosphere as a single ITriangleMesh, with flat shading like
+ * 			addIcosphere.
+ * @param	center			Center of the sphere.
+ * @param	radius			Radius of the sphere.
+ * @param	subdivisions	Number of times the faces are split.
+ * @return	The mesh.
+ */
+
+ITriangleMesh *makeIcosphereMesh(const glm::vec3 &center, float radius, int subdivisions) {
+	std::vector<glm::vec3> vertices;
+	std::vector<Face> faces;
+	makeIcosphere(subdivisions, vertices, faces);
+	for (glm::vec3 &v : vertices) {
+		v = center + radius * v;
+	}
+	std::vector<int> indices;
+	indices.reserve(3 * faces.size());
+	for (const Face &f : faces) {
+		indices.push_back(f.a);
+		indices.push_back(f.b);
+		indices.push_back(f.c);
+	}
+	return new ITriangleMesh(vertices, indices);
+}
+
+/**
+ * @fn	BenchmarkScene buildMeshScene()
+ * @brief	Three finely tessellated spheres, about 15,000 triangles in all,
+ * 			over a ground plane.
+ */
+
+BenchmarkScene buildMeshScene() {
+	BenchmarkScene result;
+	result.name = "mesh";
+	result.camera = new PerspectiveCamera(glm::vec3(0, 8, 20), glm::vec3(0, 3, 0), Y_AXIS, glm::radians(60.0f));
+	result.scene = new IScene(result.camera, false);
+	IScene &scene = *result.scene;
+
+	scene.addObject(new VisibleIShape(new IPlane(ORIGIN3D, Y_AXIS), tin));
+	addIcosphere(scene, glm::vec3(-7, 3, 0), 3.0f, 4, polishedSilver);
+	addIcosphere(scene, glm::vec3(0, 3, -2), 3.0f, 4, gold);
+	addIcosphere(scene, glm::vec3(7, 3, 0), 3.0f, 4, redPlastic);
+	scene.addObject(new PositionalLight(glm::vec3(-10, 20, 15), pureWhiteLight));
+	scene.addObject(new PositionalLight(glm::vec3(15, 15, 10), pureWhiteLight));
+	scene.buildBVH();
+	return result;
+}
+
+/**
+ * @fn	BenchmarkScene buildTriangleMeshScene(const std::string &name, int subdivisions)
+ * @brief	The mesh scene, with each sphere a single ITriangleMesh. At 4
+ * 			subdivisions it renders the same image as the mesh scene; at 8 it
+ * 			has about 3.9 million triangles.
+ * @param	name			Name of the scene.
+ * @param	subdivisions	Number of times the faces of each sphere are split.
+ */
+
+BenchmarkScene buildTriangleMeshScene(const std::string &name, int subdivisions) {
+	BenchmarkScene result;
+	result.name = name;
+	result.camera = new PerspectiveCamera(glm::vec3(0, 8, 20), glm::vec3(0, 3, 0), Y_AXIS, glm::radians(60.0f));
+	result.scene = new IScene(result.camera, false);
+	IScene &scene = *result.scene;
+
+	scene.addObject(new VisibleIShape(new IPlane(ORIGIN3D, Y_AXIS), tin));
+	scene.addObject(new VisibleIShape(makeIcosphereMesh(glm::vec3(-7, 3, 0), 3.0f, subdivisions), polishedSilver));
+	scene.addObject(new VisibleIShape(makeIcosphereMesh(glm::vec3(0, 3, -2), 3.0f, subdivisions), gold));
+	scene.addObject(new VisibleIShape(makeIcosphereMesh(glm::vec3(7, 3, 0), 3.0f, subdivisions), redPlastic));
+	scene.addObject(new PositionalLight(glm::vec3(-10, 20, 15), pureWhiteLight));
+	scene.addObject(new PositionalLight(glm::vec3(15, 15, 10), pureWhiteLight));
+	scene.buildBVH();
+	return result;
+}
+
+/**
+ * @fn	BenchmarkScene buildInstanceScene()
+ * @brief	The sphere scene's grid, with each sphere an instance of one shared
+ * 			icosphere mesh of 5,120 triangles, squashed, stretched and turned by
+ * 			its own transform: 51 million triangles, stored once.
+ */
+
+BenchmarkScene buildInstanceScene() {
+	BenchmarkScene result;
+	result.name = "instances";
+	result.camera = new PerspectiveCamera(glm::vec3(0, 30, 60), glm::vec3(0, 0, 5), Y_AXIS, glm::radians(60.0f));
+	result.scene = new IScene(result.camera, false);
+	IScene &scene = *result.scene;
+
+	const Material palette[] = { polishedSilver, redPlastic, cyanRubber, gold, jade, ruby };
+	const int N = 100;
+	const float SPACING = 1.0f;
+	const IShape *asset = makeIcosphereMesh(ORIGIN3D, 1.0f, 4);
+	result.sharedShapes.push_back(asset);
+	std::mt19937 rng(287);
+	scene.addObject(new VisibleIShape(new IPlane(ORIGIN3D, Y_AXIS), tin));
+	for (int i = 0; i < N; i++) {
+		for (int j = 0; j < N; j++) {
+			glm::vec3 size(0.2f + 0.25f * nextFloat(rng), 0.2f + 0.25f * nextFloat(rng), 0.2f + 0.25f * nextFloat(rng));
+			float angle = M_2PI * nextFloat(rng);
+			float x = (i - N / 2) * SPACING + 0.3f * (nextFloat(rng) - 0.5f);
+			float z = (j - N / 2) * SPACING + 0.3f * (nextFloat(rng) - 0.5f);
+			const Material &material = palette[rng() % (sizeof(palette) / sizeof(palette[0]))];
+			// Scale, then turn about y, then move up onto the plane and out to (x, z).
+			float c = std::cos(angle), s = std::sin(angle);
+			glm::mat4 transform(c * size.x, 0, -s * size.x, 0,
+								0, size.y, 0, 0,
+								s * size.z, 0, c * size.z, 0,
+								x, size.y, z, 1);
+			scene.addObject(new VisibleIShape(new IInstance(asset, transform), material));
+		}
+	}
+	scene.addObject(new PositionalLight(glm::vec3(-20, 40, 30), pureWhiteLight));
+	scene.addObject(new PositionalLight(glm::vec3(30, 25, -10), pureWhiteLight));
+	scene.buildBVH();
+	return result;
+}
+
+/**
+ * @fn	BenchmarkScene buildManyLightsScene()
+ * @brief	A few quadrics over a ground plane, lit by 64 dim lights on an 8 x 8
+ * 			grid, so shading and shadow rays dominate.
+ */
+
+BenchmarkScene buildManyLightsScene() {
+	BenchmarkScene result;
+	result.name = "lights";
+	result.camera = new PerspectiveCamera(glm::vec3(0, 15, 25), ORIGIN3D, Y_AXIS, glm::radians(60.0f));
+	result.scene = new IScene(result.camera, false);
+	IScene &scene = *result.scene;
+
+	scene.addObject(new VisibleIShape(new IPlane(ORIGIN3D, Y_AXIS), tin));
+	scene.addObject(new VisibleIShape(new ISphere(glm::vec3(-6, 4, 0), 4.0f), polishedSilver));
+	scene.addObject(new VisibleIShape(new IEllipsoid(glm::vec3(4, 2, 6), glm::vec3(3, 2, 2)), redPlastic));
+	scene.addObject(new VisibleIShape(new ICylinderY(glm::vec3(6, 4, -4), 2.0f, 8.0f), cyanRubber));
+	scene.addObject(new VisibleIShape(new IConeY(glm::vec3(-2, 6, -8), 1.0f, 6.0f), gold));
+
+	const float AMBIENT = 0.2f / 64;
+	const float DIFFUSE = 2.0f / 64;
+	const LightColor dimLight(color(AMBIENT, AMBIENT, AMBIENT), color(DIFFUSE, DIFFUSE, DIFFUSE), color(DIFFUSE, DIFFUSE, DIFFUSE));
+	for (int i = 0; i < 8; i++) {
+		for (int j = 0; j < 8; j++) {
+			scene.addObject(new PositionalLight(glm::vec3(-21 + 6 * i, 20, -21 + 6 * j), dimLight));
+		}
+	}
+	scene.buildBVH();
+	return result;
+}
+
+/**
+ * @fn	BenchmarkScene buildLightRigScene()
+ * @brief	A grid of spheres over a ground plane, lit by a rig of 256
+ * 			attenuated point lights and 64 spotlights aimed down, so that each
+ * 			hit is lit mostly by the lights near it.
+ */
+
+BenchmarkScene buildLightRigScene() {
+	BenchmarkScene result;
+	result.name = "rig";
+	result.camera = new PerspectiveCamera(glm::vec3(0, 25, 40), ORIGIN3D, Y_AXIS, glm::radians(60.0f));
+	result.scene = new IScene(result.camera, false);
+	IScene &scene = *result.scene;
+
+	scene.addObject(new VisibleIShape(new IPlane(ORIGIN3D, Y_AXIS), tin));
+	const Material materials[] = { polishedSilver, redPlastic, cyanRubber, gold };
+	for (int i = 0; i < 8; i++) {
+		for (int j = 0; j < 8; j++) {
+			scene.addObject(new VisibleIShape(new ISphere(glm::vec3(-28 + 8 * i, 1.5f, -28 + 8 * j), 1.5f),
+												materials[(i + j) % 4]));
+		}
+	}
+
+	const LightColor pointLight(color(0.002f, 0.002f, 0.002f), color(0.5f, 0.5f, 0.45f), color(0.5f, 0.5f, 0.45f));
+	for (int i = 0; i < 16; i++) {
+		for (int j = 0; j < 16; j++) {
+			PositionalLight *light = new PositionalLight(glm::vec3(-30 + 4 * i, 4, -30 + 4 * j), pointLight);
+			light->setAttenuation(true);
+			light->setAttenuationParams(LightAttenuationParameters(1, 0, 1));
+			scene.addObject(light);
+		}
+	}
+	const LightColor spotColor(color(0.002f, 0.002f, 0.002f), color(0.6f, 0.4f, 0.2f), color(0.6f, 0.4f, 0.2f));
+	for (int i = 0; i < 8; i++) {
+		for (int j = 0; j < 8; j++) {
+			SpotLight *light = new SpotLight(glm::vec3(-28 + 8 * i, 8, -28 + 8 * j), -Y_AXIS, glm::radians(40.0f), spotColor);
+			light->setAttenuation(true);
+			light->setAttenuationParams(LightAttenuationParameters(1, 0, 0.25f));
+			scene.addObject(light);
+		}
+	}
+	scene.buildBVH();
+	return result;
+}
+
+/**
+ * @fn	BenchmarkScene buildSoftShadowScene()
+ * @brief	A few quadrics over a ground plane, lit by one rectangle and one
+ * 			disk area light, so that most shadows have a wide penumbra.
+ */
+
+BenchmarkScene buildSoftShadowScene() {
+	BenchmarkScene result;
+	result.name = "soft";
+	result.camera = new PerspectiveCamera(glm::vec3(0, 15, 25), ORIGIN3D, Y_AXIS, glm::radians(60.0f));
+	result.scene = new IScene(result.camera, false);
+	IScene &scene = *result.scene;
+
+	scene.addObject(new VisibleIShape(new IPlane(ORIGIN3D, Y_AXIS), tin));
+	scene.addObject(new VisibleIShape(new ISphere(glm::vec3(-6, 4, 0), 4.0f), polishedSilver));
+	scene.addObject(new VisibleIShape(new IEllipsoid(glm::vec3(4, 2, 6), glm::vec3(3, 2, 2)), redPlastic));
+	scene.addObject(new VisibleIShape(new ICylinderY(glm::vec3(6, 4, -4), 2.0f, 8.0f), cyanRubber));
+	scene.addObject(new VisibleIShape(new IConeY(glm::vec3(-2, 6, -8), 1.0f, 6.0f), gold));
+
+	const LightColor halfLight(color(0.1f, 0.1f, 0.1f), color(0.6f, 0.6f, 0.6f), color(0.6f, 0.6f, 0.6f));
+	scene.addObject(new RectAreaLight(glm::vec3(-10, 20, 10), -Y_AXIS, 8.0f, 4.0f, halfLight));
+	scene.addObject(new DiskAreaLight(glm::vec3(15, 15, -5), -Y_AXIS, 3.0f, halfLight));
+	scene.buildBVH();
+	return result;
+}
+
+/**
+ * @fn	bool buildScene(const std::string &name, BenchmarkScene &result)
+ * @brief	Builds a benchmark scene by name.
+ * @param 		  	name  	Name of the scene.
+ * @param [in,out]	result	The scene.
+ * @return	True iff the name is known.
+ */
+
+bool buildScene(const std::string &name, BenchmarkScene &result) {
+	if (name == "project") result = buildProjectScene();
+	else if (name == "spheres") result = buildSphereScene();
+	else if (name == "mesh") result = buildMeshScene();
+	else if (name == "trimesh") result = buildTriangleMeshScene(name, 4);
+	else if (name == "bigmesh") result = buildTriangleMeshScene(name, 8);
+	else if (name == "instances") result = buildInstanceScene();
+	else if (name == "lights") result = buildManyLightsScene();
+	else if (name == "rig") result = buildLightRigScene();
+	else if (name == "soft") result = buildSoftShadowScene();
+	else return false;
+	return true;
+}
+
+/**
+ * @fn	bool isSceneName(const std::string &name)
+ * @brief	Tells whether buildScene knows a scene, without building it.
+ * @param	name	Name of the scene.
+ * @return	True iff the name is known.
+ */
+
+bool isSceneName(const std::string &name) {
+	const char *names[] = { "project", "spheres", "mesh", "trimesh", "bigmesh", "instances", "lights", "rig", "soft" };
+	for (const char *known : names) {
+		if (name == known) return true;
+	}
+	return false;
+}
+
+/**
+ * @fn	void freeScene(BenchmarkScene &bench)
+ * @brief	Deletes a benchmark scene: its objects and their shapes, its lights,
+ * 			the shapes its instances share, the scene and the camera. Textures
+ * 			are globals and are kept.
+ * @param [in,out]	bench	The scene; its pointers are left null.
+ */
+
+void freeScene(BenchmarkScene &bench) {
+	for (const std::vector<VisibleIShapePtr> *objects : { &bench.scene->visibleObjects, &bench.scene->transparentObjects }) {
+		for (VisibleIShapePtr obj : *objects) {
+			delete obj->shape;
+			delete obj;
+		}
+	}
+	for (PositionalLightPtr light : bench.scene->lights) {
+		delete light;
+	}
+	for (const IShape *shape : bench.sharedShapes) {
+		delete shape;
+	}
+	bench.sharedShapes.clear();
+	delete bench.scene;
+	delete bench.camera;
+	bench.scene = nullptr;
+	bench.camera = nullptr;
+#ifdef __GLIBC__
+	malloc_trim(0);		// give the freed pages back, so the next scene's growth is measured from here
+#endif
+}
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+/**
+ * @fn	long long procStatusBytes(const char *field)
+ * @brief	Reads a memory size from /proc/self/status (Linux).
+ * @param	field	The field, with its colon, e.g. "VmRSS:".
+ * @return	The size in bytes, or -1 if it could not be read.
+ */
+
+long long procStatusBytes(const char *field) {
+	FILE *status = std::fopen("/proc/self/status", "r");
+	if (status == nullptr) return -1;
+	char line[256];
+	long long kilobytes = -1;
+	const size_t length = std::strlen(field);
+	while (std::fgets(line, sizeof(line), status) != nullptr) {
+		if (std::strncmp(line, field, length) == 0) {
+			kilobytes = std::atoll(line + length);
+			break;
+		}
+	}
+	std::fclose(status);
+	return kilobytes < 0 ? -1 : kilobytes * 1024;
+}
+#endif
+
+/**
+ * @fn	long long currentMemoryBytes()
+ * @brief	The physical memory the process uses now.
+ * @return	Resident set size in bytes, or 0 if unknown.
+ */
+
+long long currentMemoryBytes() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return (long long)counters.WorkingSetSize;
+	}
+	return 0;
+#elif defined(__APPLE__)
+	return 0;
+#else
+	return std::max(0LL, procStatusBytes("VmRSS:"));
+#endif
+}
+
+/**
+ * @fn	void resetPeakMemory()
+ * @brief	Starts a new high-water mark for peakMemoryBytes, where the system
+ * 			allows it (Linux); elsewhere does nothing.
+ */
+
+void resetPeakMemory() {
+#if !defined(_WIN32) && !defined(__APPLE__)
+	FILE *clearRefs = std::fopen("/proc/self/clear_refs", "w");
+	if (clearRefs != nullptr) {
+		std::fputs("5", clearRefs);
+		std::fclose(clearRefs);
+	}
+#endif
+}
+
+/**
+ * @fn	long long peakMemoryBytes()
+ * @brief	The largest amount of physical memory the process has used since
+ * 			the last resetPeakMemory, or since it started where that cannot be
+ * 			reset.
+ * @return	Peak resident set size in bytes, or 0 if unknown.
+ */
+
+long long peakMemoryBytes() {
+#if !defined(_WIN32) && !defined(__APPLE__)
+	const long long highWaterMark = procStatusBytes("VmHWM:");
+	if (highWaterMark >= 0) {
+		return highWaterMark;
+	}
+#endif
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return (long long)counters.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return (long long)usage.ru_maxrss;			// bytes
+#else
+	return (long long)usage.ru_maxrss * 1024;	// kilobytes
+#endif
+#endif
+}
+
+/**
+ * @fn	std::vector<std::string> splitList(const std::string &list)
+ * @brief	Splits a comma separated list.
+ */
+
+std::vector<std::string> splitList(const std::string &list) {
+	std::vector<std::string> items;
+	std::stringstream input(list);
+	std::string item;
+	while (std::getline(input, item, ',')) {
+		if (!item.empty()) {
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+/**
+ * @fn	bool animateScene(IScene &scene, int count, int frame)
+ * @brief	Moves the first count quadrics of a scene up or down a little, as an
+ * 			animation would between frames, and refits the scene's BVH.
+ * @param [in,out]	scene	The scene.
+ * @param 		  	count	Number of quadrics to move.
+ * @param 		  	frame	The frame; even frames move up and odd ones back down.
+ * @return	True if the BVH was rebuilt rather than refit.
+ */
+
+bool animateScene(IScene &scene, int count, int frame) {
+	const float step = frame % 2 == 0 ? 0.05f : -0.05f;
+	for (unsigned int i = 0; i < scene.visibleObjects.size() && count > 0; i++) {
+		IQuadricSurface *quadric = dynamic_cast<IQuadricSurface *>(scene.visibleObjects[i]->shape);
+		if (quadric != nullptr) {
+			quadric->center.y += step;
+			scene.markDirty(i);
+			count--;
+		}
+	}
+	return scene.refitBVH();
+}
+
+/**
+ * @fn	void writeStage(FILE *output, const char *name, const StageStats &stage)
+ * @brief	Writes the counts of one wavefront stage as a JSON member.
+ */
+
+void writeStage(FILE *output, const char *name, const StageStats &stage) {
+	std::fprintf(output, ", \"%s\": {\"batches\": %lld, \"rays\": %lld, \"mean_queue\": %.1f,"
+				" \"occupancy\": %.4f, \"sec\": %.6f}",
+				name, stage.batches, stage.rays, stage.meanQueueSize(), stage.occupancy(), stage.seconds);
+}
+
+/**
+ * @fn	bool parseOptions(int argc, char *argv[], BenchmarkOptions &options)
+ * @brief	Parses the command line.
+ * @param 		  	argc   	Number of arguments.
+ * @param 		  	argv   	The arguments.
+ * @param [in,out]	options	Receives the options given on the command line.
+ * @return	True iff the command line was valid. Scene names are checked here,
+ * 			so a bad one is reported before any output is written.
+ */
+
+bool parseOptions(int argc, char *argv[], BenchmarkOptions &options) {
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string arg = argv[i];
+		std::string value = argv[i + 1];
+		if (arg == "-scenes") {
+			options.scenes = splitList(value);
+		} else if (arg == "-res") {
+			options.resolutions.clear();
+			for (const std::string &res : splitList(value)) {
+				int width = 0, height = 0;
+				if (std::sscanf(res.c_str(), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+					return false;
+				}
+				options.resolutions.push_back(std::make_pair(width, height));
+			}
+		} else if (arg == "-aa" || arg == "-depth") {
+			std::vector<int> &values = arg == "-aa" ? options.antiAliasing : options.depths;
+			values.clear();
+			for (const std::string &item : splitList(value)) {
+				values.push_back(item == "adaptive" ? BenchmarkOptions::ADAPTIVE : std::atoi(item.c_str()));
+			}
+		} else if (arg == "-pipeline") {
+			options.pipelines = splitList(value);
+		} else if (arg == "-repeat") {
+			options.repeat = std::atoi(value.c_str());
+		} else if (arg == "-threads") {
+			options.numThreads = std::atoi(value.c_str());
+		} else if (arg == "-animate") {
+			options.animate = std::atoi(value.c_str());
+		} else if (arg == "-lighttree") {
+			options.lightCutoff = (float)std::atof(value.c_str());
+		} else if (arg == "-o") {
+			options.outputFile = value;
+		} else if (arg == "-images") {
+			options.imagePrefix = value;
+		} else {
+			return false;
+		}
+	}
+	if (argc % 2 == 0 || options.repeat <= 0 || options.animate < 0) {
+		return false;
+	}
+	for (int aa : options.antiAliasing) {
+		if (aa != 1 && aa != 3 && aa != BenchmarkOptions::ADAPTIVE) return false;
+	}
+	for (const std::string &pipeline : options.pipelines) {
+		if (pipeline != "ray" && pipeline != "wavefront") return false;
+	}
+	for (const std::string &name : options.scenes) {
+		if (!isSceneName(name)) {
+			std::cerr << "Unknown scene: " << name << std::endl;
+			return false;
+		}
+	}
+	return !options.scenes.empty() && !options.resolutions.empty() &&
+			!options.antiAliasing.empty() && !options.depths.empty() && !options.pipelines.empty();
+}
+
+int main(int argc, char *argv[]) {
+	BenchmarkOptions options;
+	if (!parseOptions(argc, argv, options)) {
+		std::cerr << "Usage: " << argv[0] << " [-scenes project,spheres,mesh,lights] [-res 500x250,...]"
+					<< " [-aa 1,3,adaptive] [-depth 0,2] [-repeat n] [-threads n] [-animate n]"
+					<< " [-lighttree cutoff]"
+					<< " [-pipeline ray,wavefront] [-o results.json] [-images prefix]" << std::endl;
+		return 1;
+	}
+
+	FILE *output = stdout;
+	if (!options.outputFile.empty()) {
+		output = std::fopen(options.outputFile.c_str(), "w");
+		if (output == nullptr) {
+			std::cerr << "Could not write " << options.outputFile << std::endl;
+			return 1;
+		}
+	}
+
+	RayTracer rayTrace(lightGray);
+	rayTrace.numThreads = options.numThreads;
+	rayTrace.useLightTree = options.lightCutoff >= 0.0f;
+	rayTrace.lightCutoff = options.lightCutoff;
+	const int threads = options.numThreads > 0 ? options.numThreads : TileScheduler::defaultThreadCount();
+
+	std::fprintf(output, "{\n  \"threads\": %d,\n  \"quadric_kernel_width\": %d,\n  \"packets\": %s,\n  \"light_cutoff\": %g,\n  \"runs\": [",
+				threads, quadricKernelWidth(), rayTrace.usePackets ? "true" : "false", options.lightCutoff);
+	bool firstRun = true;
+	long long sweepPeakBytes = 0;
+	for (const std::string &name : options.scenes) {
+		BenchmarkScene bench;
+		resetPeakMemory();
+		const long long memoryBefore = currentMemoryBytes();
+		auto buildStart = std::chrono::steady_clock::now();
+		if (!buildScene(name, bench)) {
+			std::cerr << "Unknown scene: " << name << std::endl;
+			return 1;
+		}
+		double buildSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
+		const long long sceneBytes = currentMemoryBytes() - memoryBefore;
+
+		for (const std::pair<int, int> &res : options.resolutions) {
+			FrameBuffer frameBuffer(res.first, res.second);
+			bench.camera->calculateViewingParameters(bench.halfWidthView ? res.first / 2 : res.first, res.second);
+			for (int aa : options.antiAliasing) {
+				for (int depth : options.depths) {
+					for (const std::string &pipeline : options.pipelines) {
+						rayTrace.adaptiveAntiAliasing = aa == BenchmarkOptions::ADAPTIVE;
+						rayTrace.antiAliasing = rayTrace.adaptiveAntiAliasing ? 1 : aa;
+						rayTrace.wavefront = pipeline == "wavefront";
+						RenderStats stats;
+						double bestSec = 0.0, totalSec = 0.0, refitSec = 0.0;
+						int rebuilds = 0;
+						for (int r = 0; r < options.repeat; r++) {
+							if (options.animate > 0) {
+								auto refitStart = std::chrono::steady_clock::now();
+								rebuilds += animateScene(*bench.scene, options.animate, r) ? 1 : 0;
+								refitSec += std::chrono::duration<double>(std::chrono::steady_clock::now() - refitStart).count();
+							}
+							auto start = std::chrono::steady_clock::now();
+							stats = rayTrace.raytraceScene(frameBuffer, depth, *bench.scene);
+							double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+							bestSec = r == 0 ? sec : std::min(bestSec, sec);
+							totalSec += sec;
+						}
+
+						std::fprintf(output, "%s\n    {\"scene\": \"%s\", \"objects\": %d, \"lights\": %d, \"build_sec\": %.6f,"
+									" \"width\": %d, \"height\": %d, \"aa\": %d, \"depth\": %d, \"pipeline\": \"%s\","
+									" \"best_sec\": %.6f, \"mean_sec\": %.6f,"
+									" \"primary_rays\": %lld, \"shadow_rays\": %lld, \"shadow_rays_avoided\": %lld, \"reflection_rays\": %lld,"
+									" \"intersection_tests\": %lld, \"occluder_cache_hit_rate\": %.4f,"
+									" \"area_light_refinements\": %lld,"
+									" \"primary_rays_per_sec\": %.1f, \"shadow_rays_per_sec\": %.1f,"
+									" \"reflection_rays_per_sec\": %.1f, \"rays_per_sec\": %.1f,"
+									" \"ns_per_intersection_test\": %.3f, \"scene_memory_bytes\": %lld, \"peak_memory_bytes\": %lld",
+									firstRun ? "" : ",", name.c_str(),
+									(int)(bench.scene->visibleObjects.size() + bench.scene->transparentObjects.size()),
+									(int)bench.scene->lights.size(), buildSec,
+									res.first, res.second, aa, depth, pipeline.c_str(), bestSec, totalSec / options.repeat,
+									stats.primaryRays, stats.shadowRays, stats.shadowRaysAvoided, stats.reflectionRays, stats.intersectionTests,
+									stats.occluderCacheHitRate(), stats.areaLightRefinements,
+									stats.primaryRays / bestSec, stats.shadowRays / bestSec,
+									stats.reflectionRays / bestSec, stats.totalRays() / bestSec,
+									stats.intersectionTests > 0 ? bestSec * 1.0e9 / stats.intersectionTests : 0.0,
+									sceneBytes, peakMemoryBytes());
+						if (options.animate > 0) {
+							std::fprintf(output, ", \"animated\": %d, \"refit_sec\": %.6f, \"rebuilds\": %d",
+										options.animate, refitSec / options.repeat, rebuilds);
+						}
+						if (rayTrace.wavefront) {
+							writeStage(output, "primary", stats.primaryStage);
+							writeStage(output, "shade", stats.shadeStage);
+							writeStage(output, "shadow", stats.shadowStage);
+							writeStage(output, "reflection", stats.reflectionStage);
+						}
+						std::fprintf(output, "}");
+						std::fflush(output);
+						if (!options.imagePrefix.empty()) {
+							std::stringstream fileName;
+							fileName << options.imagePrefix << "_" << name << "_" << res.first << "x" << res.second
+										<< "_aa" << aa << "_d" << depth << (rayTrace.wavefront ? "_wavefront" : "") << ".png";
+							frameBuffer.writePNG(fileName.str());
+						}
+						firstRun = false;
+						std::cerr << name << " " << res.first << "x" << res.second << " aa=" << aa
+									<< " depth=" << depth << " " << pipeline << ": " << bestSec << " sec" << std::endl;
+					}
+				}
+			}
+		}
+		sweepPeakBytes = std::max(sweepPeakBytes, peakMemoryBytes());
+		freeScene(bench);
+	}
+	std::fprintf(output, "\n  ],\n  \"peak_memory_bytes\": %lld\n}\n", sweepPeakBytes);
+	if (output != stdout) {
+		std::fclose(output);
+	}
+	return 0;
+}
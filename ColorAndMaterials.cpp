@@ -141,6 +141,18 @@ Material Material::operator -(const Material &mat) const {
 	return result;
 }
 
+/**
+ * @fn	bool Material::operator==(const Material &mat) const
+ * @brief	Compares two materials, property by property.
+ * @param	mat	The second Material.
+ * @return	true iff every property is the same.
+ */
+
+bool Material::operator ==(const Material &mat) const {
+	return ambient == mat.ambient && diffuse == mat.diffuse && specular == mat.specular
+		&& shininess == mat.shininess && alpha == mat.alpha;
+}
+
 /**
  * @fn	Material Material::makeTransparent(float alpha, const color &C)
  * @brief	Makes a transparent version of a given color.
@@ -44,6 +44,8 @@ struct Material {
 	Material &operator +=(const Material &mat);
 	Material operator +(const Material &mat) const;
 	Material operator -(const Material &mat) const;
+	bool operator ==(const Material &mat) const;
+	bool operator !=(const Material &mat) const { return !(*this == mat); }
 	static Material makeTransparent(float alpha, const color &C);
 };
 
@@ -35,6 +35,7 @@ void render() {
 	float N = 10.0f;
 	cameras[currCamera]->changeConfiguration(glm::vec3(0, 5, 10), glm::vec3(0, 0, 0), Y_AXIS);
 	rayTrace.raytraceScene(frameBuffer, 0, scene);
+	frameBuffer.showColorBuffer();
 
 	int frameEndTime = glutGet(GLUT_ELAPSED_TIME); // Get end time
 	float totalTimeSec = (frameEndTime - frameStartTime) / 1000.0f;
@@ -54,6 +54,7 @@ void render() {
 	cameraPos = glm::vec3(R*std::cos(-rads), R, R*std::sin(-rads));
 	camera.changeConfiguration(cameraPos, lookAt, up);
 	rayTrace.raytraceScene(frameBuffer, 0, theScene);
+	frameBuffer.showColorBuffer();
 	int frameEndTime = glutGet(GLUT_ELAPSED_TIME);
 	float totalTimeSec = (frameEndTime - frameStartTime) / 1000.0f;
 
@@ -1,3 +1,5 @@
+#include <fstream>
+#include <algorithm>
 #include "Utilities.h"
 #include "FrameBuffer.h"
 
@@ -8,10 +10,41 @@
  * @param	height	The height.
  */
 
-FrameBuffer::FrameBuffer(const int width, const int height) : window(width, height) {
+FrameBuffer::FrameBuffer(const int width, const int height)
+	: window(width, height), colorBuffer(nullptr), depthBuffer(nullptr) {
 	setFrameBufferSize(width, height);
 }
 
+/**
+ * @fn	FrameBuffer::FrameBuffer(const FrameBuffer &other)
+ * @brief	Copy constructor. Copies the colors and depths.
+ * @param	other	The framebuffer to copy.
+ */
+
+FrameBuffer::FrameBuffer(const FrameBuffer &other)
+	: window(other.window), colorBuffer(nullptr), depthBuffer(nullptr) {
+	*this = other;
+}
+
+/**
+ * @fn	FrameBuffer &FrameBuffer::operator = (const FrameBuffer &other)
+ * @brief	Assignment. Takes on the size, colors and depths of other.
+ * @param	other	The framebuffer to copy.
+ * @return	This framebuffer.
+ */
+
+FrameBuffer &FrameBuffer::operator = (const FrameBuffer &other) {
+	if (this != &other) {
+		if (colorBuffer == nullptr || window.width != other.window.width || window.height != other.window.height) {
+			setFrameBufferSize(other.window.width, other.window.height);
+		}
+		std::memcpy(clearColorUB, other.clearColorUB, BYTES_PER_PIXEL);
+		std::memcpy(colorBuffer, other.colorBuffer, window.area() * BYTES_PER_PIXEL);
+		std::memcpy(depthBuffer, other.depthBuffer, window.area() * sizeof(float));
+	}
+	return *this;
+}
+
 /**
  * @fn	FrameBuffer::~FrameBuffer()
  * @brief	Destructor
@@ -27,15 +60,11 @@ FrameBuffer::~FrameBuffer() {
  * @brief	Sets frame buffer size
  * @param	width 	The width.
  * @param	height	The height.
- * @see https://www.opengl.org/archives/resources/features/KilgardTechniques/oglpitfall/
  */
 
 void FrameBuffer::setFrameBufferSize(int width, int height) {
 	window = Window(width, height);
 
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	glPixelStorei(GL_PACK_ALIGNMENT, 1);
-
 	delete [] colorBuffer;
 	delete [] depthBuffer;
 
@@ -73,15 +102,155 @@ void FrameBuffer::clearColorAndDepthBuffers() {
 
 /**
  * @fn	void FrameBuffer::showColorBuffer() const
- * @brief	Shows the contents of the color buffer to screen.
+ * @brief	Shows the contents of the color buffer to screen. This is the only
+ * 			member that needs an OpenGL context.
+ * @see https://www.opengl.org/archives/resources/features/KilgardTechniques/oglpitfall/
  */
 
 void FrameBuffer::showColorBuffer() const {
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
 	glRasterPos2d(-1, -1);
 	glDrawPixels(window.width, window.height, GL_RGB, GL_UNSIGNED_BYTE, colorBuffer);
 	glFlush();
 }
 
+/**
+ * @fn	bool FrameBuffer::writePPM(const std::string &fileName) const
+ * @brief	Writes the color buffer to a binary (P6) PPM file. Rows are written
+ * 			top to bottom, so the file looks like the window.
+ * @param	fileName	Name of the file to write.
+ * @return	True iff the file was written.
+ */
+
+bool FrameBuffer::writePPM(const std::string &fileName) const {
+	std::ofstream output(fileName, std::ios::binary);
+	if (!output) {
+		return false;
+	}
+	output << "P6\n" << window.width << " " << window.height << "\n255\n";
+	const int rowBytes = window.width * BYTES_PER_PIXEL;
+	for (int y = window.height - 1; y >= 0; --y) {
+		output.write((const char *)(colorBuffer + y * rowBytes), rowBytes);
+	}
+	return (bool)output;
+}
+
+/**
+ * @fn	static unsigned int crc32(const unsigned char *data, size_t length, unsigned int crc)
+ * @brief	Updates a PNG chunk checksum (CRC-32, polynomial 0xEDB88320).
+ * @param	data  	The bytes to add.
+ * @param	length	Number of bytes.
+ * @param	crc   	Running checksum; start with 0.
+ * @return	The updated checksum.
+ */
+
+static unsigned int crc32(const unsigned char *data, size_t length, unsigned int crc) {
+	struct CrcTable {
+		unsigned int entries[256];
+		CrcTable() {
+			for (unsigned int n = 0; n < 256; n++) {
+				unsigned int c = n;
+				for (int k = 0; k < 8; k++) {
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				}
+				entries[n] = c;
+			}
+		}
+	};
+	static const CrcTable table;
+	crc = ~crc;
+	for (size_t i = 0; i < length; i++) {
+		crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+/**
+ * @fn	static void putBigEndian(std::vector<unsigned char> &bytes, unsigned int value)
+ * @brief	Appends a 32 bit value, most significant byte first.
+ */
+
+static void putBigEndian(std::vector<unsigned char> &bytes, unsigned int value) {
+	bytes.push_back((unsigned char)(value >> 24));
+	bytes.push_back((unsigned char)(value >> 16));
+	bytes.push_back((unsigned char)(value >> 8));
+	bytes.push_back((unsigned char)value);
+}
+
+/**
+ * @fn	static void writeChunk(std::ofstream &output, const char *type, const std::vector<unsigned char> &data)
+ * @brief	Writes one PNG chunk: length, type, data and checksum.
+ */
+
+static void writeChunk(std::ofstream &output, const char *type, const std::vector<unsigned char> &data) {
+	std::vector<unsigned char> chunk;
+	putBigEndian(chunk, (unsigned int)data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	putBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4, 0));
+	output.write((const char *)chunk.data(), chunk.size());
+}
+
+/**
+ * @fn	bool FrameBuffer::writePNG(const std::string &fileName) const
+ * @brief	Writes the color buffer to an 8 bit RGB PNG file. The pixel data is
+ * 			put in uncompressed (stored) deflate blocks, which every PNG reader
+ * 			accepts and which needs no compression library.
+ * @param	fileName	Name of the file to write.
+ * @return	True iff the file was written.
+ */
+
+bool FrameBuffer::writePNG(const std::string &fileName) const {
+	std::ofstream output(fileName, std::ios::binary);
+	if (!output) {
+		return false;
+	}
+	const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	output.write((const char *)signature, sizeof(signature));
+
+	std::vector<unsigned char> header;
+	putBigEndian(header, window.width);
+	putBigEndian(header, window.height);
+	const unsigned char format[] = { 8, 2, 0, 0, 0 };	// 8 bit RGB, no interlace
+	header.insert(header.end(), format, format + sizeof(format));
+	writeChunk(output, "IHDR", header);
+
+	// Scanlines top to bottom, each preceded by filter type 0 (none).
+	const int rowBytes = window.width * BYTES_PER_PIXEL;
+	std::vector<unsigned char> raw;
+	raw.reserve((size_t)(rowBytes + 1) * window.height);
+	for (int y = window.height - 1; y >= 0; --y) {
+		raw.push_back(0);
+		raw.insert(raw.end(), colorBuffer + y * rowBytes, colorBuffer + (y + 1) * rowBytes);
+	}
+
+	std::vector<unsigned char> zlib = { 0x78, 0x01 };
+	const size_t MAX_BLOCK = 65535;
+	size_t pos = 0;
+	do {
+		size_t length = std::min(MAX_BLOCK, raw.size() - pos);
+		bool last = pos + length == raw.size();
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back((unsigned char)(length & 0xFF));
+		zlib.push_back((unsigned char)(length >> 8));
+		zlib.push_back((unsigned char)(~length & 0xFF));
+		zlib.push_back((unsigned char)((~length >> 8) & 0xFF));
+		zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + length);
+		pos += length;
+	} while (pos < raw.size());
+
+	unsigned int a = 1, b = 0;		// Adler-32 of the uncompressed data
+	for (size_t i = 0; i < raw.size(); i++) {
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	putBigEndian(zlib, (b << 16) | a);
+	writeChunk(output, "IDAT", zlib);
+	writeChunk(output, "IEND", std::vector<unsigned char>());
+	return (bool)output;
+}
+
 /**
  * @fn	void FrameBuffer::setColor(int x, int y, const color &rgb)
  * @brief	Sets a color at (x, y)
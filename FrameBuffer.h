@@ -1,6 +1,7 @@
 #pragma once
 
-#include "defs.h"
+#include <string>
+#include "Defs.h"
 #include "ColorAndMaterials.h"
 
 const int BYTES_PER_PIXEL = 3;			//!< RGB requires 3 bytes.
@@ -14,6 +15,8 @@ const int BYTES_PER_PIXEL = 3;			//!< RGB requires 3 bytes.
 
 struct FrameBuffer {
 	FrameBuffer(const int width, const int height);
+	FrameBuffer(const FrameBuffer &other);
+	FrameBuffer &operator = (const FrameBuffer &other);
 	~FrameBuffer();
 	void setFrameBufferSize(int width, int height);
 	void setClearColor(const color &clearColor);
@@ -22,6 +25,8 @@ struct FrameBuffer {
 
 	void clearColorAndDepthBuffers();
 	void showColorBuffer() const;
+	bool writePPM(const std::string &fileName) const;
+	bool writePNG(const std::string &fileName) const;
 	int getWindowWidth() const { return window.width; }
 	int getWindowHeight() const { return window.height; }
 
@@ -1,7 +1,7 @@
 #pragma once
 
 #include <vector>
-#include "defs.h"
+#include "Defs.h"
 #include "ColorAndMaterials.h"
 #include "Image.h"
 #include "Utilities.h"
@@ -15,9 +15,10 @@ struct HitRecord {
 	float t;					//!< the t value where the intersection took place.
 	glm::vec3 interceptPoint;	//!< the (x,y,z) value where the intersection took place.
 	glm::vec3 surfaceNormal;	//!< the normal vector at the intersection point.
-	Material material;			//!< the Material value of the object.
-	Image *texture;				//!< the texture associated with this object, if any.
+	int materialId;				//!< index of the object's Material in IScene::materials.
+	int textureId;				//!< index of the object's texture in IScene::textures; -1 if none.
 	float u, v;					//!< (u,v) correpsonding to intersection point.
+	int objectId;				//!< index of the object hit, in the list that was searched; -1 if none.
 
 	/**
 	 * @fn	HitRecord()
@@ -26,7 +27,8 @@ struct HitRecord {
 
 	HitRecord() {
 		t = FLT_MAX;
-		texture = nullptr; 
+		u = v = 0.0f;
+		materialId = textureId = objectId = -1;
 	}
 
 	/**
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "IScene.h"
 
 /**
@@ -19,19 +20,27 @@ IScene::IScene(RaytracingCamera *theCamera, bool showAxis) {
 		IShapePtr yaxis = new ICylinderY(glm::vec3(0, L2, 0), R, L);
 //		IShapePtr zaxis = new ICylinderZ(glm::vec3(0, 0, L2), R, L);
 //		visibleObjects.push_back(new VisibleIShape(xaxis, red));
-		visibleObjects.push_back(new VisibleIShape(yaxis, green));
+		addObject(new VisibleIShape(yaxis, green));
 //		visibleObjects.push_back(new VisibleIShape(zaxis, blue));
 	}
 }
 
 /**
  * @fn	void IScene::addObject(const VisibleIShapePtr &obj)
- * @brief	Adds an visible object to the scene
+ * @brief	Adds an visible object to the scene. The object's material and
+ * 			texture are entered into the scene's tables. Later changes made
+ * 			with VisibleIShape::setMaterial or setTexture update the tables
+ * 			at once; other changes to the object's material are picked up by
+ * 			the next buildBVH or refitBVH.
  * @param	obj	The object to be added.
  */
 
 void IScene::addObject(const VisibleIShapePtr &obj) {
+	obj->scene = this;
+	obj->materialId = addMaterial(obj->material);
+	obj->textureId = addTexture(obj->texture);
 	visibleObjects.push_back(obj);
+	bvhIsCurrent = false;
 }
 
 /**
@@ -43,9 +52,44 @@ void IScene::addObject(const VisibleIShapePtr &obj) {
 
 void IScene::addTransparentObject(const VisibleIShapePtr &obj, float alpha) {
 	obj->material.alpha = alpha;
+	obj->scene = this;
+	obj->materialId = addMaterial(obj->material);
+	obj->textureId = addTexture(obj->texture);
 	transparentObjects.push_back(obj);
 }
 
+/**
+ * @fn	int IScene::addMaterial(const Material &mat)
+ * @brief	Adds a material to the material table, unless an equal one is
+ * 			already there.
+ * @param	mat	The material.
+ * @return	The material's id, i.e., its index in materials.
+ */
+
+int IScene::addMaterial(const Material &mat) {
+	for (unsigned int i = 0; i < materials.size(); i++) {
+		if (materials[i] == mat) return i;
+	}
+	materials.push_back(mat);
+	return (int)materials.size() - 1;
+}
+
+/**
+ * @fn	int IScene::addTexture(Image *tex)
+ * @brief	Adds a texture to the texture table, unless it is already there.
+ * @param [in,out]	tex	The texture; may be null.
+ * @return	The texture's id, i.e., its index in textures, or -1 if tex is null.
+ */
+
+int IScene::addTexture(Image *tex) {
+	if (tex == nullptr) return -1;
+	for (unsigned int i = 0; i < textures.size(); i++) {
+		if (textures[i] == tex) return i;
+	}
+	textures.push_back(tex);
+	return (int)textures.size() - 1;
+}
+
 /**
  * @fn	void IScene::addObject(const PositionalLightPtr &light)
  * @brief	Adds a positional light to the scene.
@@ -56,6 +100,26 @@ void IScene::addObject(const PositionalLightPtr &light) {
 	lights.push_back(light);
 }
 
+/**
+ * @fn	void IScene::updateObjectIds()
+ * @brief	Enters again into the tables the material and texture of every
+ * 			object whose ids no longer match them, e.g., because its material
+ * 			was assigned directly instead of through setMaterial.
+ */
+
+void IScene::updateObjectIds() {
+	for (const std::vector<VisibleIShapePtr> *objects : { &visibleObjects, &transparentObjects }) {
+		for (VisibleIShapePtr obj : *objects) {
+			if (obj->materialId < 0 || materials[obj->materialId] != obj->material) {
+				obj->materialId = addMaterial(obj->material);
+			}
+			if ((obj->textureId < 0 ? nullptr : textures[obj->textureId]) != obj->texture) {
+				obj->textureId = addTexture(obj->texture);
+			}
+		}
+	}
+}
+
 /**
  * @fn	void IScene::changeCamera(RaytracingCamera *cam)
  * @brief	Change camera
@@ -65,3 +129,344 @@ void IScene::addObject(const PositionalLightPtr &light) {
 void IScene::changeCamera(RaytracingCamera *cam) {
 	camera = cam;
 }
+
+/**
+ * @fn	void IScene::buildBVH()
+ * @brief	Builds the bounding volume hierarchy over the visible objects. Call
+ * 			once the scene is complete, and again after objects are added.
+ * 			Objects that move can be marked dirty and refit instead (see
+ * 			refitBVH). Until it is called, intersections fall back to testing
+ * 			every object. Objects with infinite bounds are kept out of the hierarchy
+ * 			and are always tested. Both sets of objects are then compiled into
+ * 			ShapeArrays, so they are tested without virtual calls. The light
+ * 			tree is built here too, so call it again after lights change if
+ * 			RayTracer::useLightTree is on. Materials assigned to objects
+ * 			directly since they were added are entered into the table.
+ */
+
+void IScene::buildBVH() {
+	updateObjectIds();
+	std::vector<AABB> bounds;
+	std::vector<int> boundedObjects;
+	unboundedObjects.clear();
+
+	for (unsigned int i = 0; i < visibleObjects.size(); i++) {
+		AABB box = objectBounds(i);
+		if (box.isInfinite()) {
+			unboundedObjects.push_back(i);
+		} else {
+			bounds.push_back(box);
+			boundedObjects.push_back(i);
+		}
+	}
+
+	bvh.build(bounds);
+	// Map the hierarchy's primitive indices straight to object indices, and
+	// sort each leaf by shape kind, so a leaf is one run per kind and its
+	// quadrics are adjacent for the SIMD kernel.
+	for (unsigned int i = 0; i < bvh.primIndices.size(); i++) {
+		bvh.primIndices[i] = boundedObjects[bvh.primIndices[i]];
+	}
+	for (const BVHNode &node : bvh.nodes) {
+		if (node.isLeaf()) {
+			std::stable_sort(bvh.primIndices.begin() + node.first, bvh.primIndices.begin() + node.first + node.count,
+				[&](int a, int b) {
+					return ShapeArrays::kindOf(visibleObjects[a]->shape) < ShapeArrays::kindOf(visibleObjects[b]->shape);
+				});
+		}
+	}
+	leafShapes.build(visibleObjects, bvh.primIndices);
+	unboundedShapes.build(visibleObjects, unboundedObjects);
+	lightTree.build(lights);
+	objectSlots.assign(visibleObjects.size(), -1);
+	for (unsigned int i = 0; i < bvh.primIndices.size(); i++) {
+		objectSlots[bvh.primIndices[i]] = i;
+	}
+	dirtyObjects.clear();
+	builtCost = bvh.sahCost();
+	bvhIsCurrent = true;
+}
+
+/**
+ * @fn	AABB IScene::objectBounds(int objectIndex) const
+ * @brief	The box a visible object is given in the hierarchy: its bounds,
+ * 			padded so that hits on a flat side are not lost to round-off.
+ * @param	objectIndex	Index of the object in visibleObjects.
+ * @return	The padded bounds; infinite if the object is unbounded.
+ */
+
+AABB IScene::objectBounds(int objectIndex) const {
+	AABB box = visibleObjects[objectIndex]->shape->bounds();
+	if (!box.isInfinite()) {
+		box.pad(EPSILON);
+	}
+	return box;
+}
+
+/**
+ * @fn	bool IScene::markDirty(int objectIndex)
+ * @brief	Records that a visible object moved or changed shape. The change is
+ * 			seen by rendering only after the next refitBVH or buildBVH: the
+ * 			hierarchy keeps each object's box and the ShapeArrays a compiled
+ * 			copy of its shape, so a shape changed without markDirty and
+ * 			refitBVH (or buildBVH) is still drawn, and still casts shadows,
+ * 			where it was. Marking an
+ * 			object twice before the refit is the same as marking it once.
+ * 			Transparent objects are not in the hierarchy and need no marking.
+ * @param	objectIndex	Index of the object in visibleObjects.
+ * @return	false, and nothing is recorded, if objectIndex is not an index
+ * 			into visibleObjects.
+ */
+
+bool IScene::markDirty(int objectIndex) {
+	if (objectIndex < 0 || objectIndex >= (int)visibleObjects.size()) {
+		return false;
+	}
+	if (std::find(dirtyObjects.begin(), dirtyObjects.end(), objectIndex) == dirtyObjects.end()) {
+		dirtyObjects.push_back(objectIndex);
+	}
+	return true;
+}
+
+/**
+ * @fn	bool IScene::refitBVH()
+ * @brief	Brings the hierarchy up to date with the objects marked dirty, for
+ * 			scenes that animate a few objects per frame. The moved objects are
+ * 			compiled again and the boxes above them refit, which costs
+ * 			O(dirty objects * depth) rather than a full build. A refit tree
+ * 			keeps its old grouping, so once its SAH cost grows past
+ * 			refitCostLimit times its cost when built, it is rebuilt instead.
+ * 			It is also rebuilt if objects were added, or if an object went
+ * 			from bounded to unbounded or back. As in buildBVH, materials
+ * 			assigned to objects directly are entered into the table.
+ * 			Rendering must not be running.
+ * @return	true if the hierarchy was rebuilt, false if it was refit.
+ */
+
+bool IScene::refitBVH() {
+	if (!bvhIsCurrent) {
+		buildBVH();
+		return true;
+	}
+	updateObjectIds();
+	std::vector<int> slots;
+	for (int index : dirtyObjects) {
+		const IShape *shape = visibleObjects[index]->shape;
+		const int slot = objectSlots[index];
+		if (objectBounds(index).isInfinite() != (slot < 0)) {
+			buildBVH();
+			return true;
+		}
+		if (slot >= 0) {
+			leafShapes.update(slot, shape);
+			slots.push_back(slot);
+		} else {
+			for (unsigned int entry = 0; entry < unboundedObjects.size(); entry++) {
+				if (unboundedObjects[entry] == index) {
+					unboundedShapes.update(entry, shape);
+				}
+			}
+		}
+	}
+	dirtyObjects.clear();
+	bvh.refit(slots, [&](int index) { return objectBounds(index); });
+	if (bvh.sahCost() > refitCostLimit * builtCost) {
+		buildBVH();
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @fn	void IScene::intersectLeaf(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const
+ * @brief	Intersects the objects in one BVH leaf. Only t is computed here; the
+ * 			winner is resolved afterwards. Ties go to the object added first,
+ * 			as in a linear scan.
+ * @param 		  	first   	First slot of the leaf in bvh.primIndices.
+ * @param 		  	count   	Number of slots in the leaf.
+ * @param 		  	ray			The ray.
+ * @param [in,out]	closestT	t of the closest hit so far.
+ * @param [in,out]	hitIndex	Index of the object that produced closestT.
+ */
+
+void IScene::intersectLeaf(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const {
+	RenderStats::local().intersectionTests += count;
+	leafShapes.intersect(first, count, ray, closestT, hitIndex);
+}
+
+/**
+ * @fn	HitRecord IScene::findClosestIntersection(const Ray &ray) const
+ * @brief	Finds the closest visible object along a ray, using the bounding
+ * 			volume hierarchy when it is current. Candidates only report t; the
+ * 			point, normal, material and texture coordinates are computed once,
+ * 			for the closest hit.
+ * @param	ray	The ray.
+ * @return	The closest intersection that is in front of the ray's origin.
+ */
+
+HitRecord IScene::findClosestIntersection(const Ray &ray) const {
+	if (!bvhIsCurrent) {
+		return VisibleIShape::findIntersection(ray, visibleObjects);
+	}
+
+	float closestT = FLT_MAX;
+	int hitIndex = -1;
+	RenderStats::local().intersectionTests += unboundedObjects.size();
+	unboundedShapes.intersect(0, unboundedShapes.size(), ray, closestT, hitIndex);
+	float tMax = closestT;
+	bvh.intersectLeaves(ray.origin, ray.direction, tMax, [&](int first, int count, float &t) {
+		intersectLeaf(first, count, ray, closestT, hitIndex);
+		t = closestT;
+	});
+
+	HitRecord theHit;
+	if (hitIndex >= 0) {
+		visibleObjects[hitIndex]->resolveHit(ray, closestT, theHit);
+		theHit.objectId = hitIndex;
+	}
+	return theHit;
+}
+
+/**
+ * @fn	void IScene::findClosestIntersections(const Ray *rays, int count, HitRecord hits[]) const
+ * @brief	Finds the closest visible object along each ray of a packet. The
+ * 			hierarchy is traversed once for the whole packet, with the box tests
+ * 			done for all rays at once. The results are exactly those of
+ * 			findClosestIntersection, ray by ray.
+ * @param 		  	rays 	The rays; coherent rays (e.g., neighboring camera
+ * 							rays) share most of the traversal.
+ * @param 		  	count	Number of rays, at most RayPacket::SIZE.
+ * @param [in,out]	hits 	The closest intersection of each ray.
+ */
+
+void IScene::findClosestIntersections(const Ray *rays, int count, HitRecord hits[]) const {
+	if (!bvhIsCurrent) {
+		for (int i = 0; i < count; i++) {
+			hits[i] = findClosestIntersection(rays[i]);
+		}
+		return;
+	}
+
+	RayPacket packet;
+	float closestT[RayPacket::SIZE];
+	int hitIndex[RayPacket::SIZE];
+	for (int i = 0; i < RayPacket::SIZE; i++) {
+		closestT[i] = FLT_MAX;
+		hitIndex[i] = -1;
+	}
+	RenderStats::local().intersectionTests += count * unboundedObjects.size();
+	for (int i = 0; i < count; i++) {
+		packet.set(i, rays[i].origin, rays[i].direction);
+		unboundedShapes.intersect(0, unboundedShapes.size(), rays[i], closestT[i], hitIndex[i]);
+	}
+	packet.pad();
+
+	bvh.intersectPacket(packet, closestT, [&](int first, int n, unsigned mask) {
+		for (int i = 0; i < count; i++) {
+			if ((mask >> i) & 1) {
+				intersectLeaf(first, n, rays[i], closestT[i], hitIndex[i]);
+			}
+		}
+	});
+
+	for (int i = 0; i < count; i++) {
+		if (hitIndex[i] >= 0) {
+			visibleObjects[hitIndex[i]]->resolveHit(rays[i], closestT[i], hits[i]);
+			hits[i].objectId = hitIndex[i];
+		}
+	}
+}
+
+/**
+ * @fn	bool IScene::isOccluded(const Ray &ray, float tMax) const
+ * @brief	Determines if any visible object blocks a ray before tMax. Used for
+ * 			shadow rays: it stops at the first blocker and computes no normals,
+ * 			materials or texture coordinates.
+ * @param	ray 	The ray.
+ * @param	tMax	Blockers at or beyond tMax (e.g., behind the light) do not count.
+ * @return	true iff something blocks the ray.
+ */
+
+bool IScene::isOccluded(const Ray &ray, float tMax) const {
+	return findOccluder(ray, tMax) >= 0;
+}
+
+/**
+ * @fn	bool IScene::isOccluded(const Ray &ray, float tMax, int &lastOccluder) const
+ * @brief	Same as isOccluded, but first tries the object that blocked the
+ * 			last ray toward the same light. Neighboring points usually share a
+ * 			blocker, so this often ends the query after one test. The answer
+ * 			is the same either way.
+ * @param 		  	ray		   	The ray.
+ * @param 		  	tMax	   	Blockers at or beyond tMax do not count.
+ * @param [in,out]	lastOccluder	Index in visibleObjects of the last blocker, or -1.
+ * 									Set to the blocker found, if any; kept otherwise.
+ * @return	true iff something blocks the ray.
+ */
+
+bool IScene::isOccluded(const Ray &ray, float tMax, int &lastOccluder) const {
+	if (lastOccluder >= 0 && lastOccluder < (int)visibleObjects.size()) {
+		RenderStats &stats = RenderStats::local();
+		stats.occluderCacheTests++;
+		stats.intersectionTests++;
+		if (objectOccludes(lastOccluder, ray, tMax)) {
+			stats.occluderCacheHits++;
+			return true;
+		}
+	}
+	const int occluder = findOccluder(ray, tMax);
+	if (occluder < 0) return false;
+	lastOccluder = occluder;
+	return true;
+}
+
+/**
+ * @fn	int IScene::findOccluder(const Ray &ray, float tMax) const
+ * @brief	Finds a visible object that blocks a ray before tMax; not
+ * 			necessarily the closest one.
+ * @param	ray 	The ray.
+ * @param	tMax	Blockers at or beyond tMax do not count.
+ * @return	Index of the blocker in visibleObjects, or -1 if there is none.
+ */
+
+int IScene::findOccluder(const Ray &ray, float tMax) const {
+	RenderStats &stats = RenderStats::local();
+	if (!bvhIsCurrent) {
+		for (unsigned int i = 0; i < visibleObjects.size(); i++) {
+			stats.intersectionTests++;
+			if (visibleObjects[i]->shape->occludes(ray, tMax)) return i;
+		}
+		return -1;
+	}
+
+	for (int i = 0; i < unboundedShapes.size(); i++) {
+		stats.intersectionTests++;
+		if (unboundedShapes.occludes(i, ray, tMax)) return unboundedObjects[i];
+	}
+	int occluder = -1;
+	bvh.occluded(ray.origin, ray.direction, tMax, [&](int index) {
+		stats.intersectionTests++;
+		if (!leafShapes.occludes(objectSlots[index], ray, tMax)) return false;
+		occluder = index;
+		return true;
+	});
+	return occluder;
+}
+
+/**
+ * @fn	bool IScene::objectOccludes(int objectIndex, const Ray &ray, float tMax) const
+ * @brief	Determines if one visible object blocks a ray before tMax. Objects
+ * 			in the hierarchy are tested in their compiled form, as findOccluder
+ * 			tests them.
+ * @param	objectIndex	Index of the object in visibleObjects.
+ * @param	ray		   	The ray.
+ * @param	tMax	   	Blockers at or beyond tMax do not count.
+ * @return	true iff the object blocks the ray.
+ */
+
+bool IScene::objectOccludes(int objectIndex, const Ray &ray, float tMax) const {
+	if (bvhIsCurrent && objectSlots[objectIndex] >= 0) {
+		return leafShapes.occludes(objectSlots[objectIndex], ray, tMax);
+	}
+	return visibleObjects[objectIndex]->shape->occludes(ray, tMax);
+}
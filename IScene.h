@@ -7,6 +7,10 @@
 #include "Light.h"
 #include "EShape.h"
 #include "IShape.h"
+#include "BVH.h"
+#include "ShapeArrays.h"
+#include "LightTree.h"
+#include "RenderStats.h"
 
 /**
  * @struct	IScene
@@ -15,12 +19,39 @@
 
 struct IScene {
 	std::vector<PositionalLightPtr> lights;				//!< All the positional lights in the scene
+	LightTree lightTree;								//!< Hierarchy over the lights that are on; made by buildBVH
 	std::vector<VisibleIShapePtr> visibleObjects;		//!< All the visible objects in the scene
 	std::vector<VisibleIShapePtr> transparentObjects;	//!< All the transparent objects in the scene
+	std::vector<Material> materials;					//!< Material table, indexed by HitRecord::materialId
+	std::vector<Image *> textures;						//!< Texture table, indexed by HitRecord::textureId
 	RaytracingCamera *camera;							//!< The one camera in the scene
+	float refitCostLimit = 1.5f;						//!< refitBVH rebuilds once the hierarchy's SAH cost grows past this many times its cost when built
 	IScene(RaytracingCamera *theCamera, bool withAxis = false);
 	void addObject(const VisibleIShapePtr &obj);
 	void addTransparentObject(const VisibleIShapePtr &obj, float alpha);
 	void addObject(const PositionalLightPtr &light);
 	void changeCamera(RaytracingCamera *cam);
+	int addMaterial(const Material &mat);
+	int addTexture(Image *tex);
+	void buildBVH();
+	bool markDirty(int objectIndex);
+	bool refitBVH();
+	HitRecord findClosestIntersection(const Ray &ray) const;
+	void findClosestIntersections(const Ray *rays, int count, HitRecord hits[]) const;
+	bool isOccluded(const Ray &ray, float tMax) const;
+	bool isOccluded(const Ray &ray, float tMax, int &lastOccluder) const;
+protected:
+	BVH bvh;							//!< Hierarchy over the bounded visible objects
+	std::vector<int> unboundedObjects;	//!< Visible objects with infinite bounds (e.g., planes)
+	bool bvhIsCurrent = false;			//!< false if objects were added since the last build
+	ShapeArrays leafShapes;				//!< The bounded objects, compiled; entry i is BVH slot i (see bvh.primIndices)
+	ShapeArrays unboundedShapes;		//!< The unbounded objects, compiled
+	std::vector<int> objectSlots;		//!< BVH slot of each visible object; -1 if unbounded
+	std::vector<int> dirtyObjects;		//!< Visible objects marked as moved since the last build or refit
+	float builtCost = 0.0f;				//!< bvh.sahCost() right after the last build
+	AABB objectBounds(int objectIndex) const;
+	void updateObjectIds();
+	void intersectLeaf(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const;
+	int findOccluder(const Ray &ray, float tMax) const;
+	bool objectOccludes(int objectIndex, const Ray &ray, float tMax) const;
 };
@@ -1,5 +1,9 @@
 #include <vector>
+#include <algorithm>
 #include "IShape.h"
+#include "QuadricForm.h"
+#include "RenderStats.h"
+#include "IScene.h"
 
 /**
  * @fn	IShape::IShape()
@@ -22,6 +26,76 @@ void IShape::getTexCoords(const glm::vec3 &pt, float &u, float &v) const {
 	u = v = 0;
 }
 
+/**
+ * @fn	float IShape::findClosestT(const Ray &ray) const
+ * @brief	First phase of an intersection: finds only the t value of the
+ * 			closest intersection, as findClosestIntersection would report it.
+ * 			Subclasses override it to skip the intercept point and normal, which
+ * 			are only needed for the hit that ends up closest (see resolveHit).
+ * 			The default uses the full intersection routine.
+ * @param	ray	The ray.
+ * @return	The t value of the closest intersection, or FLT_MAX if none.
+ */
+
+float IShape::findClosestT(const Ray &ray) const {
+	HitRecord hit;
+	findClosestIntersection(ray, hit);
+	return hit.t;
+}
+
+/**
+ * @fn	void IShape::resolveHit(const Ray &ray, float t, HitRecord &hit) const
+ * @brief	Second phase of an intersection: fills in the hit at t, which must
+ * 			be the value findClosestT returned for the same ray. The default
+ * 			recomputes the full intersection.
+ * @param 		  	ray	The ray.
+ * @param 		  	t  	The t value returned by findClosestT.
+ * @param [in,out]	hit	The hit; gets t, the intercept point and the normal.
+ */
+
+void IShape::resolveHit(const Ray &ray, float t, HitRecord &hit) const {
+	findClosestIntersection(ray, hit);
+}
+
+/**
+ * @fn	const IQuadricSurface *IShape::asQuadric() const
+ * @brief	Gives access to the quadric behind a shape, for shapes whose
+ * 			intersections are fully described by a quadric's roots.
+ * @return	The quadric, or nullptr for other shapes.
+ */
+
+const IQuadricSurface *IShape::asQuadric() const {
+	return nullptr;
+}
+
+/**
+ * @fn	AABB IShape::bounds() const
+ * @brief	Computes an axis aligned box that contains the shape. The default is
+ * 			an infinite box, which is correct for any shape.
+ * @return	The bounding box.
+ */
+
+AABB IShape::bounds() const {
+	return AABB::infinite();
+}
+
+/**
+ * @fn	bool IShape::occludes(const Ray &ray, float tMax) const
+ * @brief	Determines if the shape blocks the ray somewhere in (0, tMax). This
+ * 			is all a shadow ray needs, so subclasses override it to skip the
+ * 			normal and other hit information. The default uses the full
+ * 			intersection routine.
+ * @param	ray 	The ray.
+ * @param	tMax	Intersections at or beyond tMax do not count.
+ * @return	true iff the closest intersection lies in (0, tMax).
+ */
+
+bool IShape::occludes(const Ray &ray, float tMax) const {
+	HitRecord hit;
+	findClosestIntersection(ray, hit);
+	return hit.t > 0 && hit.t < tMax;
+}
+
 /**
  * @fn	glm::vec3 IShape::movePointOffSurface(const glm::vec3 &pt, const glm::vec3 &n)
  * @brief	Compute point that is slightly off surface.
@@ -46,6 +120,8 @@ VisibleIShape::VisibleIShape(IShapePtr shapePtr, const Material &mat)
 	texture = nullptr;
 	lu = lv = 0.0f;
 	ru = rv = 1.0f;
+	materialId = textureId = -1;
+	scene = nullptr;
 }
 
 /**
@@ -58,13 +134,35 @@ VisibleIShape::VisibleIShape(IShapePtr shapePtr, const Material &mat)
 void VisibleIShape::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	shape->findClosestIntersection(ray, hit);
 	if (hit.t < FLT_MAX) {
-		hit.material = material;
+		hit.materialId = materialId;
+	}
+}
+
+/**
+ * @fn	void VisibleIShape::resolveHit(const Ray &ray, float t, HitRecord &hit) const
+ * @brief	Fills in everything about a hit on this shape: geometry, material
+ * 			and texture ids, and texture coordinates ((0,0) if the shape has
+ * 			no texture). Called once per ray, for the closest hit only.
+ * @param 		  	ray	The ray.
+ * @param 		  	t  	The t value returned by shape->findClosestT(ray).
+ * @param [in,out]	hit	The hit.
+ */
+
+void VisibleIShape::resolveHit(const Ray &ray, float t, HitRecord &hit) const {
+	shape->resolveHit(ray, t, hit);
+	hit.materialId = materialId;
+	hit.textureId = textureId;
+	if (textureId >= 0) {
+		shape->getTexCoords(hit.interceptPoint, hit.u, hit.v);
+	} else {
+		hit.u = hit.v = 0.0f;
 	}
 }
 
 /**
  * @fn	void VisibleIShape::setTexture(Image *tex, float leftU, float rightU, float bottomV, float topV)
- * @brief	Sets the texture for this implicit shape.
+ * @brief	Sets the texture for this implicit shape. If the shape is already
+ * 			in a scene, the texture is entered into the scene's table too.
  * @param [in,out]	tex	   	The image to use as the texture.
  * @param 		  	leftU  	The left u.
  * @param 		  	rightU 	The right u.
@@ -78,6 +176,9 @@ void VisibleIShape::setTexture(Image *tex, float leftU, float rightU, float bott
 	ru = rightU;
 	lv = bottomV;
 	rv = topV;
+	if (scene != nullptr) {
+		textureId = scene->addTexture(tex);
+	}
 }
 
 /**
@@ -90,6 +191,21 @@ void VisibleIShape::setTexture(Image *tex) {
 	setTexture(tex, 0.0f, 0.0f, 1.0f, 1.0f);
 }
 
+/**
+ * @fn	void VisibleIShape::setMaterial(const Material &mat)
+ * @brief	Sets the material for this implicit shape. If the shape is already
+ * 			in a scene, the material is entered into the scene's table too, so
+ * 			the next render uses it.
+ * @param	mat	The material.
+ */
+
+void VisibleIShape::setMaterial(const Material &mat) {
+	material = mat;
+	if (scene != nullptr) {
+		materialId = scene->addMaterial(mat);
+	}
+}
+
 /**
  * @fn	HitRecord VisibleIShape::findIntersection(const Ray &ray, const std::vector<VisibleIShapePtr> &surfaces)
  * @brief	Searches for the first intersection
@@ -100,26 +216,26 @@ void VisibleIShape::setTexture(Image *tex) {
 
 HitRecord VisibleIShape::findIntersection(const Ray &ray, const std::vector<VisibleIShapePtr> &surfaces) {
 	HitRecord theHit;
-	theHit.t = FLT_MAX;
-
-	for (int i = 0; i < surfaces.size(); i++) {
-		HitRecord thisHit;
-		surfaces[i]->findClosestIntersection(ray, thisHit);
-		if (thisHit.t < theHit.t && thisHit.t > 0) {
-			theHit = thisHit;
-			theHit.material = surfaces[i]->material;
-			theHit.texture = surfaces[i]->texture;
-
-			if (theHit.texture != nullptr) {
-				surfaces[i]->shape->getTexCoords(theHit.interceptPoint, theHit.u, theHit.v);
-
-			}
+	float closestT = FLT_MAX;
+	int closest = -1;
+
+	RenderStats::local().intersectionTests += surfaces.size();
+	for (unsigned int i = 0; i < surfaces.size(); i++) {
+		float t = surfaces[i]->shape->findClosestT(ray);
+		if (t < closestT && t > 0) {
+			closestT = t;
+			closest = i;
 		}
 	}
+	if (closest >= 0) {
+		surfaces[closest]->resolveHit(ray, closestT, theHit);
+		theHit.objectId = closest;
+	}
 	return theHit;
 }
 
 
+
 /**
  * @fn	IDisk::IDisk(const glm::vec3 &pos, const glm::vec3 &normal, float rad)
  * @brief	Implicit representation of an implicit disk.
@@ -147,6 +263,66 @@ void IDisk::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	}
 }
 
+/**
+ * @fn	bool IDisk::occludes(const Ray &ray, float tMax) const
+ * @brief	Determines if the disk blocks the ray somewhere in (0, tMax).
+ * @param	ray 	The ray.
+ * @param	tMax	Intersections at or beyond tMax do not count.
+ * @return	true iff the ray hits the disk in (0, tMax).
+ */
+
+bool IDisk::occludes(const Ray &ray, float tMax) const {
+	glm::vec3 N = glm::normalize(n);
+	float denom = glm::dot(ray.direction, N);
+	if (denom == 0) return false;
+	float t = glm::dot(center - ray.origin, N) / denom;
+	if (t <= 0 || t >= tMax) return false;
+	return glm::distance(center, ray.getPoint(t)) <= radius;
+}
+
+/**
+ * @fn	AABB IDisk::bounds() const
+ * @brief	Computes an axis aligned box that contains the disk. Along each axis,
+ * 			the disk extends radius * sqrt(1 - n[axis]^2) from its center.
+ * @return	The bounding box.
+ */
+
+AABB IDisk::bounds() const {
+	glm::vec3 N = glm::normalize(n);
+	glm::vec3 e(radius * std::sqrt(std::max(0.0f, 1.0f - N.x * N.x)),
+				radius * std::sqrt(std::max(0.0f, 1.0f - N.y * N.y)),
+				radius * std::sqrt(std::max(0.0f, 1.0f - N.z * N.z)));
+	return AABB(center - e, center + e);
+}
+
+/**
+ * @fn	glm::vec3 IDisk::pointAt(float s, float t) const
+ * @brief	Maps the unit square onto the disk with the concentric mapping,
+ * 			which keeps cells of the square compact on the disk; used to
+ * 			sample the disk in strata.
+ * @param	s	First coordinate, in [0, 1].
+ * @param	t	Second coordinate, in [0, 1].
+ * @return	The point on the disk.
+ */
+
+glm::vec3 IDisk::pointAt(float s, float t) const {
+	const float a = 2 * s - 1;
+	const float b = 2 * t - 1;
+	if (a == 0 && b == 0) return center;
+	float r, phi;
+	if (std::abs(a) > std::abs(b)) {
+		r = a;
+		phi = M_PI_4 * (b / a);
+	} else {
+		r = b;
+		phi = M_PI_2 - M_PI_4 * (a / b);
+	}
+	const glm::vec3 N = glm::normalize(n);
+	const glm::vec3 u = glm::normalize(glm::cross(N, std::abs(N.x) < 0.9f ? X_AXIS : Y_AXIS));
+	const glm::vec3 v = glm::cross(N, u);
+	return center + (radius * r) * (std::cos(phi) * u + std::sin(phi) * v);
+}
+
 /**
  * @fn	ISphere::ISphere(const glm::vec3 & position, float radius)
  * @brief	Implicit representation of a 3D sphere.
@@ -171,55 +347,15 @@ void ISphere::getTexCoords(const glm::vec3 &pt, float &u, float &v) const {
 }
 
 /**
- * @fn	void ISphere::computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) const
- * @see textbook.
- * @brief	Calculates aq, bq, and cq that are used in the quadric equations. The 
- * 			values that are know to be zero are eliminated from the code.
- * @param 		  	ray	The ray.
- * @param [in,out]	Aq 	aq.
- * @param [in,out]	Bq 	bq.
- * @param [in,out]	Cq 	cq.
- */
-
-void ISphere::computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) const {
-	const float &A = qParams.A;
-	const float &B = qParams.B;
-	const float &C = qParams.C;
-	const float &D = qParams.D;
-	const float &E = qParams.E;
-	const float &F = qParams.F;
-	const float &G = qParams.G;
-	const float &H = qParams.H;
-	const float &I = qParams.I;
-	const float &J = qParams.J;
-
-	glm::vec3 Ro = ray.origin - center;
-	const glm::vec3 &Rd = ray.direction;
-
-	Aq = /*A * */ (Rd.x*Rd.x) +
-		/*B * */ (Rd.y*Rd.y) +
-		/*C * */ (Rd.z*Rd.z);
-		//D * (Rd.x * Rd.y) +
-		//E * (Rd.x * Rd.z) +
-		//F * (Rd.y * Rd.z);
-
-	Bq = 2 * /* A * */ Ro.x*Rd.x +
-		2 * /* B * */ Ro.y*Rd.y +
-		2 * /* C * */ Ro.z*Rd.z;
-		//D * (Ro.x * Rd.y + Ro.y * Rd.x) +
-		//E * (Ro.x * Rd.z + Ro.z * Rd.x) +
-		//F * (Ro.y * Rd.z + Ro.z * Rd.y) +
-		//G * Rd.x + H * Rd.y + I * Rd.z;
-
-	Cq = /* A * */ (Ro.x * Ro.x) +
-		/* B * */ (Ro.y * Ro.y) +
-		/* C * */ (Ro.z * Ro.z) +
-		//D * (Ro.x * Ro.y) +
-		//E * (Ro.x * Ro.z) +
-		//F * (Ro.y * Ro.z) +
-		//G * Ro.x +
-		//H * Ro.y +
-		I * Ro.z + J;
+ * @fn	AABB ISphere::bounds() const
+ * @brief	Computes an axis aligned box that contains the sphere.
+ * @return	The bounding box.
+ */
+
+AABB ISphere::bounds() const {
+	float R = std::sqrt(-qParams.J);
+	glm::vec3 e(R, R, R);
+	return AABB(center - e, center + e);
 }
 
 /**
@@ -230,14 +366,7 @@ void ISphere::computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) con
  */
 
 IBox::IBox(const glm::vec3 &center, const glm::vec3 &size) 
-		: IShape() {
-	glm::vec3 sizeDiv2 = 0.5f * size;
-	rects.push_back(IRect(center + glm::vec3(sizeDiv2.x, 0, 0), glm::vec3(1, 0, 0), size.y, size.z));
-	rects.push_back(IRect(center - glm::vec3(sizeDiv2.x, 0, 0), glm::vec3(-1, 0, 0), size.y, size.z));
-	rects.push_back(IRect(center + glm::vec3(0, sizeDiv2.y, 0), glm::vec3(0, 1, 0), size.x, size.z));
-	rects.push_back(IRect(center - glm::vec3(0, sizeDiv2.y, 0), glm::vec3(0, -1, 0), size.x, size.z));
-	rects.push_back(IRect(center + glm::vec3(0, 0, sizeDiv2.z), glm::vec3(0, 0, 1), size.x, size.y));
-	rects.push_back(IRect(center - glm::vec3(0, 0, sizeDiv2.z), glm::vec3(0, 0, -1), size.x, size.y));
+		: IShape(), box(center - 0.5f * size, center + 0.5f * size) {
 }
 
 /**
@@ -251,6 +380,49 @@ IBox::IBox(const glm::vec3 &center, float size)
 	: IBox(center, glm::vec3(size, size, size)) {
 }
 
+/**
+ * @fn	float IBox::slabT(const Ray &ray, int &axis, float &side) const
+ * @brief	Slab test: intersects the ray with the three pairs of parallel
+ * 			planes that bound the box and keeps the overlap of the three
+ * 			intervals. The surface is where the ray enters the box, or where it
+ * 			leaves if it starts inside.
+ * @param 		  	ray 	The ray.
+ * @param [in,out]	axis	The axis of the face hit.
+ * @param [in,out]	side	-1 if the face is on the low side of axis, 1 if high.
+ * @return	The t value, or FLT_MAX if the ray misses.
+ */
+
+float IBox::slabT(const Ray &ray, int &axis, float &side) const {
+	float tNear = -FLT_MAX, tFar = FLT_MAX;
+	int nearAxis = 0, farAxis = 0;
+	for (int a = 0; a < 3; a++) {
+		float invDir = 1.0f / ray.direction[a];
+		float t0 = (box.lo[a] - ray.origin[a]) * invDir;
+		float t1 = (box.hi[a] - ray.origin[a]) * invDir;
+		if (invDir < 0.0f) {
+			std::swap(t0, t1);
+		}
+		// A NaN (origin on a slab, ray parallel to it) leaves the interval unchanged.
+		if (t0 > tNear) {
+			tNear = t0;
+			nearAxis = a;
+		}
+		if (t1 < tFar) {
+			tFar = t1;
+			farAxis = a;
+		}
+	}
+	if (tNear > tFar || tFar <= 0) return FLT_MAX;
+	if (tNear > 0) {
+		axis = nearAxis;
+		side = ray.direction[axis] < 0 ? 1.0f : -1.0f;
+		return tNear;
+	}
+	axis = farAxis;
+	side = ray.direction[axis] < 0 ? -1.0f : 1.0f;
+	return tFar;
+}
+
 /**
  * @fn	void IBox::findClosestIntersection(const Ray &ray, HitRecord &theHit) const
  * @brief	Identifies the nearest intersection
@@ -259,13 +431,48 @@ IBox::IBox(const glm::vec3 &center, float size)
  */
 
 void IBox::findClosestIntersection(const Ray &ray, HitRecord &theHit) const {
-	for (unsigned int i = 0; i < rects.size(); i++) {
-		HitRecord thisHit;
-		rects[i].findClosestIntersection(ray, thisHit);
-		if (thisHit.t < theHit.t) {
-			theHit = thisHit;
-		}
-	}
+	int axis;
+	float side;
+	theHit.t = slabT(ray, axis, side);
+	if (theHit.t == FLT_MAX) return;
+	theHit.interceptPoint = ray.getPoint(theHit.t);
+	theHit.surfaceNormal = glm::vec3(0, 0, 0);
+	theHit.surfaceNormal[axis] = side;
+}
+
+/**
+ * @fn	float IBox::findClosestT(const Ray &ray) const
+ * @brief	Finds the t value of the closest intersection.
+ * @param	ray	The ray.
+ * @return	The t value, or FLT_MAX if the ray misses.
+ */
+
+float IBox::findClosestT(const Ray &ray) const {
+	int axis;
+	float side;
+	return slabT(ray, axis, side);
+}
+
+/**
+ * @fn	bool IBox::occludes(const Ray &ray, float tMax) const
+ * @brief	Determines if the box blocks the ray somewhere in (0, tMax).
+ * @param	ray 	The ray.
+ * @param	tMax	Intersections at or beyond tMax do not count.
+ * @return	true iff the ray meets the box's surface in (0, tMax).
+ */
+
+bool IBox::occludes(const Ray &ray, float tMax) const {
+	return findClosestT(ray) < tMax;
+}
+
+/**
+ * @fn	AABB IBox::bounds() const
+ * @brief	The box itself.
+ * @return	The bounding box.
+ */
+
+AABB IBox::bounds() const {
+	return box;
 }
 
 /**
@@ -399,6 +606,21 @@ void IPlane::findClosestIntersection(const Ray &ray, HitRecord &hit) const {	//
 	}
 }
 
+/**
+ * @fn	bool IPlane::occludes(const Ray &ray, float tMax) const
+ * @brief	Determines if the plane blocks the ray somewhere in (0, tMax).
+ * @param	ray 	The ray.
+ * @param	tMax	Intersections at or beyond tMax do not count.
+ * @return	true iff the ray crosses the plane in (0, tMax).
+ */
+
+bool IPlane::occludes(const Ray &ray, float tMax) const {
+	float denom = glm::dot(ray.direction, n);
+	if (denom == 0) return false;
+	float t = glm::dot(a - ray.origin, n) / denom;
+	return t > 0 && t < tMax;
+}
+
 
 /**
  * @fn	IPlane::IPlane(const glm::vec3 &point, const glm::vec3 &normal)
@@ -505,6 +727,59 @@ void IRect::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	}
 }
 
+/**
+ * @fn	AABB IRect::bounds() const
+ * @brief	Computes an axis aligned box that contains the rectangle. Only
+ * 			rectangles facing along an axis are clipped to their width and
+ * 			height (see findClosestIntersection); any other rectangle is hit
+ * 			like its whole plane, so its bounds are infinite.
+ * @return	The bounding box.
+ */
+
+AABB IRect::bounds() const {
+	glm::vec3 e;
+	if (std::abs(n[0]) == 1) {
+		e = glm::vec3(0, W2, H2);
+	} else if (std::abs(n[1]) == 1) {
+		e = glm::vec3(W2, 0, H2);
+	} else if (std::abs(n[2]) == 1) {
+		e = glm::vec3(W2, H2, 0);
+	} else {
+		return AABB::infinite();
+	}
+	return AABB(center - e, center + e);
+}
+
+/**
+ * @fn	glm::vec3 IRect::pointAt(float s, float t) const
+ * @brief	Maps the unit square onto the rectangle: s runs along the width and
+ * 			t along the height, with the axes findClosestIntersection uses. A
+ * 			rectangle that does not face along an axis gets any two axes
+ * 			perpendicular to its normal.
+ * @param	s	Coordinate along the width, in [0, 1].
+ * @param	t	Coordinate along the height, in [0, 1].
+ * @return	The point on the rectangle.
+ */
+
+glm::vec3 IRect::pointAt(float s, float t) const {
+	glm::vec3 u, v;
+	if (std::abs(n[0]) == 1) {
+		u = Y_AXIS;
+		v = Z_AXIS;
+	} else if (std::abs(n[1]) == 1) {
+		u = X_AXIS;
+		v = Z_AXIS;
+	} else if (std::abs(n[2]) == 1) {
+		u = X_AXIS;
+		v = Y_AXIS;
+	} else {
+		const glm::vec3 N = glm::normalize(n);
+		u = glm::normalize(glm::cross(N, std::abs(N.x) < 0.9f ? X_AXIS : Y_AXIS));
+		v = glm::cross(N, u);
+	}
+	return center + ((s - 0.5f) * width) * u + ((t - 0.5f) * height) * v;
+}
+
 /**
  * @fn	IConvexPolygon::IConvexPolygon(const std::vector<glm::vec3> &vertices)
  * @brief	Constructs a convex polygon, given the vector of vertices.
@@ -531,6 +806,36 @@ void IConvexPolygon::findClosestIntersection(const Ray &ray, HitRecord &hit) con
 	}
 }
 
+/**
+ * @fn	bool IConvexPolygon::occludes(const Ray &ray, float tMax) const
+ * @brief	Determines if the polygon blocks the ray somewhere in (0, tMax).
+ * 			IPlane's version would count the whole plane.
+ * @param	ray 	The ray.
+ * @param	tMax	Intersections at or beyond tMax do not count.
+ * @return	true iff the ray crosses the polygon in (0, tMax).
+ */
+
+bool IConvexPolygon::occludes(const Ray &ray, float tMax) const {
+	HitRecord hit;
+	findClosestIntersection(ray, hit);
+	return hit.t > 0 && hit.t < tMax;
+}
+
+/**
+ * @fn	AABB IConvexPolygon::bounds() const
+ * @brief	Computes an axis aligned box that contains the polygon: the box of
+ * 			its vertices.
+ * @return	The bounding box.
+ */
+
+AABB IConvexPolygon::bounds() const {
+	AABB box;
+	for (const glm::vec3 &vertex : v) {
+		box.extend(vertex);
+	}
+	return box;
+}
+
 /**
  * @fn	bool IConvexPolygon::isInside(const glm::vec3 &point) const
  * @brief	Query if 'point' is inside
@@ -570,6 +875,7 @@ IQuadricSurface::IQuadricSurface(const QuadricParameters &params,
 	twoA = 2.0f * qParams.A;
 	twoB = 2.0f * qParams.B;
 	twoC = 2.0f * qParams.C;
+	form = &QuadricForm::select(qParams);
 }
 
 /**
@@ -596,7 +902,8 @@ IQuadricSurface::IQuadricSurface(const glm::vec3 &position)
 
 /**
  * @fn	void IQuadricSurface::computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) const
- * @brief	Calculates the aq bq cq
+ * @brief	Calculates the aq bq cq, using the form chosen for this quadric's
+ * 			non-zero parameters.
  * @param 		  	ray	The ray.
  * @param [in,out]	Aq 	The aq.
  * @param [in,out]	Bq 	The bq.
@@ -604,42 +911,7 @@ IQuadricSurface::IQuadricSurface(const glm::vec3 &position)
  */
 
 void IQuadricSurface::computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) const {
-	glm::vec3 Ro = ray.origin - center;
-	const glm::vec3 &Rd = ray.direction;
-	const float &A = qParams.A;
-	const float &B = qParams.B;
-	const float &C = qParams.C;
-	const float &D = qParams.D;
-	const float &E = qParams.E;
-	const float &F = qParams.F;
-	const float &G = qParams.G;
-	const float &H = qParams.H;
-	const float &I = qParams.I;
-	const float &J = qParams.J;
-	Aq = A * (Rd.x*Rd.x) +
-		B * (Rd.y*Rd.y) +
-		C * (Rd.z*Rd.z) +
-		D * (Rd.x * Rd.y) +
-		E * (Rd.x * Rd.z) +
-		F * (Rd.y * Rd.z);
-
-	Bq = twoA * Ro.x*Rd.x +
-		twoB * Ro.y*Rd.y +
-		twoC * Ro.z*Rd.z +
-		D * (Ro.x * Rd.y + Ro.y * Rd.x) +
-		E * (Ro.x * Rd.z + Ro.z * Rd.x) +
-		F * (Ro.y * Rd.z + Ro.z * Rd.y) +
-		G * Rd.x + H * Rd.y + I * Rd.z;
-
-	Cq = A * (Ro.x * Ro.x) +
-		B * (Ro.y * Ro.y) +
-		C * (Ro.z * Ro.z) +
-		D * (Ro.x * Ro.y) +
-		E * (Ro.x * Ro.z) +
-		F * (Ro.y * Ro.z) +
-		G * Ro.x +
-		H * Ro.y +
-		I * Ro.z + J;
+	form->coefficients(qParams, twoA, twoB, twoC, ray.origin - center, ray.direction, Aq, Bq, Cq);
 }
 
 /**
@@ -651,25 +923,43 @@ void IQuadricSurface::computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float
  */
 
 int IQuadricSurface::findIntersections(const Ray &ray, HitRecord hits[2]) const {
+	float roots[2];
+	int numIntersections = findPositiveRoots(ray, roots);
+
+	for (int i = 0; i < numIntersections; i++) {
+		const float &t = roots[i];
+		hits[i].t = t;
+		hits[i].interceptPoint = ray.origin + t * ray.direction;
+		const glm::vec3 &intercept = hits[i].interceptPoint;
+		hits[i].surfaceNormal = normal(intercept);
+	}
+
+	return numIntersections;
+}
+
+/**
+ * @fn	int IQuadricSurface::findPositiveRoots(const Ray &ray, float roots[2]) const
+ * @brief	Finds the t values, in front of the ray's origin, where the ray
+ * 			meets the quadric.
+ * @param 		  	ray  	The ray.
+ * @param [in,out]	roots	The positive t values, in ascending order.
+ * @return	The number of positive roots.
+ */
+
+int IQuadricSurface::findPositiveRoots(const Ray &ray, float roots[2]) const {
 	float Aq, Bq, Cq;
 	computeAqBqCq(ray, Aq, Bq, Cq);
-	float roots[2];
+	float allRoots[2];
 
-	int numRoots = quadratic(Aq, Bq, Cq, roots);
-	int numIntersections = 0;
+	int numRoots = quadratic(Aq, Bq, Cq, allRoots);
+	int numPositive = 0;
 
 	for (int i = 0; i < numRoots; i++) {
-		if (roots[i] > 0) {
-			const float &t = roots[i];
-			hits[numIntersections].t = t;
-			hits[numIntersections].interceptPoint = ray.origin + t * ray.direction;
-			const glm::vec3 &intercept = hits[numIntersections].interceptPoint;
-			hits[numIntersections].surfaceNormal = normal(intercept);
-			numIntersections++;
+		if (allRoots[i] > 0) {
+			roots[numPositive++] = allRoots[i];
 		}
 	}
-
-	return numIntersections;
+	return numPositive;
 }
 
 /**
@@ -680,27 +970,86 @@ int IQuadricSurface::findIntersections(const Ray &ray, HitRecord hits[2]) const
  */
 
 void IQuadricSurface::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
-	static HitRecord hits[2];
+	float roots[2];
 	hit.t = FLT_MAX;
 
-	int numIntercepts = findIntersections(ray, hits);
-	if (numIntercepts == 1 && hits[0].t > 0) {
-		hit.t = hits[0].t;
-		hit.interceptPoint = hits[0].interceptPoint;
+	if (findPositiveRoots(ray, roots) > 0) {
+		hit.t = roots[0];
+		hit.interceptPoint = ray.origin + hit.t * ray.direction;
 		hit.surfaceNormal = normal(hit.interceptPoint);
-	} else if (numIntercepts == 2) {
-		if (hits[0].t > 0) {
-			hit.t = hits[0].t;
-			hit.interceptPoint = hits[0].interceptPoint;
-			hit.surfaceNormal = normal(hit.interceptPoint);
-		} else if (hits[1].t > 0) {
-			hit.t = hits[1].t;
-			hit.interceptPoint = hits[1].interceptPoint;
-			hit.surfaceNormal = normal(hit.interceptPoint);
-		}
 	}
 }
 
+/**
+ * @fn	float IQuadricSurface::findClosestT(const Ray &ray) const
+ * @brief	Finds the t value of the nearest intersection, without computing
+ * 			the intercept point or normal.
+ * @param	ray	The ray.
+ * @return	The t value, or FLT_MAX if the ray misses.
+ */
+
+float IQuadricSurface::findClosestT(const Ray &ray) const {
+	float roots[2];
+	int numRoots = findPositiveRoots(ray, roots);
+	return selectRoot(ray, roots, numRoots);
+}
+
+/**
+ * @fn	float IQuadricSurface::selectRoot(const Ray &ray, const float roots[2], int numRoots) const
+ * @brief	Picks the root that is the visible intersection. Subclasses that
+ * 			only use part of the quadric (e.g., finite cylinders) override this.
+ * 			Kept separate from the root finding so that roots computed for many
+ * 			quadrics at once (see QuadricKernel.h) can be finished per shape.
+ * @param	ray			The ray.
+ * @param	roots   	The positive roots, in ascending order.
+ * @param	numRoots	The number of positive roots.
+ * @return	The t value of the intersection, or FLT_MAX if none.
+ */
+
+float IQuadricSurface::selectRoot(const Ray &ray, const float roots[2], int numRoots) const {
+	return numRoots > 0 ? roots[0] : FLT_MAX;
+}
+
+/**
+ * @fn	const IQuadricSurface *IQuadricSurface::asQuadric() const
+ * @brief	Identifies the shape as a quadric whose intersections are fully
+ * 			described by its roots and selectRoot.
+ * @return	This shape.
+ */
+
+const IQuadricSurface *IQuadricSurface::asQuadric() const {
+	return this;
+}
+
+/**
+ * @fn	void IQuadricSurface::resolveHit(const Ray &ray, float t, HitRecord &hit) const
+ * @brief	Fills in the intercept point and normal of the hit at t.
+ * @param 		  	ray	The ray.
+ * @param 		  	t  	The t value returned by findClosestT.
+ * @param [in,out]	hit	The hit.
+ */
+
+void IQuadricSurface::resolveHit(const Ray &ray, float t, HitRecord &hit) const {
+	hit.t = t;
+	hit.interceptPoint = ray.origin + t * ray.direction;
+	hit.surfaceNormal = normal(hit.interceptPoint);
+}
+
+/**
+ * @fn	bool IQuadricSurface::occludes(const Ray &ray, float tMax) const
+ * @brief	Determines if the quadric blocks the ray somewhere in (0, tMax).
+ * 			Only the roots are needed; no intersection points or normals.
+ * @param	ray 	The ray.
+ * @param	tMax	Intersections at or beyond tMax do not count.
+ * @return	true iff the nearest positive root is less than tMax.
+ */
+
+bool IQuadricSurface::occludes(const Ray &ray, float tMax) const {
+	float roots[2];
+	int numRoots = findPositiveRoots(ray, roots);
+	return numRoots > 0 && roots[0] < tMax;
+}
+
 /**
  * @fn	glm::vec3 IQuadricSurface::normal(const glm::vec3 &P) const
  * @brief	Normals the given p
@@ -709,21 +1058,7 @@ void IQuadricSurface::findClosestIntersection(const Ray &ray, HitRecord &hit) co
  */
 
 glm::vec3 IQuadricSurface::normal(const glm::vec3 &P) const {
-	const float &A = qParams.A;
-	const float &B = qParams.B;
-	const float &C = qParams.C;
-	const float &D = qParams.D;
-	const float &E = qParams.E;
-	const float &F = qParams.F;
-	const float &G = qParams.G;
-	const float &H = qParams.H;
-	const float &I = qParams.I;
-	const float &J = qParams.J;
-	glm::vec3 pt = P - center;
-	glm::vec3 normal(twoA * pt.x + D * pt.y + E * pt.z + G,
-					twoB * pt.y + D * pt.x + F * pt.z + H,
-					twoC * pt.z + E * pt.x + F * pt.y + I);
-	return glm::normalize(normal);
+	return glm::normalize(form->gradient(qParams, twoA, twoB, twoC, P - center));
 }
 
 ICone::ICone(const glm::vec3 &pos, float R, float L,
@@ -738,18 +1073,52 @@ IConeY::IConeY(const glm::vec3 &pos, float rad, float len)
 
 
 void IConeY::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
-	const glm::vec3 &rayOrigin = ray.origin;
-	const glm::vec3 &rayDirection = ray.direction;
-	static HitRecord hits[2];
-	int numHits = ICone::findIntersections(ray, hits);
-	for (int i = 0; i < numHits; i++) {
-		if (hits[i].interceptPoint.y < center.y &&
-			hits[i].interceptPoint.y > center.y-length/2 ) {
-			if(hits[i].t<hit.t)hit = hits[i];
-			return;
+	float t = IQuadricSurface::findClosestT(ray);
+	if (t == FLT_MAX) {
+		hit.t = FLT_MAX;
+	} else if (t < hit.t) {
+		IQuadricSurface::resolveHit(ray, t, hit);
+	}
+}
+
+/**
+ * @fn	float IConeY::selectRoot(const Ray &ray, const float roots[2], int numRoots) const
+ * @brief	Picks the first root that lies on the finite cone.
+ * @param	ray			The ray.
+ * @param	roots   	The positive roots, in ascending order.
+ * @param	numRoots	The number of positive roots.
+ * @return	The t value, or FLT_MAX if the ray misses.
+ */
+
+float IConeY::selectRoot(const Ray &ray, const float roots[2], int numRoots) const {
+	for (int i = 0; i < numRoots; i++) {
+		glm::vec3 intercept = ray.origin + roots[i] * ray.direction;
+		if (intercept.y < center.y &&
+			intercept.y > center.y-length/2 ) {
+			return roots[i];
 		}
 	}
-	hit.t = FLT_MAX;
+	return FLT_MAX;
+}
+
+/**
+ * @fn	bool IConeY::occludes(const Ray &ray, float tMax) const
+ * @brief	Determines if the cone blocks the ray somewhere in (0, tMax).
+ * @param	ray 	The ray.
+ * @param	tMax	Intersections at or beyond tMax do not count.
+ * @return	true iff the ray hits the visible part of the cone in (0, tMax).
+ */
+
+bool IConeY::occludes(const Ray &ray, float tMax) const {
+	float roots[2];
+	int numRoots = findPositiveRoots(ray, roots);
+	for (int i = 0; i < numRoots && roots[i] < tMax; i++) {
+		float y = (ray.origin + roots[i] * ray.direction).y;
+		if (y < center.y && y > center.y - length / 2) {
+			return true;
+		}
+	}
+	return false;
 }
 
 
@@ -764,6 +1133,21 @@ void IConeY::getTexCoords(const glm::vec3 &pt, float &u, float &v) const {
 
 }
 
+/**
+ * @fn	AABB IConeY::bounds() const
+ * @brief	Computes an axis aligned box that contains the visible nappe of the
+ * 			cone, which runs from the apex down length/2, widening by radius per
+ * 			unit of height.
+ * @return	The bounding box.
+ */
+
+AABB IConeY::bounds() const {
+	float halfLength = length / 2.0f;
+	float R = radius * halfLength;
+	return AABB(glm::vec3(center.x - R, center.y - halfLength, center.z - R),
+				glm::vec3(center.x + R, center.y, center.z + R));
+}
+
 
 /**
  * @fn	ICylinder::ICylinder(const glm::vec3 &pos, float R, float L, const QuadricParameters &qParams)
@@ -779,55 +1163,6 @@ ICylinder::ICylinder(const glm::vec3 &pos, float R, float L,
 	: IQuadricSurface(qParams, pos), radius(R), length(L) {
 }
 
-/**
- * @fn	void ICylinder::computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) const
- * @brief	Calculates the aq bq cq
- * @param 		  	ray	The ray.
- * @param [in,out]	Aq 	The aq.
- * @param [in,out]	Bq 	The bq.
- * @param [in,out]	Cq 	The cq.
- */
-
-void ICylinder::computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) const {
-	const float &A = qParams.A;
-	const float &B = qParams.B;
-	const float &C = qParams.C;
-	const float &D = qParams.D;
-	const float &E = qParams.E;
-	const float &F = qParams.F;
-	const float &G = qParams.G;
-	const float &H = qParams.H;
-	const float &I = qParams.I;
-	const float &J = qParams.J;
-	glm::vec3 Ro = ray.origin - center;
-	const glm::vec3 &Rd = ray.direction;
-
-	Aq = A * (Rd.x*Rd.x) +
-		B * (Rd.y*Rd.y) +
-		C * (Rd.z*Rd.z);
-	//D * (Rd.x * Rd.y) +
-	//E * (Rd.x * Rd.z) +
-	//F * (Rd.y * Rd.z);
-
-	Bq = twoA * Ro.x*Rd.x +
-		twoB * Ro.y*Rd.y +
-		twoC * Ro.z*Rd.z;
-	//D * (Ro.x * Rd.y + Ro.y * Rd.x) +
-	//E * (Ro.x * Rd.z + Ro.z * Rd.x) +
-	//F * (Ro.y * Rd.z + Ro.z * Rd.y) +
-	//G * Rd.x + H * Rd.y + I * Rd.z;
-
-	Cq = A * (Ro.x * Ro.x) +
-		B * (Ro.y * Ro.y) +
-		C * (Ro.z * Ro.z) +
-		//D * (Ro.x * Ro.y) +
-		//E * (Ro.x * Ro.z) +
-		//F * (Ro.y * Ro.z) +
-		//G * Ro.x +
-		//H * Ro.y +
-		I * Ro.z + J;
-}
-
 /**
  * @fn	ICylinderY::ICylinderY(const glm::vec3 &pos, float rad, float len) : ICylinder(pos, rad, len, QuadricParameters::cylinderYQParams(rad))
  * @brief	Constructor
@@ -849,18 +1184,52 @@ ICylinderY::ICylinderY(const glm::vec3 &pos, float rad, float len)
  */
 
 void ICylinderY::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
-	const glm::vec3 &rayOrigin = ray.origin;
-	const glm::vec3 &rayDirection = ray.direction;
-	static HitRecord hits[2];
-	int numHits = ICylinder::findIntersections(ray, hits);
-	for (int i = 0; i < numHits; i++) {
-		if (hits[i].interceptPoint.y < center.y + length / 2 &&
-			hits[i].interceptPoint.y > center.y - length / 2) {
-				hit = hits[i];
-				return;
+	float t = IQuadricSurface::findClosestT(ray);
+	if (t == FLT_MAX) {
+		hit.t = FLT_MAX;
+	} else {
+		IQuadricSurface::resolveHit(ray, t, hit);
+	}
+}
+
+/**
+ * @fn	float ICylinderY::selectRoot(const Ray &ray, const float roots[2], int numRoots) const
+ * @brief	Picks the first root that lies on the open cylinder.
+ * @param	ray			The ray.
+ * @param	roots   	The positive roots, in ascending order.
+ * @param	numRoots	The number of positive roots.
+ * @return	The t value, or FLT_MAX if the ray misses.
+ */
+
+float ICylinderY::selectRoot(const Ray &ray, const float roots[2], int numRoots) const {
+	for (int i = 0; i < numRoots; i++) {
+		glm::vec3 intercept = ray.origin + roots[i] * ray.direction;
+		if (intercept.y < center.y + length / 2 &&
+			intercept.y > center.y - length / 2) {
+			return roots[i];
 		}
 	}
-	hit.t = FLT_MAX;
+	return FLT_MAX;
+}
+
+/**
+ * @fn	bool ICylinderY::occludes(const Ray &ray, float tMax) const
+ * @brief	Determines if the cylinder blocks the ray somewhere in (0, tMax).
+ * @param	ray 	The ray.
+ * @param	tMax	Intersections at or beyond tMax do not count.
+ * @return	true iff the ray hits the side of the cylinder in (0, tMax).
+ */
+
+bool ICylinderY::occludes(const Ray &ray, float tMax) const {
+	float roots[2];
+	int numRoots = findPositiveRoots(ray, roots);
+	for (int i = 0; i < numRoots && roots[i] < tMax; i++) {
+		float y = (ray.origin + roots[i] * ray.direction).y;
+		if (y < center.y + length / 2 && y > center.y - length / 2) {
+			return true;
+		}
+	}
+	return false;
 }
 
 /**
@@ -879,23 +1248,68 @@ void ICylinderY::getTexCoords(const glm::vec3 &pt, float &u, float &v) const {
 
 
 }
+
+/**
+ * @fn	AABB ICylinderY::bounds() const
+ * @brief	Computes an axis aligned box that contains the cylinder.
+ * @return	The bounding box.
+ */
+
+AABB ICylinderY::bounds() const {
+	glm::vec3 e(radius, length / 2.0f, radius);
+	return AABB(center - e, center + e);
+}
 ICylinderX::ICylinderX(const glm::vec3 &pos, float rad, float len)
 	: ICylinder(pos, rad, len, QuadricParameters::cylinderXQParams(rad)) {
 }
 
 void ICylinderX::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
-	const glm::vec3 &rayOrigin = ray.origin;
-	const glm::vec3 &rayDirection = ray.direction;
-	static HitRecord hits[2];
-	int numHits = ICylinder::findIntersections(ray, hits);
-	for (int i = 0; i < numHits; i++) {
-		if (hits[i].interceptPoint.x <= center.x + length / 2 &&
-			hits[i].interceptPoint.x >= center.x - length / 2) {
-			hit = hits[i];
-			return;
+	float t = IQuadricSurface::findClosestT(ray);
+	if (t == FLT_MAX) {
+		hit.t = FLT_MAX;
+	} else {
+		IQuadricSurface::resolveHit(ray, t, hit);
+	}
+}
+
+/**
+ * @fn	float ICylinderX::selectRoot(const Ray &ray, const float roots[2], int numRoots) const
+ * @brief	Picks the first root that lies on the open cylinder.
+ * @param	ray			The ray.
+ * @param	roots   	The positive roots, in ascending order.
+ * @param	numRoots	The number of positive roots.
+ * @return	The t value, or FLT_MAX if the ray misses.
+ */
+
+float ICylinderX::selectRoot(const Ray &ray, const float roots[2], int numRoots) const {
+	for (int i = 0; i < numRoots; i++) {
+		glm::vec3 intercept = ray.origin + roots[i] * ray.direction;
+		if (intercept.x <= center.x + length / 2 &&
+			intercept.x >= center.x - length / 2) {
+			return roots[i];
 		}
 	}
-	hit.t = FLT_MAX;
+	return FLT_MAX;
+}
+
+/**
+ * @fn	bool ICylinderX::occludes(const Ray &ray, float tMax) const
+ * @brief	Determines if the cylinder blocks the ray somewhere in (0, tMax).
+ * @param	ray 	The ray.
+ * @param	tMax	Intersections at or beyond tMax do not count.
+ * @return	true iff the ray hits the side of the cylinder in (0, tMax).
+ */
+
+bool ICylinderX::occludes(const Ray &ray, float tMax) const {
+	float roots[2];
+	int numRoots = findPositiveRoots(ray, roots);
+	for (int i = 0; i < numRoots && roots[i] < tMax; i++) {
+		float x = (ray.origin + roots[i] * ray.direction).x;
+		if (x <= center.x + length / 2 && x >= center.x - length / 2) {
+			return true;
+		}
+	}
+	return false;
 }
 
 void ICylinderX::getTexCoords(const glm::vec3 &pt, float &u, float &v) const {
@@ -905,6 +1319,17 @@ void ICylinderX::getTexCoords(const glm::vec3 &pt, float &u, float &v) const {
 	v = (pt.y - bottom) / length;
 }
 
+/**
+ * @fn	AABB ICylinderX::bounds() const
+ * @brief	Computes an axis aligned box that contains the cylinder.
+ * @return	The bounding box.
+ */
+
+AABB ICylinderX::bounds() const {
+	glm::vec3 e(length / 2.0f, radius, radius);
+	return AABB(center - e, center + e);
+}
+
 ICloseCylinderY::ICloseCylinderY(const glm::vec3 &pos, float rad, float len)
 	: ICylinderY(pos, rad, len),
 	topDisk(glm::vec3(center.x,center.y+len/2,center.z), glm::vec3(0, 1, 0), radius),
@@ -912,48 +1337,73 @@ ICloseCylinderY::ICloseCylinderY(const glm::vec3 &pos, float rad, float len)
 }
 
 void ICloseCylinderY::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
-	const glm::vec3 &rayOrigin = ray.origin;
-	const glm::vec3 &rayDirection = ray.direction;
-	//static HitRecord hits[2];
-	HitRecord hit1, hit2, hit3;
+	HitRecord partHit;	// each part overwrites t, so one record serves all three
 
-	topDisk.findClosestIntersection(ray, hit1);
-	bottomDisk.findClosestIntersection(ray, hit2);
+	topDisk.findClosestIntersection(ray, partHit);
+	if (partHit.t < hit.t) {
+		hit = partHit;
+	}
+	bottomDisk.findClosestIntersection(ray, partHit);
+	if (partHit.t < hit.t) {
+		hit = partHit;
+	}
+	ICylinderY::findClosestIntersection(ray, partHit);
+	if (partHit.t < hit.t) {
+		hit = partHit;
+	}
+}
+/**
+ * @fn	float ICloseCylinderY::findClosestT(const Ray &ray) const
+ * @brief	Finds the t value of the nearest intersection with the side or
+ * 			either cap.
+ * @param	ray	The ray.
+ * @return	The t value, or FLT_MAX if the ray misses.
+ */
 
-	ICylinderY::findClosestIntersection(ray, hit3);
+float ICloseCylinderY::findClosestT(const Ray &ray) const {
+	float t = topDisk.findClosestT(ray);
+	t = std::min(t, bottomDisk.findClosestT(ray));
+	return std::min(t, ICylinderY::findClosestT(ray));
+}
 
+/**
+ * @fn	const IQuadricSurface *ICloseCylinderY::asQuadric() const
+ * @brief	The caps are not part of the quadric, so the closed cylinder cannot
+ * 			be intersected from its roots alone.
+ * @return	nullptr.
+ */
 
-	//int numHits = ICylinder::findIntersections(ray, hits);
-	//for (int i = 0; i < numHits; i++) {
-	//	if (hits[i].interceptPoint.y < center.y + length / 2 &&
-	//		hits[i].interceptPoint.y > center.y - length / 2) {
-	//		hit3 = hits[i];
-	//		break;
-	//	}
-	//}
+const IQuadricSurface *ICloseCylinderY::asQuadric() const {
+	return nullptr;
+}
 
-	
-	if (hit1.t < hit.t) {
-		hit = hit1;
-	}
-	if (hit2.t < hit.t) {
-		hit = hit2;
-	}
-	if (hit3.t < hit.t) {
-		hit = hit3;
-	}
-	//HitRecord allHits[] = { hit1, hit2, hit3 };
-	//for (int i = 0; i < 3; i++)
-	//{
-	//	for (int j = 0; j < 3; j++)
-	//	{
-	//		if (allHits[i].t < allHits[j].t) {
-	//			hit = allHits[i];
-	//			return;
-	//		}
-	//	}
-	//}
-	
+/**
+ * @fn	void ICloseCylinderY::resolveHit(const Ray &ray, float t, HitRecord &hit) const
+ * @brief	Fills in the hit at t. The caps and the side have different
+ * 			normals, so this redoes the full intersection.
+ * @param 		  	ray	The ray.
+ * @param 		  	t  	The t value returned by findClosestT.
+ * @param [in,out]	hit	The hit.
+ */
+
+void ICloseCylinderY::resolveHit(const Ray &ray, float t, HitRecord &hit) const {
+	findClosestIntersection(ray, hit);
+}
+
+
+/**
+ * @fn	bool ICloseCylinderY::occludes(const Ray &ray, float tMax) const
+ * @brief	Determines if the closed cylinder blocks the ray somewhere in
+ * 			(0, tMax).
+ * @param	ray 	The ray.
+ * @param	tMax	Intersections at or beyond tMax do not count.
+ * @return	true iff the ray hits the side or either cap in (0, tMax).
+ */
+
+bool ICloseCylinderY::occludes(const Ray &ray, float tMax) const {
+	return ICylinderY::occludes(ray, tMax) ||
+			topDisk.occludes(ray, tMax) ||
+			bottomDisk.occludes(ray, tMax);
 }
 
 void ICloseCylinderY::getTexCoords(const glm::vec3 &pt, float &u, float &v) const {
@@ -1013,6 +1463,454 @@ void ITriangle::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	}
 }
 
+/**
+ * @fn	AABB ITriangle::bounds() const
+ * @brief	Computes an axis aligned box that contains the triangle.
+ * @return	The bounding box of the three vertices.
+ */
+
+AABB ITriangle::bounds() const {
+	AABB box;
+	box.extend(a);
+	box.extend(b);
+	box.extend(c);
+	return box;
+}
+
+/**
+ * @struct	WatertightRay
+ * @brief	The per-ray constants of the watertight ray/triangle test: the axis
+ * 			along which the ray runs the most becomes z, and a shear turns the
+ * 			ray into the +z axis through the origin.
+ */
+
+struct WatertightRay {
+	int kx, ky, kz;			//!< the axes that become x, y and z
+	float Sx, Sy, Sz;		//!< the shear
+	glm::vec3 origin;		//!< origin of the ray
+
+	WatertightRay(const Ray &ray) : origin(ray.origin) {
+		const glm::vec3 &d = ray.direction;
+		glm::vec3 absDir(std::abs(d.x), std::abs(d.y), std::abs(d.z));
+		kz = absDir.x > absDir.y ? (absDir.x > absDir.z ? 0 : 2) : (absDir.y > absDir.z ? 1 : 2);
+		kx = (kz + 1) % 3;
+		ky = (kx + 1) % 3;
+		if (d[kz] < 0.0f) {
+			std::swap(kx, ky);		// keeps the winding of the triangles
+		}
+		Sx = d[kx] / d[kz];
+		Sy = d[ky] / d[kz];
+		Sz = 1.0f / d[kz];
+	}
+};
+
+/**
+ * @fn	static float watertightT(const WatertightRay &ray, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c, glm::vec3 &bary)
+ * @brief	Intersects a ray with a triangle, as in Woop, Benthin and Wald,
+ * 			"Watertight Ray/Triangle Intersection" (JCGT, 2013). The vertices
+ * 			are moved into the ray's sheared space, where the ray is the z axis,
+ * 			and the 2D edge functions of the triangle are evaluated at the
+ * 			origin. Two triangles that share an edge compute the same edge
+ * 			function for it, so a ray through the edge hits one of them. Edge
+ * 			functions that come out exactly zero are recomputed in double.
+ * @param 		  	ray 	The ray's constants.
+ * @param 		  	a   	First vertex.
+ * @param 		  	b   	Second vertex.
+ * @param 		  	c   	Third vertex.
+ * @param [in,out]	bary	The barycentric coordinates of the hit (weights of a, b and c).
+ * @return	The t value of the hit, or FLT_MAX if the ray misses.
+ */
+
+static float watertightT(const WatertightRay &ray, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
+						glm::vec3 &bary) {
+	const glm::vec3 A = a - ray.origin;
+	const glm::vec3 B = b - ray.origin;
+	const glm::vec3 C = c - ray.origin;
+	const float Ax = A[ray.kx] - ray.Sx * A[ray.kz];
+	const float Ay = A[ray.ky] - ray.Sy * A[ray.kz];
+	const float Bx = B[ray.kx] - ray.Sx * B[ray.kz];
+	const float By = B[ray.ky] - ray.Sy * B[ray.kz];
+	const float Cx = C[ray.kx] - ray.Sx * C[ray.kz];
+	const float Cy = C[ray.ky] - ray.Sy * C[ray.kz];
+
+	float U = Cx * By - Cy * Bx;
+	float V = Ax * Cy - Ay * Cx;
+	float W = Bx * Ay - By * Ax;
+	if (U == 0.0f || V == 0.0f || W == 0.0f) {
+		U = (float)((double)Cx * (double)By - (double)Cy * (double)Bx);
+		V = (float)((double)Ax * (double)Cy - (double)Ay * (double)Cx);
+		W = (float)((double)Bx * (double)Ay - (double)By * (double)Ax);
+	}
+	if ((U < 0.0f || V < 0.0f || W < 0.0f) && (U > 0.0f || V > 0.0f || W > 0.0f)) {
+		return FLT_MAX;
+	}
+	const float det = U + V + W;
+	if (det == 0.0f) {
+		return FLT_MAX;
+	}
+
+	const float T = U * (ray.Sz * A[ray.kz]) + V * (ray.Sz * B[ray.kz]) + W * (ray.Sz * C[ray.kz]);
+	const float t = T / det;
+	if (!(t > 0.0f)) {
+		return FLT_MAX;
+	}
+	const float invDet = 1.0f / det;
+	bary = glm::vec3(U * invDet, V * invDet, W * invDet);
+	return t;
+}
+
+/**
+ * @fn	ITriangleMesh::ITriangleMesh(const std::vector<glm::vec3> &positions, const std::vector<int> &triangleIndices, const std::vector<glm::vec3> &vertexNormals, const std::vector<glm::vec2> &vertexTexCoords)
+ * @brief	Constructs an indexed triangle mesh and builds its BVH. The
+ * 			triangles are reordered, so indices is in BVH leaf order afterwards.
+ * @param	positions	   	The vertex positions.
+ * @param	triangleIndices	Three indices into positions per triangle, presented in
+ * 							counterclockwise order.
+ * @param	vertexNormals  	One normal per vertex, interpolated across each
+ * 							triangle; empty to use the triangles' own normals.
+ * @param	vertexTexCoords	One (u,v) per vertex, interpolated across each triangle;
+ * 							empty to use the barycentric coordinates.
+ */
+
+ITriangleMesh::ITriangleMesh(const std::vector<glm::vec3> &positions, const std::vector<int> &triangleIndices,
+							const std::vector<glm::vec3> &vertexNormals,
+							const std::vector<glm::vec2> &vertexTexCoords)
+	: IShape(), vertices(positions), normals(vertexNormals), texCoords(vertexTexCoords),
+	indices(triangleIndices) {
+	buildBVH();
+}
+
+/**
+ * @fn	void ITriangleMesh::buildBVH()
+ * @brief	Builds the mesh's BVH and puts the triangles in leaf order, so that
+ * 			each leaf is a contiguous run of indices and leaf slot i is
+ * 			triangle i. Each triangle's box is padded by a small fraction of its
+ * 			size, so that rounding in the box tests does not lose hits the
+ * 			watertight test would find.
+ */
+
+void ITriangleMesh::buildBVH() {
+	const int N = numTriangles();
+	std::vector<AABB> triangleBounds(N);
+	box = AABB();
+	for (int tri = 0; tri < N; tri++) {
+		AABB &triangleBox = triangleBounds[tri];
+		for (int k = 0; k < 3; k++) {
+			triangleBox.extend(vertices[indices[3 * tri + k]]);
+		}
+		box.extend(triangleBox);
+		triangleBox.pad(1.0E-5f * glm::length(triangleBox.hi - triangleBox.lo));
+	}
+	bvh.build(triangleBounds);
+
+	std::vector<int> leafOrder(indices.size());
+	for (int slot = 0; slot < N; slot++) {
+		int tri = bvh.primIndices[slot];
+		for (int k = 0; k < 3; k++) {
+			leafOrder[3 * slot + k] = indices[3 * tri + k];
+		}
+		bvh.primIndices[slot] = slot;
+	}
+	indices.swap(leafOrder);
+}
+
+/**
+ * @fn	int ITriangleMesh::findClosestTriangle(const Ray &ray, float &t, glm::vec3 &bary) const
+ * @brief	Finds the closest triangle along a ray. Ties go to the triangle
+ * 			tested first.
+ * @param 		  	ray 	The ray.
+ * @param [in,out]	t   	The t value of the hit, or FLT_MAX if none.
+ * @param [in,out]	bary	The barycentric coordinates of the hit.
+ * @return	The index of the triangle hit, or -1 if none.
+ */
+
+int ITriangleMesh::findClosestTriangle(const Ray &ray, float &t, glm::vec3 &bary) const {
+	const WatertightRay sheared(ray);
+	int hitTriangle = -1;
+	int tests = 0;
+	t = FLT_MAX;
+	bvh.intersectLeaves(ray.origin, ray.direction, t, [&](int first, int count, float &tMax) {
+		tests += count;
+		for (int tri = first; tri < first + count; tri++) {
+			const int *v = &indices[3 * tri];
+			glm::vec3 triangleBary;
+			float triangleT = watertightT(sheared, vertices[v[0]], vertices[v[1]], vertices[v[2]], triangleBary);
+			if (triangleT < tMax) {
+				tMax = triangleT;
+				hitTriangle = tri;
+				bary = triangleBary;
+			}
+		}
+	});
+	RenderStats::local().intersectionTests += tests;
+	return hitTriangle;
+}
+
+/**
+ * @fn	float ITriangleMesh::findClosestT(const Ray &ray) const
+ * @brief	Finds the t value of the closest intersection.
+ * @param	ray	The ray.
+ * @return	The t value, or FLT_MAX if the ray misses the mesh.
+ */
+
+float ITriangleMesh::findClosestT(const Ray &ray) const {
+	float t;
+	glm::vec3 bary;
+	findClosestTriangle(ray, t, bary);
+	return t;
+}
+
+/**
+ * @fn	void ITriangleMesh::findClosestIntersection(const Ray &ray, HitRecord &hit) const
+ * @brief	Searches for the nearest intersection. The normal and the (u,v) are
+ * 			interpolated from the vertices of the triangle hit.
+ * @param 		  	ray	The ray.
+ * @param [in,out]	hit	Hit record.
+ */
+
+void ITriangleMesh::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
+	glm::vec3 bary;
+	int tri = findClosestTriangle(ray, hit.t, bary);
+	if (tri >= 0) {
+		fillHit(ray, tri, bary, hit);
+	}
+}
+
+/**
+ * @fn	void ITriangleMesh::resolveHit(const Ray &ray, float t, HitRecord &hit) const
+ * @brief	Fills in the hit at t without tracing the ray through the mesh
+ * 			again. The triangle hit is found among the few whose boxes contain
+ * 			the hit point, as the one the ray meets at t. Should rounding put
+ * 			the point outside every box, the ray is traced again.
+ * @param 		  	ray	The ray.
+ * @param 		  	t  	The t value returned by findClosestT.
+ * @param [in,out]	hit	The hit; gets t, the intercept point, the normal and (u,v).
+ */
+
+void ITriangleMesh::resolveHit(const Ray &ray, float t, HitRecord &hit) const {
+	const WatertightRay sheared(ray);
+	const float tolerance = 1.0E-5f * t;
+	int hitTriangle = -1;
+	float closestDiff = FLT_MAX;
+	glm::vec3 bary;
+	bvh.findContaining(ray.getPoint(t), [&](int tri) {
+		const int *v = &indices[3 * tri];
+		glm::vec3 triangleBary;
+		float diff = std::abs(watertightT(sheared, vertices[v[0]], vertices[v[1]], vertices[v[2]], triangleBary) - t);
+		if (diff <= tolerance && diff < closestDiff) {
+			closestDiff = diff;
+			hitTriangle = tri;
+			bary = triangleBary;
+		}
+		return diff == 0.0f;
+	});
+	if (hitTriangle < 0) {
+		findClosestIntersection(ray, hit);
+		return;
+	}
+	hit.t = t;
+	fillHit(ray, hitTriangle, bary, hit);
+}
+
+/**
+ * @fn	void ITriangleMesh::fillHit(const Ray &ray, int tri, const glm::vec3 &bary, HitRecord &hit) const
+ * @brief	Fills in a hit on one triangle: the intercept point, and the normal
+ * 			and (u,v) interpolated from the triangle's vertices.
+ * @param 		  	ray 	The ray.
+ * @param 		  	tri 	The triangle hit.
+ * @param 		  	bary	The barycentric coordinates of the hit.
+ * @param [in,out]	hit 	The hit, with t already set.
+ */
+
+void ITriangleMesh::fillHit(const Ray &ray, int tri, const glm::vec3 &bary, HitRecord &hit) const {
+	const int *v = &indices[3 * tri];
+	hit.interceptPoint = ray.getPoint(hit.t);
+	if (normals.empty()) {
+		const glm::vec3 &a = vertices[v[0]];
+		hit.surfaceNormal = glm::normalize(glm::cross(vertices[v[1]] - a, vertices[v[2]] - a));
+	} else {
+		hit.surfaceNormal = glm::normalize(bary.x * normals[v[0]] + bary.y * normals[v[1]] + bary.z * normals[v[2]]);
+	}
+	if (texCoords.empty()) {
+		hit.u = bary.y;
+		hit.v = bary.z;
+	} else {
+		glm::vec2 uv = bary.x * texCoords[v[0]] + bary.y * texCoords[v[1]] + bary.z * texCoords[v[2]];
+		hit.u = uv.x;
+		hit.v = uv.y;
+	}
+}
+
+/**
+ * @fn	bool ITriangleMesh::occludes(const Ray &ray, float tMax) const
+ * @brief	Determines if any triangle blocks a shadow ray somewhere in (0, tMax).
+ * 			Stops at the first one found.
+ * @param	ray 	The ray.
+ * @param	tMax	Intersections at or beyond tMax do not count.
+ * @return	true iff the mesh blocks the ray.
+ */
+
+bool ITriangleMesh::occludes(const Ray &ray, float tMax) const {
+	const WatertightRay sheared(ray);
+	return bvh.occluded(ray.origin, ray.direction, tMax, [&](int tri) {
+		const int *v = &indices[3 * tri];
+		glm::vec3 bary;
+		return watertightT(sheared, vertices[v[0]], vertices[v[1]], vertices[v[2]], bary) < tMax;
+	});
+}
+
+/**
+ * @fn	void ITriangleMesh::getTexCoords(const glm::vec3 &pt, float &u, float &v) const
+ * @brief	The (u,v) of a point cannot be found from the point alone, so it is
+ * 			interpolated by resolveHit, which always comes first, and is left
+ * 			as it is here.
+ * @param 		  	pt	The point on the surface.
+ * @param [in,out]	u 	The u in the (u, v) texture coordinates.
+ * @param [in,out]	v 	The v in the (u, v) texture coordinates.
+ */
+
+void ITriangleMesh::getTexCoords(const glm::vec3 &pt, float &u, float &v) const {
+}
+
+/**
+ * @fn	AABB ITriangleMesh::bounds() const
+ * @brief	Computes an axis aligned box that contains the mesh.
+ * @return	The bounding box of the vertices.
+ */
+
+AABB ITriangleMesh::bounds() const {
+	return box;
+}
+
+/**
+ * @fn	IInstance::IInstance(const IShape *shape, const glm::mat4 &transform)
+ * @brief	Constructs an instance of a shape.
+ * @param	shape	 	The shared shape. It is not copied or owned.
+ * @param	transform	Moves the shape from its own space into the world. It
+ * 						must be invertible.
+ */
+
+IInstance::IInstance(const IShape *shape, const glm::mat4 &transform)
+	: IShape(), geometry(shape), objectToWorld(transform), worldToObject(glm::inverse(transform)),
+	normalToWorld(glm::transpose(glm::mat3(worldToObject))) {
+	AABB objectBox = geometry->bounds();
+	if (objectBox.isInfinite()) {
+		box = objectBox;
+		return;
+	}
+	for (int corner = 0; corner < 8; corner++) {
+		glm::vec3 pt((corner & 1) ? objectBox.hi.x : objectBox.lo.x,
+					(corner & 2) ? objectBox.hi.y : objectBox.lo.y,
+					(corner & 4) ? objectBox.hi.z : objectBox.lo.z);
+		box.extend(glm::vec3(objectToWorld * glm::vec4(pt, 1.0f)));
+	}
+}
+
+/**
+ * @fn	Ray IInstance::toObject(const Ray &ray, float &tScale) const
+ * @brief	Moves a ray into object space. The direction is normalized again,
+ * 			so t values along the two rays differ by a constant factor.
+ * @param 		  	ray   	The ray, in world space.
+ * @param [in,out]	tScale	An object space t times tScale is the world space t.
+ * @return	The ray, in object space.
+ */
+
+Ray IInstance::toObject(const Ray &ray, float &tScale) const {
+	glm::vec3 origin(worldToObject * glm::vec4(ray.origin, 1.0f));
+	glm::vec3 direction(worldToObject * glm::vec4(ray.direction, 0.0f));
+	tScale = 1.0f / glm::length(direction);
+	return Ray(origin, direction);
+}
+
+/**
+ * @fn	float IInstance::findClosestT(const Ray &ray) const
+ * @brief	Finds the t value of the closest intersection.
+ * @param	ray	The ray.
+ * @return	The t value, or FLT_MAX if the ray misses.
+ */
+
+float IInstance::findClosestT(const Ray &ray) const {
+	float tScale;
+	float t = geometry->findClosestT(toObject(ray, tScale));
+	return t == FLT_MAX ? FLT_MAX : t * tScale;
+}
+
+/**
+ * @fn	void IInstance::findClosestIntersection(const Ray &ray, HitRecord &hit) const
+ * @brief	Searches for the nearest intersection in object space and moves it
+ * 			into the world.
+ * @param 		  	ray	The ray.
+ * @param [in,out]	hit	Hit record.
+ */
+
+void IInstance::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
+	float tScale;
+	geometry->findClosestIntersection(toObject(ray, tScale), hit);
+	if (hit.t == FLT_MAX) {
+		return;
+	}
+	hit.t *= tScale;
+	hit.interceptPoint = ray.getPoint(hit.t);
+	hit.surfaceNormal = glm::normalize(normalToWorld * hit.surfaceNormal);
+}
+
+/**
+ * @fn	void IInstance::resolveHit(const Ray &ray, float t, HitRecord &hit) const
+ * @brief	Fills in the hit at t by letting the shape resolve it in object
+ * 			space, so a shared mesh is not traced a second time, and moves it
+ * 			into the world.
+ * @param 		  	ray	The ray.
+ * @param 		  	t  	The t value returned by findClosestT.
+ * @param [in,out]	hit	The hit.
+ */
+
+void IInstance::resolveHit(const Ray &ray, float t, HitRecord &hit) const {
+	float tScale;
+	geometry->resolveHit(toObject(ray, tScale), t / tScale, hit);
+	if (hit.t == FLT_MAX) {
+		return;
+	}
+	hit.t = t;
+	hit.interceptPoint = ray.getPoint(t);
+	hit.surfaceNormal = glm::normalize(normalToWorld * hit.surfaceNormal);
+}
+
+/**
+ * @fn	bool IInstance::occludes(const Ray &ray, float tMax) const
+ * @brief	Determines if the shape blocks a shadow ray somewhere in (0, tMax).
+ * @param	ray 	The ray.
+ * @param	tMax	Intersections at or beyond tMax do not count.
+ * @return	true iff the shape blocks the ray.
+ */
+
+bool IInstance::occludes(const Ray &ray, float tMax) const {
+	float tScale;
+	Ray objectRay = toObject(ray, tScale);
+	return geometry->occludes(objectRay, tMax / tScale);
+}
+
+/**
+ * @fn	void IInstance::getTexCoords(const glm::vec3 &pt, float &u, float &v) const
+ * @brief	Gets the shape's texture coordinates for a point on the instance.
+ * @param 		  	pt	The point on the surface, in world space.
+ * @param [in,out]	u 	The u in the (u, v) texture coordinates.
+ * @param [in,out]	v 	The v in the (u, v) texture coordinates.
+ */
+
+void IInstance::getTexCoords(const glm::vec3 &pt, float &u, float &v) const {
+	geometry->getTexCoords(glm::vec3(worldToObject * glm::vec4(pt, 1.0f)), u, v);
+}
+
+/**
+ * @fn	AABB IInstance::bounds() const
+ * @brief	Computes an axis aligned box that contains the instance.
+ * @return	The box around the shape's bounds, moved into the world.
+ */
+
+AABB IInstance::bounds() const {
+	return box;
+}
+
 /**
  * @fn	IEllipsoid::IEllipsoid(const glm::vec3 &position, const glm::vec3 &sz) : IQuadricSurface(QuadricParameters::ellipoidParameters(sz), position)
  * @brief	Constructs an implicit representation of an ellipsoid.
@@ -1025,50 +1923,13 @@ IEllipsoid::IEllipsoid(const glm::vec3 &position, const glm::vec3 &sz)
 }
 
 /**
- * @fn	void IEllipsoid::computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) const
- * @brief	Calculates the aq bq cq, given a particular ray.
- * @param 		  	ray	The ray.
- * @param [in,out]	Aq 	Aq.
- * @param [in,out]	Bq 	Bq.
- * @param [in,out]	Cq 	Cq.
- */
-
-void IEllipsoid::computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) const {
-	const float &A = qParams.A;
-	const float &B = qParams.B;
-	const float &C = qParams.C;
-	const float &D = qParams.D;
-	const float &E = qParams.E;
-	const float &F = qParams.F;
-	const float &G = qParams.G;
-	const float &H = qParams.H;
-	const float &I = qParams.I;
-	const float &J = qParams.J;
-	glm::vec3 Ro = ray.origin - center;
-	const glm::vec3 &Rd = ray.direction;
-
-	Aq = A * (Rd.x*Rd.x) +
-		B * (Rd.y*Rd.y) +
-		C * (Rd.z*Rd.z);
-	//D * (Rd.x * Rd.y) +
-	//E * (Rd.x * Rd.z) +
-	//F * (Rd.y * Rd.z);
-
-	Bq = 2 * A * Ro.x*Rd.x +
-		2 * B * Ro.y*Rd.y +
-		2 * C * Ro.z*Rd.z;
-	//D * (Ro.x * Rd.y + Ro.y * Rd.x) +
-	//E * (Ro.x * Rd.z + Ro.z * Rd.x) +
-	//F * (Ro.y * Rd.z + Ro.z * Rd.y) +
-	//G * Rd.x + H * Rd.y + I * Rd.z;
-
-	Cq = A * (Ro.x * Ro.x) +
-		B * (Ro.y * Ro.y) +
-		C * (Ro.z * Ro.z) +
-		//D * (Ro.x * Ro.y) +
-		//E * (Ro.x * Ro.z) +
-		//F * (Ro.y * Ro.z) +
-		//G * Ro.x +
-		//H * Ro.y +
-		I * Ro.z + J;
+ * @fn	AABB IEllipsoid::bounds() const
+ * @brief	Computes an axis aligned box that contains the ellipsoid. The semi
+ * 			axes are recovered from A = 1/sx^2, B = 1/sy^2, C = 1/sz^2.
+ * @return	The bounding box.
+ */
+
+AABB IEllipsoid::bounds() const {
+	glm::vec3 e(1.0f / std::sqrt(qParams.A), 1.0f / std::sqrt(qParams.B), 1.0f / std::sqrt(qParams.C));
+	return AABB(center - e, center + e);
 }
\ No newline at end of file
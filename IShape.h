@@ -1,11 +1,16 @@
 #pragma once
 #include <vector>
 #include "HitRecord.h"
+#include "AABB.h"
+#include "BVH.h"
 
 struct IShape;
 typedef IShape *IShapePtr;
 struct VisibleIShape;
 typedef VisibleIShape *VisibleIShapePtr;
+struct IQuadricSurface;
+struct IScene;
+struct QuadricForm;
 
 /**
  * @struct	Ray
@@ -30,8 +35,14 @@ struct Ray {
 
 struct IShape {
 	IShape();
+	virtual ~IShape() {}
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const = 0;
+	virtual float findClosestT(const Ray &ray) const;
+	virtual void resolveHit(const Ray &ray, float t, HitRecord &hit) const;
+	virtual const IQuadricSurface *asQuadric() const;
 	virtual void getTexCoords(const glm::vec3 &pt, float &u, float &v) const;
+	virtual AABB bounds() const;
+	virtual bool occludes(const Ray &ray, float tMax) const;
 	static glm::vec3 movePointOffSurface(const glm::vec3 &pt, const glm::vec3 &n);
 };
 
@@ -41,17 +52,22 @@ struct IShape {
  */
 
 struct VisibleIShape {
-	Material material;	//!< Material for this shape.
+	Material material;	//!< Material for this shape; change it with setMaterial once the shape is in a scene.
 	IShapePtr shape;	//!< Pointer to underlying implicit shape.
 	Image *texture;		//!< Texture associated with this shape, if any.
 	float lu;			//!< left u value
 	float ru;			//!< right u value
 	float lv;			//!< left v value
 	float rv;			//!< right v value
+	int materialId;		//!< index of material in the scene's material table
+	int textureId;		//!< index of texture in the scene's texture table; -1 if none
+	IScene *scene;		//!< scene whose tables materialId and textureId index; null until added
 	VisibleIShape(IShapePtr shapePtr, const Material &mat);
 	void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	void resolveHit(const Ray &ray, float t, HitRecord &hit) const;
 	void setTexture(Image *tex, float leftU, float rightU, float bottomV, float topV);
 	void setTexture(Image *tex);
+	void setMaterial(const Material &mat);
 	static HitRecord findIntersection(const Ray &ray, const std::vector<VisibleIShapePtr> &surfaces);
 };
 
@@ -68,6 +84,7 @@ struct IPlane : public IShape {
 	IPlane(const glm::vec3 &p1, const glm::vec3 &p2, const glm::vec3 &p3);
 
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual bool occludes(const Ray &ray, float tMax) const;
 	bool insidePlane(const glm::vec3 &point) const;
 	void findIntersection(const glm::vec3 &p1, const glm::vec3 &p2, float &t) const;
 };
@@ -81,6 +98,9 @@ struct IPlane : public IShape {
 struct IDisk : public IShape {
 	IDisk(const glm::vec3 &position, const glm::vec3 &n, float rad);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual bool occludes(const Ray &ray, float tMax) const;
+	virtual AABB bounds() const;
+	glm::vec3 pointAt(float s, float t) const;
 	glm::vec3 center;	//!< center point of disk
 	glm::vec3 n;		//!< normal vector of disk
 	float radius;
@@ -95,6 +115,8 @@ struct IDisk : public IShape {
 struct IRect : public IShape {
 	IRect(const glm::vec3 &position, const glm::vec3 &normal, float W, float H);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual AABB bounds() const;
+	glm::vec3 pointAt(float s, float t) const;
 	float width;		//!< width of rectangle
 	float height;		//!< height of rectangle
 	glm::vec3 center;	//!< center point of rectangle
@@ -107,15 +129,20 @@ protected:
 
 /**
  * @struct	IBox
- * @brief	Implicit representation of 3D box.
+ * @brief	Implicit representation of an axis aligned 3D box, intersected with
+ * 			the slab test.
  */
 
 struct IBox : public IShape {
 	IBox(const glm::vec3 &center, const glm::vec3 &size);
 	IBox(const glm::vec3 &center, float size);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual float findClosestT(const Ray &ray) const;
+	virtual bool occludes(const Ray &ray, float tMax) const;
+	virtual AABB bounds() const;
 protected:
-	std::vector<IRect> rects;	//!< 6 rectangles corresponding to sides of box.
+	AABB box;	//!< corners of the box
+	float slabT(const Ray &ray, int &axis, float &side) const;
 };
 
 /**
@@ -147,6 +174,8 @@ struct IConvexPolygon : public IPlane {
 	glm::vec3 n;
 	IConvexPolygon(const std::vector<glm::vec3> &vertices);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual bool occludes(const Ray &ray, float tMax) const;
+	virtual AABB bounds() const;
 	bool isInside(const glm::vec3 &point) const;
 };
 
@@ -162,9 +191,70 @@ struct ITriangle : public IShape {
 	IPlane plane;	//!< the plane this triangle lies on.
 	ITriangle(const glm::vec3 &A, const glm::vec3 &B, const glm::vec3 &C);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual AABB bounds() const;
 	bool inside(const glm::vec3 &pt) const;
 };
 
+/**
+ * @struct	ITriangleMesh
+ * @brief	Implicit representation of an indexed triangle mesh. The vertices
+ * 			and the indices are stored in contiguous arrays, and the mesh has a
+ * 			BVH of its own, so a scene sees the whole mesh as one object. Rays
+ * 			are tested against triangles with the watertight test of Woop,
+ * 			Benthin and Wald, so no ray slips through an edge shared by two
+ * 			triangles.
+ */
+
+struct ITriangleMesh : public IShape {
+	std::vector<glm::vec3> vertices;	//!< vertex positions
+	std::vector<glm::vec3> normals;		//!< vertex normals; empty for flat shading
+	std::vector<glm::vec2> texCoords;	//!< vertex (u,v); empty to use barycentric coordinates
+	std::vector<int> indices;			//!< three vertex indices per triangle, in BVH leaf order
+	ITriangleMesh(const std::vector<glm::vec3> &positions, const std::vector<int> &triangleIndices,
+				const std::vector<glm::vec3> &vertexNormals = std::vector<glm::vec3>(),
+				const std::vector<glm::vec2> &vertexTexCoords = std::vector<glm::vec2>());
+	int numTriangles() const { return (int)indices.size() / 3; }
+	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual float findClosestT(const Ray &ray) const;
+	virtual void resolveHit(const Ray &ray, float t, HitRecord &hit) const;
+	virtual bool occludes(const Ray &ray, float tMax) const;
+	virtual void getTexCoords(const glm::vec3 &pt, float &u, float &v) const;
+	virtual AABB bounds() const;
+protected:
+	BVH bvh;	//!< hierarchy over the triangles; leaf slot i is triangle i
+	AABB box;	//!< bounds of all the vertices
+	void buildBVH();
+	int findClosestTriangle(const Ray &ray, float &t, glm::vec3 &bary) const;
+	void fillHit(const Ray &ray, int tri, const glm::vec3 &bary, HitRecord &hit) const;
+};
+
+/**
+ * @struct	IInstance
+ * @brief	A shape placed in the world by a 4x4 transform. The shape is shared,
+ * 			not copied, so any number of instances can use one mesh. Rays are
+ * 			moved into the shape's own (object) space and tested there, and hits
+ * 			are moved back out. IScene's BVH over the instances and each mesh's
+ * 			own BVH make a two level hierarchy. The shape must outlive its
+ * 			instances.
+ */
+
+struct IInstance : public IShape {
+	const IShape *geometry;		//!< the shared shape, in object space
+	glm::mat4 objectToWorld;	//!< the instance's transform
+	glm::mat4 worldToObject;	//!< inverse of objectToWorld
+	glm::mat3 normalToWorld;	//!< inverse transpose of objectToWorld's upper 3x3, for normals
+	IInstance(const IShape *shape, const glm::mat4 &transform);
+	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual float findClosestT(const Ray &ray) const;
+	virtual void resolveHit(const Ray &ray, float t, HitRecord &hit) const;
+	virtual bool occludes(const Ray &ray, float tMax) const;
+	virtual void getTexCoords(const glm::vec3 &pt, float &u, float &v) const;
+	virtual AABB bounds() const;
+protected:
+	AABB box;	//!< the shape's bounds, moved into the world
+	Ray toObject(const Ray &ray, float &tScale) const;
+};
+
 /**
  * @struct	IQuadricSurface
  * @brief	Implicit representation of quadric surface. These shapes can be
@@ -179,11 +269,19 @@ struct IQuadricSurface : public IShape {
 					const glm::vec3 & position);
 	IQuadricSurface(const glm::vec3 & position = glm::vec3(0, 0, 0));
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual float findClosestT(const Ray &ray) const;
+	virtual void resolveHit(const Ray &ray, float t, HitRecord &hit) const;
+	virtual float selectRoot(const Ray &ray, const float roots[2], int numRoots) const;
+	virtual const IQuadricSurface *asQuadric() const;
+	virtual bool occludes(const Ray &ray, float tMax) const;
 	int findIntersections(const Ray &ray, HitRecord hits[2]) const;
+	int findPositiveRoots(const Ray &ray, float roots[2]) const;
 	glm::vec3 normal(const glm::vec3 &pt) const;
-	virtual void computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) const;
+	void computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) const;
+	const QuadricParameters &getParameters() const { return qParams; }
 protected:
 	QuadricParameters qParams;		//!< The parameters that make up the quadric
+	const QuadricForm *form;		//!< Specialized for the non-zero parameters
 	float twoA;						//!< 2*A
 	float twoB;						//!< 2*B
 	float twoC;						//!< 2*C
@@ -197,7 +295,7 @@ protected:
 struct ISphere : IQuadricSurface {
 	ISphere(const glm::vec3 &position, float radius);
 	virtual void getTexCoords(const glm::vec3 &pt, float &u, float &v) const;
-	virtual void computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) const;
+	virtual AABB bounds() const;
 };
 
 //struct ICone
@@ -210,7 +308,10 @@ struct ICone : public IQuadricSurface {
 struct IConeY : public ICone {
 	IConeY(const glm::vec3 &position, float R, float len);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual float selectRoot(const Ray &ray, const float roots[2], int numRoots) const;
+	virtual bool occludes(const Ray &ray, float tMax) const;
 	void getTexCoords(const glm::vec3 &pt, float &u, float &v) const;
+	virtual AABB bounds() const;
 };
 
 
@@ -223,7 +324,6 @@ struct ICylinder : public IQuadricSurface {
 	float radius, length;
 	ICylinder(const glm::vec3 &position, float R, float len, const QuadricParameters &qParams);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const = 0;
-	virtual void computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) const;
 };
 
 
@@ -236,12 +336,18 @@ struct ICylinder : public IQuadricSurface {
 struct ICylinderY : public ICylinder {
 	ICylinderY(const glm::vec3 &position, float R, float len);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual float selectRoot(const Ray &ray, const float roots[2], int numRoots) const;
+	virtual bool occludes(const Ray &ray, float tMax) const;
 	void getTexCoords(const glm::vec3 &pt, float &u, float &v) const;
+	virtual AABB bounds() const;
 };
 struct ICylinderX : public ICylinder {
 	ICylinderX(const glm::vec3 &position, float R, float len);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual float selectRoot(const Ray &ray, const float roots[2], int numRoots) const;
+	virtual bool occludes(const Ray &ray, float tMax) const;
 	void getTexCoords(const glm::vec3 &pt, float &u, float &v) const;
+	virtual AABB bounds() const;
 };
 
 struct ICloseCylinderY : public ICylinderY {
@@ -249,6 +355,10 @@ struct ICloseCylinderY : public ICylinderY {
 	IDisk topDisk;
 	IDisk bottomDisk;
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual float findClosestT(const Ray &ray) const;
+	virtual void resolveHit(const Ray &ray, float t, HitRecord &hit) const;
+	virtual const IQuadricSurface *asQuadric() const;
+	virtual bool occludes(const Ray &ray, float tMax) const;
 	void getTexCoords(const glm::vec3 &pt, float &u, float &v) const;
 };
 
@@ -259,5 +369,5 @@ struct ICloseCylinderY : public ICylinderY {
 
 struct IEllipsoid : public IQuadricSurface {
 	IEllipsoid(const glm::vec3 &position, const glm::vec3 &sz);
-	virtual void computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) const;
+	virtual AABB bounds() const;
 };
\ No newline at end of file
@@ -110,6 +110,42 @@ color PositionalLight::illuminate(const glm::vec3 &interceptWorldCoords,
 
 }
 
+/**
+ * @fn	void SpotLight::cacheCone()
+ * @brief	Recomputes the normalized direction and the cosines of the cone
+ * 			angles, after fov, spotDirection or falloff changed.
+ */
+
+void SpotLight::cacheCone() {
+	unitSpotDirection = glm::normalize(spotDirection);
+	cosHalfFov = std::cos(fov / 2);
+	cosInner = std::cos(std::max(0.0f, fov / 2 - falloff));
+}
+
+/**
+ * @fn	float SpotLight::coneFactor(const glm::vec3 &point) const
+ * @brief	How much of the light reaches a point: 0 outside the cone, 1 inside
+ * 			it, and in between in the falloff band. Points are rejected with a
+ * 			dot product against the cached cosine; no acos is taken.
+ * @param	point	The point lit.
+ * @return	The fraction of the light that reaches the point.
+ */
+
+float SpotLight::coneFactor(const glm::vec3 &point) const {
+	glm::vec3 a = point - lightPosition;
+	float d = glm::dot(a, unitSpotDirection);
+	float limit = cosHalfFov * cosHalfFov * glm::dot(a, a);
+	// The angle is at most fov / 2 iff d >= cosHalfFov * |a|; compared squared,
+	// so no square root is needed either.
+	bool outside = cosHalfFov >= 0 ? (d < 0 || d * d < limit) : (d < 0 && d * d > limit);
+	if (outside) return 0.0f;
+	if (cosInner <= cosHalfFov) return 1.0f;
+	float cosAngle = d / glm::length(a);
+	if (cosAngle >= cosInner) return 1.0f;
+	float t = (cosAngle - cosHalfFov) / (cosInner - cosHalfFov);
+	return t * t * (3 - 2 * t);
+}
+
 /**
  * @fn	color SpotLight::illuminate(const HitRecord &hit, const glm::vec3 &viewingDir, const Frame &eyeFrame, bool inShadow) const
  * @brief	Computes the color this light produces in raytracing applications.
@@ -126,23 +162,45 @@ color SpotLight::illuminate(const glm::vec3 &interceptWorldCoords,
 							const Frame &eyeFrame, bool inShadow) const {
 	if (!isOn) return black;
 
-
-
-	glm::vec3 a = interceptWorldCoords - lightPosition;
-	float angleBetween = glm::acos(cosBetween(a, spotDirection));
-	if (angleBetween <= fov / 2) {
-		if (inShadow) {
-			return ambientColor(material.ambient, lightColorComponents.ambient);
-		}
-		glm::vec3 v = glm::normalize(eyeFrame.origin - interceptWorldCoords);
-		return totalColor(material, lightColorComponents, v, normal, lightPosition, interceptWorldCoords, attenuationIsTurnedOn, attenuationParams);
-	
-	}
-	else {
+	float factor = coneFactor(interceptWorldCoords);
+	if (factor <= 0.0f) {
 		return black;
 	}
+	color result;
+	if (inShadow) {
+		result = ambientColor(material.ambient, lightColorComponents.ambient);
+	} else {
+		glm::vec3 v = glm::normalize(eyeFrame.origin - interceptWorldCoords);
+		result = totalColor(material, lightColorComponents, v, normal, lightPosition, interceptWorldCoords, attenuationIsTurnedOn, attenuationParams);
+	}
+	return factor < 1.0f ? result * factor : result;
+}
 
-	
+/**
+ * @fn	color AreaLight::illuminateFrom(const glm::vec3 &samplePosition, const glm::vec3 &interceptWorldCoords, const glm::vec3 &normal, const Material &material, const Frame &eyeFrame, bool inShadow) const
+ * @brief	Computes the color one sample of the light produces, as if the whole
+ * 			light were a point light at the sample.
+ * @param	samplePosition			The sample's position on the light.
+ * @param	interceptWorldCoords	The point lit.
+ * @param	normal					The surface normal at the point.
+ * @param	material				The material at the point.
+ * @param	eyeFrame				The coordinate frame of the camera.
+ * @param	inShadow				true if the sample is blocked from the point.
+ * @return	The color produced at the point by the sample.
+ */
+
+color AreaLight::illuminateFrom(const glm::vec3 &samplePosition,
+								const glm::vec3 &interceptWorldCoords,
+								const glm::vec3 &normal,
+								const Material &material,
+								const Frame &eyeFrame, bool inShadow) const {
+	if (!isOn) return black;
+
+	if (inShadow) {
+		return ambientColor(material.ambient, lightColorComponents.ambient);
+	}
+	glm::vec3 v = glm::normalize(eyeFrame.origin - interceptWorldCoords);
+	return totalColor(material, lightColorComponents, v, normal, samplePosition, interceptWorldCoords, attenuationIsTurnedOn, attenuationParams);
 }
 
 /**
@@ -190,5 +248,6 @@ std::ostream &operator << (std::ostream &os, const SpotLight &sl) {
 	PositionalLight pl = (sl);
 	os << pl;
 	os << " FOV " << sl.fov << std::endl;
+	os << " falloff " << sl.falloff << std::endl;
 	return os;
 }
\ No newline at end of file
@@ -1,7 +1,8 @@
 #pragma once
 #include <vector>
-#include "defs.h"
+#include "Defs.h"
 #include "HitRecord.h"
+#include "IShape.h"
 
 /**
  * @struct	LightAttenuationParameters
@@ -53,12 +54,15 @@ struct LightSource {
 	LightSource() {
 		isOn = true;
 	}
+	virtual ~LightSource() {}
 	virtual color illuminate(const glm::vec3 &interceptWorldCoords,
 								const glm::vec3 &normal, 
 								const Material &material,
 								const Frame &eyeFrame, bool inShadow) const = 0;
 	};
 
+struct AreaLight;
+
 /**
  * @struct	PositionalLight
  * @brief	Represents a simple positional light source.
@@ -83,6 +87,12 @@ struct PositionalLight : public LightSource {
 	void setAttenuationParams(const LightAttenuationParameters &params) {
 		attenuationParams = params;
 	}
+	virtual float coneFactor(const glm::vec3 &point) const {
+		return 1.0f;
+	}
+	virtual const AreaLight *asAreaLight() const {
+		return nullptr;
+	}
 	virtual color illuminate(const glm::vec3 &interceptWorldCoords,
 							const glm::vec3 &normal,
 							const Material &material,
@@ -92,22 +102,108 @@ struct PositionalLight : public LightSource {
 
 /**
  * @struct	SpotLight
- * @brief	A spot light.
+ * @brief	A spot light. The cone is tested against cached cosines, so fov,
+ * 			spotDirection and falloff should be changed through the setters.
  */
 
 struct SpotLight : public PositionalLight {
 	float fov;					//!< Field of view of the light.
 	glm::vec3 spotDirection;	//!< Direction of spotlight.
+	float falloff = 0.0f;		//!< Angle inside the cone's edge over which the light fades out; 0 for a hard edge.
 	SpotLight(const glm::vec3 &position, const glm::vec3 &dir,
 		float angleInRadians, const LightColor &lightColor)
 		: PositionalLight(position, lightColor), spotDirection(dir),
 		fov(angleInRadians) {
+		cacheCone();
+	}
+	void setDirection(const glm::vec3 &dir) {
+		spotDirection = dir;
+		cacheCone();
 	}
+	void setFOV(float angleInRadians) {
+		fov = angleInRadians;
+		cacheCone();
+	}
+	void setFalloff(float angleInRadians) {
+		falloff = angleInRadians;
+		cacheCone();
+	}
+	const glm::vec3 &unitDirection() const { return unitSpotDirection; }
+	virtual float coneFactor(const glm::vec3 &point) const;
 	virtual color illuminate(const glm::vec3 &interceptWorldCoords,
 							const glm::vec3 &normal,
 							const Material &material,
 							const Frame &eyeFrame, bool inShadow) const;
 	friend std::ostream &operator << (std::ostream &os, const SpotLight &pl);
+protected:
+	glm::vec3 unitSpotDirection;	//!< spotDirection, normalized
+	float cosHalfFov;				//!< cosine of fov / 2
+	float cosInner;					//!< cosine of fov / 2 - falloff, where the fade starts
+	void cacheCone();
+};
+
+/**
+ * @struct	AreaLight
+ * @brief	A light spread over a surface, which casts soft shadows. It is
+ * 			sampled as samplesPerAxis x samplesPerAxis point lights, one
+ * 			jittered in each cell (stratum) of the surface's parameter square;
+ * 			its color at a point is the mean of theirs. lightPosition is the
+ * 			center of the surface; moving it moves the whole light.
+ */
+
+struct AreaLight : public PositionalLight {
+	int samplesPerAxis = 4;		//!< Strata along each side of the parameter square.
+	AreaLight(const glm::vec3 &center, const LightColor &lightColor)
+		: PositionalLight(center, lightColor) {
+	}
+	virtual glm::vec3 pointAt(float s, float t) const = 0;
+	virtual float extent() const = 0;
+	virtual const AreaLight *asAreaLight() const {
+		return this;
+	}
+	color illuminateFrom(const glm::vec3 &samplePosition,
+						const glm::vec3 &interceptWorldCoords,
+						const glm::vec3 &normal,
+						const Material &material,
+						const Frame &eyeFrame, bool inShadow) const;
+};
+
+/**
+ * @struct	RectAreaLight
+ * @brief	An area light shaped like an IRect.
+ */
+
+struct RectAreaLight : public AreaLight {
+	IRect rect;		//!< The light's surface, centered where the light was made.
+	RectAreaLight(const glm::vec3 &center, const glm::vec3 &normal, float W, float H,
+		const LightColor &lightColor)
+		: AreaLight(center, lightColor), rect(center, normal, W, H) {
+	}
+	virtual glm::vec3 pointAt(float s, float t) const {
+		return rect.pointAt(s, t) - rect.center + lightPosition;
+	}
+	virtual float extent() const {
+		return glm::length(glm::vec2(rect.width, rect.height)) / 2;
+	}
+};
+
+/**
+ * @struct	DiskAreaLight
+ * @brief	An area light shaped like an IDisk.
+ */
+
+struct DiskAreaLight : public AreaLight {
+	IDisk disk;		//!< The light's surface, centered where the light was made.
+	DiskAreaLight(const glm::vec3 &center, const glm::vec3 &normal, float radius,
+		const LightColor &lightColor)
+		: AreaLight(center, lightColor), disk(center, normal, radius) {
+	}
+	virtual glm::vec3 pointAt(float s, float t) const {
+		return disk.pointAt(s, t) - disk.center + lightPosition;
+	}
+	virtual float extent() const {
+		return disk.radius;
+	}
 };
 
 const LightColor pureWhiteLight(std::vector<float>{1, 1, 1, 1, 1, 1, 1, 1, 1});
@@ -129,3 +225,4 @@ color totalColor(const Material &mat, const LightColor &lightColor,
 typedef LightSource *LightSourcePtr;
 typedef PositionalLight *PositionalLightPtr;
 typedef SpotLight *SpotLightPtr;
+typedef AreaLight *AreaLightPtr;
@@ -0,0 +1,247 @@
+#include <algorithm>
+#include "LightTree.h"
+
+/**
+ * @fn	static float maxComponent(const color &c)
+ * @brief	The largest of the three channels.
+ */
+
+static float maxComponent(const color &c) {
+	return std::max(c.r, std::max(c.g, c.b));
+}
+
+/**
+ * @fn	LightCluster LightCluster::of(const PositionalLight &light)
+ * @brief	The cluster of a single light. An area light's sphere holds its
+ * 			whole surface.
+ * @param	light	The light.
+ * @return	The cluster.
+ */
+
+LightCluster LightCluster::of(const PositionalLight &light) {
+	LightCluster cluster;
+	cluster.ambient = light.lightColorComponents.ambient;
+	cluster.diffuse = light.lightColorComponents.diffuse;
+	cluster.specular = light.lightColorComponents.specular;
+	cluster.attenuation = light.attenuationIsTurnedOn ? light.attenuationParams : noEffectAttenuationParams;
+	cluster.center = light.lightPosition;
+	cluster.spotAxis = Z_AXIS;
+	if (const SpotLight *spot = dynamic_cast<const SpotLight *>(&light)) {
+		cluster.spotAxis = spot->unitDirection();
+		cluster.spotAngle = spot->fov / 2;
+	}
+	if (const AreaLight *area = light.asAreaLight()) {
+		cluster.radius = area->extent();
+	}
+	return cluster;
+}
+
+/**
+ * @fn	void LightCluster::add(const LightCluster &other)
+ * @brief	Grows the cluster to hold another one's lights as well.
+ * @param	other	The other cluster.
+ */
+
+void LightCluster::add(const LightCluster &other) {
+	ambient += other.ambient;
+	diffuse += other.diffuse;
+	specular += other.specular;
+	attenuation.constant = std::min(attenuation.constant, other.attenuation.constant);
+	attenuation.linear = std::min(attenuation.linear, other.attenuation.linear);
+	attenuation.quadratic = std::min(attenuation.quadratic, other.attenuation.quadratic);
+
+	// Smallest sphere around both spheres.
+	float d = glm::distance(center, other.center);
+	if (d + other.radius <= radius) {
+		// other is inside this sphere
+	} else if (d + radius <= other.radius) {
+		center = other.center;
+		radius = other.radius;
+	} else {
+		float newRadius = (d + radius + other.radius) / 2;
+		center += (other.center - center) * ((newRadius - radius) / d);
+		radius = newRadius;
+	}
+
+	// Cone around both cones, about the mean of the two axes.
+	if (spotAngle >= M_PI || other.spotAngle >= M_PI) {
+		spotAngle = M_2PI;
+		return;
+	}
+	glm::vec3 axis = spotAxis + other.spotAxis;
+	if (glm::length(axis) < 1.0e-6f) {
+		spotAngle = M_2PI;
+		return;
+	}
+	axis = glm::normalize(axis);
+	float angle = std::acos(glm::clamp(glm::dot(axis, spotAxis), -1.0f, 1.0f)) + spotAngle;
+	float otherAngle = std::acos(glm::clamp(glm::dot(axis, other.spotAxis), -1.0f, 1.0f)) + other.spotAngle;
+	spotAxis = axis;
+	spotAngle = std::max(angle, otherAngle);
+	if (spotAngle >= M_PI) {
+		spotAngle = M_2PI;
+	}
+}
+
+/**
+ * @fn	void LightCluster::cacheSpotCone()
+ * @brief	Computes cosSpot and sinSpot, once the cluster is complete. The
+ * 			margin keeps points on the edge of a spot from being culled by
+ * 			round-off.
+ */
+
+void LightCluster::cacheSpotCone() {
+	const float angle = spotAngle + 1.0e-4f;
+	cosSpot = std::cos(angle);
+	sinSpot = std::sin(angle);
+}
+
+/**
+ * @fn	float LightCluster::bound(const glm::vec3 &point, const glm::vec3 &normal, const Material &material) const
+ * @brief	An upper bound on the diffuse and specular light the cluster can add
+ * 			to any channel at a point. The closest the lights can be gives the
+ * 			least attenuation; if they are all behind the surface, there is no
+ * 			diffuse term.
+ * @param	point   	The point lit.
+ * @param	normal  	The surface normal at the point.
+ * @param	material	The material at the point.
+ * @return	The bound.
+ */
+
+float LightCluster::bound(const glm::vec3 &point, const glm::vec3 &normal, const Material &material) const {
+	glm::vec3 toCenter = center - point;
+	float closest = std::max(0.0f, glm::length(toCenter) - radius);
+	float denom = attenuation.constant + attenuation.linear * closest + attenuation.quadratic * closest * closest;
+	float factor = denom > 0 ? 1.0f / denom : FLT_MAX;
+	float facing = glm::dot(toCenter, normal) < -radius ? 0.0f : 1.0f;
+	return factor * (facing * maxComponent(material.diffuse * diffuse) + maxComponent(material.specular * specular));
+}
+
+/**
+ * @fn	bool LightCluster::outsideSpots(const glm::vec3 &point) const
+ * @brief	Determines if a point is outside the cone of every light in the
+ * 			cluster, so that none of them adds anything to it.
+ * @param	point	The point.
+ * @return	true iff every light is a spotlight aimed away from the point.
+ */
+
+bool LightCluster::outsideSpots(const glm::vec3 &point) const {
+	if (spotAngle >= M_PI) return false;
+	glm::vec3 w = point - center;
+	float distance2 = glm::dot(w, w);
+	if (distance2 <= radius * radius) return false;
+	// The point is outside if the angle between spotAxis and w exceeds the
+	// spot angle plus the angle the sphere spans from the point. Compared by
+	// cosines, with the cosine and sine of the sum from the cached ones.
+	float distance = std::sqrt(distance2);
+	float sinSpread = radius / distance;
+	float cosSpread = std::sqrt(1.0f - sinSpread * sinSpread);
+	if (sinSpot * cosSpread + cosSpot * sinSpread <= 0) return false;	// the sum reaches pi
+	return glm::dot(spotAxis, w) < (cosSpot * cosSpread - sinSpot * sinSpread) * distance;
+}
+
+/**
+ * @fn	void LightTree::build(const std::vector<PositionalLightPtr> &lights)
+ * @brief	Builds the tree over the lights that are on.
+ * @param	lights	The scene's lights.
+ */
+
+void LightTree::build(const std::vector<PositionalLightPtr> &lights) {
+	std::vector<int> onLights;
+	AABB extent;
+	for (unsigned int i = 0; i < lights.size(); i++) {
+		if (lights[i]->isOn) {
+			onLights.push_back(i);
+			extent.extend(lights[i]->lightPosition);
+		}
+	}
+	// Points have no area for the SAH to weigh, so each light gets a small box.
+	const float pad = onLights.empty() ? 0.0f : 1.0e-3f * std::max(1.0f, glm::length(extent.hi - extent.lo));
+	std::vector<AABB> bounds;
+	for (int light : onLights) {
+		AABB box(lights[light]->lightPosition, lights[light]->lightPosition);
+		box.pad(pad);
+		bounds.push_back(box);
+	}
+	bvh.build(bounds);
+	for (unsigned int i = 0; i < bvh.primIndices.size(); i++) {
+		bvh.primIndices[i] = onLights[bvh.primIndices[i]];
+	}
+
+	lightClusters.clear();
+	for (PositionalLightPtr light : lights) {
+		lightClusters.push_back(LightCluster::of(*light));
+		lightClusters.back().cacheSpotCone();
+	}
+	// Children follow their parents in the node array, so going backwards
+	// reaches every child before its parent.
+	clusters.assign(bvh.nodes.size(), LightCluster());
+	for (int n = (int)bvh.nodes.size() - 1; n >= 0; n--) {
+		const BVHNode &node = bvh.nodes[n];
+		if (node.isLeaf()) {
+			clusters[n] = lightClusters[bvh.primIndices[node.first]];
+			for (int i = node.first + 1; i < node.first + node.count; i++) {
+				clusters[n].add(lightClusters[bvh.primIndices[i]]);
+			}
+		} else {
+			clusters[n] = clusters[n + 1];
+			clusters[n].add(clusters[node.rightChild]);
+		}
+		clusters[n].cacheSpotCone();
+	}
+}
+
+/**
+ * @fn	void LightTree::select(const glm::vec3 &point, const glm::vec3 &normal, const Material &material, float cutoff, std::vector<int> &selected, color &culledAmbient) const
+ * @brief	Finds the lights worth evaluating, and casting shadow rays for, at
+ * 			a point. Lights whose spots miss the point are left out. Lights in
+ * 			a node whose bound is below cutoff are left out too, and their
+ * 			ambient colors are added to culledAmbient. With a cutoff of 0, no
+ * 			light that could change the point's color is left out.
+ * @param 		  	point		 	The point lit.
+ * @param 		  	normal		 	The surface normal at the point.
+ * @param 		  	material	 	The material at the point.
+ * @param 		  	cutoff		 	Bound below which lights are skipped.
+ * @param [in,out]	selected	 	Receives the indices of the lights to evaluate, in
+ * 									increasing order.
+ * @param [in,out]	culledAmbient	Receives the sum of the ambient colors of the
+ * 									lights skipped for being below the cutoff.
+ */
+
+void LightTree::select(const glm::vec3 &point, const glm::vec3 &normal, const Material &material, float cutoff,
+						std::vector<int> &selected, color &culledAmbient) const {
+	selected.clear();
+	culledAmbient = color(0, 0, 0);
+	if (bvh.isEmpty()) return;
+
+	int stack[BVH::MAX_DEPTH];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const int nodeIndex = stack[--top];
+		const BVHNode &node = bvh.nodes[nodeIndex];
+		const LightCluster &cluster = clusters[nodeIndex];
+		if (cluster.outsideSpots(point)) continue;
+		if (cluster.bound(point, normal, material) < cutoff) {
+			culledAmbient += cluster.ambient;
+			continue;
+		}
+		if (!node.isLeaf()) {
+			stack[top++] = node.rightChild;
+			stack[top++] = nodeIndex + 1;
+			continue;
+		}
+		for (int i = node.first; i < node.first + node.count; i++) {
+			const int light = bvh.primIndices[i];
+			const LightCluster &lightCluster = lightClusters[light];
+			if (node.count == 1 || !lightCluster.outsideSpots(point)) {
+				if (node.count > 1 && lightCluster.bound(point, normal, material) < cutoff) {
+					culledAmbient += lightCluster.ambient;
+				} else {
+					selected.push_back(light);
+				}
+			}
+		}
+	}
+	std::sort(selected.begin(), selected.end());
+}
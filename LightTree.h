@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+#include "Light.h"
+#include "BVH.h"
+
+/**
+ * @struct	LightCluster
+ * @brief	What a group of lights adds up to, for bounding how much light the
+ * 			group can send to a point without looking at each light.
+ */
+
+struct LightCluster {
+	color ambient = color(0, 0, 0);		//!< sum of the lights' ambient colors
+	color diffuse = color(0, 0, 0);		//!< sum of the lights' diffuse colors
+	color specular = color(0, 0, 0);	//!< sum of the lights' specular colors
+	LightAttenuationParameters attenuation;	//!< smallest of each attenuation parameter; (1, 0, 0) for no attenuation
+	glm::vec3 center;					//!< center of a sphere around the lights' positions
+	float radius = 0.0f;				//!< radius of that sphere
+	glm::vec3 spotAxis;					//!< axis of a cone around all the spotlights' cones
+	float spotAngle = M_2PI;			//!< half angle of that cone; M_PI or more if any light is not a spotlight
+	float cosSpot = -1.0f;				//!< cosine of spotAngle plus a small margin; set by cacheSpotCone
+	float sinSpot = 0.0f;				//!< sine of spotAngle plus a small margin; set by cacheSpotCone
+
+	static LightCluster of(const PositionalLight &light);
+	void add(const LightCluster &other);
+	void cacheSpotCone();
+	float bound(const glm::vec3 &point, const glm::vec3 &normal, const Material &material) const;
+	bool outsideSpots(const glm::vec3 &point) const;
+};
+
+/**
+ * @struct	LightTree
+ * @brief	Hierarchy over a scene's lights, clustered by position, so that a
+ * 			hit is lit only by the lights that can matter to it. Each node keeps
+ * 			the LightCluster of the lights below it. A node whose lights all aim
+ * 			their spots away from the hit is skipped. So is a node whose bound
+ * 			on diffuse and specular light falls below a cutoff; its lights then
+ * 			add only their ambient term. With many lights, most of the tree is
+ * 			skipped near the root, so shading cost grows slower than the number
+ * 			of lights. The tree holds the lights as they were when built; lights
+ * 			switched off are left out.
+ */
+
+struct LightTree {
+	void build(const std::vector<PositionalLightPtr> &lights);
+	bool isEmpty() const { return bvh.isEmpty(); }
+	void select(const glm::vec3 &point, const glm::vec3 &normal, const Material &material, float cutoff,
+				std::vector<int> &selected, color &culledAmbient) const;
+protected:
+	BVH bvh;								//!< hierarchy over the lights' positions; primIndices are light indices
+	std::vector<LightCluster> clusters;		//!< cluster of each node of bvh
+	std::vector<LightCluster> lightClusters;	//!< cluster of each light on its own
+};
@@ -0,0 +1,137 @@
+#include <chrono>
+#include "ProgressiveRenderer.h"
+
+/**
+ * @fn	ProgressiveRenderer::ProgressiveRenderer()
+ * @brief	Constructs a renderer with nothing rendered yet.
+ */
+
+ProgressiveRenderer::ProgressiveRenderer()
+	: tracer(black), working(1, 1), published(1, 1), cancelled(false) {
+}
+
+/**
+ * @fn	ProgressiveRenderer::~ProgressiveRenderer()
+ * @brief	Destructor. Cancels the render in progress, if any.
+ */
+
+ProgressiveRenderer::~ProgressiveRenderer() {
+	stop();
+}
+
+/**
+ * @fn	void ProgressiveRenderer::start(const RayTracer &rayTracer, int width, int height, int depth, const IScene &theScene)
+ * @brief	Cancels any render in progress and starts a new one. Returns once
+ * 			the first pass is published; the others follow in the background.
+ * @param	rayTracer	The settings to render with; copied, so later changes
+ * 						to rayTracer do not affect this render.
+ * @param	width	 	Width of the image.
+ * @param	height   	Height of the image.
+ * @param	depth	 	The depth of recursion.
+ * @param	theScene 	The scene. It must stay unchanged until stop() is
+ * 						called or the render is done.
+ */
+
+void ProgressiveRenderer::start(const RayTracer &rayTracer, int width, int height, int depth, const IScene &theScene) {
+	stop();
+	tracer = rayTracer;
+	tracer.cancel = &cancelled;
+	cancelled = false;
+	if (working.getWindowWidth() != width || working.getWindowHeight() != height) {
+		working.setFrameBufferSize(width, height);
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		publishedPass = presentedPass = -1;
+		passTimes.clear();
+	}
+	startTime = std::chrono::steady_clock::now();
+	current = true;
+
+	renderPass(0, depth, theScene);
+	worker = std::thread([this, depth, &theScene]() {
+		for (int pass = 1; pass < numPasses() && !cancelled; pass++) {
+			renderPass(pass, depth, theScene);
+		}
+	});
+}
+
+/**
+ * @fn	void ProgressiveRenderer::renderPass(int pass, int depth, const IScene &theScene)
+ * @brief	Renders one pass and, unless it was cancelled part way, publishes it.
+ * @param	pass	 	The pass: a preview for pass < blockSizes.size(), the full
+ * 						render otherwise.
+ * @param	depth	 	The depth of recursion.
+ * @param	theScene 	The scene.
+ */
+
+void ProgressiveRenderer::renderPass(int pass, int depth, const IScene &theScene) {
+	if (pass < (int)blockSizes.size()) {
+		tracer.raytraceBlocks(working, blockSizes[pass], depth, theScene);
+	} else {
+		tracer.raytraceScene(working, depth, theScene);
+	}
+	if (cancelled) {
+		return;
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	std::lock_guard<std::mutex> lock(mutex);
+	published = working;
+	publishedPass = pass;
+	passTimes.push_back(seconds);
+}
+
+/**
+ * @fn	void ProgressiveRenderer::stop()
+ * @brief	Cancels the render in progress and waits for it to stop. The scene
+ * 			may be changed once this returns.
+ */
+
+void ProgressiveRenderer::stop() {
+	cancelled = true;
+	if (worker.joinable()) {
+		worker.join();
+	}
+	current = false;
+}
+
+/**
+ * @fn	void ProgressiveRenderer::wait()
+ * @brief	Waits for the render in progress to finish all of its passes.
+ */
+
+void ProgressiveRenderer::wait() {
+	if (worker.joinable()) {
+		worker.join();
+	}
+}
+
+/**
+ * @fn	int ProgressiveRenderer::present(FrameBuffer &frameBuffer)
+ * @brief	Copies the newest finished pass into a framebuffer, if it has not
+ * 			been presented yet.
+ * @param [in,out]	frameBuffer	Receives the image; resized to match it.
+ * @return	The pass copied, or -1 if there was nothing new.
+ */
+
+int ProgressiveRenderer::present(FrameBuffer &frameBuffer) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (publishedPass <= presentedPass) {
+		return -1;
+	}
+	frameBuffer = published;
+	presentedPass = publishedPass;
+	return presentedPass;
+}
+
+/**
+ * @fn	double ProgressiveRenderer::passSeconds(int pass) const
+ * @brief	How long after start() a pass was published.
+ * @param	pass	The pass.
+ * @return	The time in seconds, or a negative value if it is not published.
+ */
+
+double ProgressiveRenderer::passSeconds(int pass) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return pass < (int)passTimes.size() ? passTimes[pass] : -1.0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Raytracer.h"
+
+/**
+ * @struct	ProgressiveRenderer
+ * @brief	Renders a scene in passes of increasing quality: blocky previews,
+ * 			one ray per block of blockSizes[i] pixels, and then the full render
+ * 			with the ray tracer's anti-aliasing. The first pass is done inside
+ * 			start(), so an image is ready at once; the rest run on a background
+ * 			thread. Each finished pass is published, and present() copies the
+ * 			newest one into a framebuffer. The scene must not change while a
+ * 			render is running; call stop() first, which cancels the render.
+ */
+
+struct ProgressiveRenderer {
+	std::vector<int> blockSizes = { 8, 4, 2 };	//!< Preview passes, coarsest first.
+
+	ProgressiveRenderer();
+	~ProgressiveRenderer();
+	void start(const RayTracer &rayTracer, int width, int height, int depth, const IScene &theScene);
+	void stop();
+	void wait();
+	int present(FrameBuffer &frameBuffer);
+	bool isCurrent() const { return current; }
+	int numPasses() const { return (int)blockSizes.size() + 1; }
+	double passSeconds(int pass) const;
+protected:
+	void renderPass(int pass, int depth, const IScene &theScene);
+	RayTracer tracer;				//!< Copy of the ray tracer's settings, made by start().
+	FrameBuffer working;			//!< Image of the pass being rendered.
+	FrameBuffer published;			//!< Image of the last finished pass.
+	std::thread worker;				//!< Renders the passes after the first.
+	std::atomic<bool> cancelled;	//!< Raised by stop(); checked between tiles.
+	mutable std::mutex mutex;		//!< Guards published, publishedPass and passTimes.
+	int publishedPass = -1;			//!< Pass held in published; -1 if none.
+	int presentedPass = -1;			//!< Pass last handed out by present().
+	std::vector<double> passTimes;	//!< Seconds from start() to the end of each pass.
+	std::chrono::steady_clock::time_point startTime;
+	bool current = false;			//!< True from start() until stop().
+};
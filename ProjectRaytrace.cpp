@@ -3,6 +3,7 @@
 #include "IShape.h"
 #include "FrameBuffer.h"
 #include "Raytracer.h"
+#include "ProgressiveRenderer.h"
 #include "IScene.h"
 #include "Light.h"
 #include "Image.h"
@@ -36,20 +37,29 @@ OrthographicCamera oCamera(glm::vec3(0, 10, 10), ORIGIN3D, Y_AXIS, 25.0f);
 RaytracingCamera *cameras[] = { &pCamera, &oCamera };
 int currCamera = 0;
 IScene scene(cameras[currCamera], false);
+ProgressiveRenderer progressive;	// declared after the scene, so it stops before the scene goes away
 
+// Anything that changes the scene, camera or window stops the progressive
+// render first; render() then starts a new one. Until the final pass is in,
+// the timer keeps asking for redisplays and render() shows the newest pass.
 void render() {
-	int frameStartTime = glutGet(GLUT_ELAPSED_TIME);
-	cameras[currCamera]->calculateViewingParameters(frameBuffer.getWindowWidth()/2, frameBuffer.getWindowHeight());
-	cameras[currCamera]->changeConfiguration(glm::vec3(12, 20, 18), ORIGIN3D, Y_AXIS);
-	//cameras[currCamera]->changeConfiguration(glm::vec3(10.0f, 5.0f, 5.0f), glm::vec3(10.0f, 20.0f, 0.0f), Y_AXIS);
-	rayTrace.raytraceScene(frameBuffer, numReflections, scene);
+	if (!progressive.isCurrent()) {
+		cameras[currCamera]->calculateViewingParameters(frameBuffer.getWindowWidth()/2, frameBuffer.getWindowHeight());
+		cameras[currCamera]->changeConfiguration(glm::vec3(12, 20, 18), ORIGIN3D, Y_AXIS);
+		//cameras[currCamera]->changeConfiguration(glm::vec3(10.0f, 5.0f, 5.0f), glm::vec3(10.0f, 20.0f, 0.0f), Y_AXIS);
+		progressive.start(rayTrace, frameBuffer.getWindowWidth(), frameBuffer.getWindowHeight(), numReflections, scene);
+	}
+	int pass = progressive.present(frameBuffer);
+	frameBuffer.showColorBuffer();
 
-	int frameEndTime = glutGet(GLUT_ELAPSED_TIME); // Get end time
-	float totalTimeSec = (frameEndTime - frameStartTime) / 1000.0f;
-	std::cout << "Render time: " << totalTimeSec << " sec." << std::endl;
+	if (pass == progressive.numPasses() - 1) {
+		std::cout << "Render time: " << progressive.passSeconds(pass) << " sec. (first image after "
+					<< progressive.passSeconds(0) << " sec.)" << std::endl;
+	}
 }
 
 void resize(int width, int height) {
+	progressive.stop();
 	frameBuffer.setFrameBufferSize(width, height);
 	cameras[currCamera]->calculateViewingParameters(width, height);
 	glutPostRedisplay();
@@ -83,11 +93,14 @@ void buildScene() {
 	
 	
 	VisibleIShapePtr p;
-	scene.addObject(p = new VisibleIShape(closedCylinderY, gold));
+	p = new VisibleIShape(closedCylinderY, gold);
 	p->setTexture(&im);
+	scene.addObject(p);
 
 	scene.addObject(lights[0]);
 	scene.addObject(lights[1]);
+
+	scene.buildBVH();
 }
 
 void incrementClamp(float &v, float delta, float lo, float hi) {
@@ -100,6 +113,7 @@ void incrementClamp(int &v, int delta, int lo, int hi) {
 
 void timer(int id) {
 	if (isAnimated) {
+		progressive.stop();
 		// modify something in your scene
 		//sphere->center.x++;	
 		float cylinderYZAxis = closedCylinderY->center.z;
@@ -124,6 +138,7 @@ void timer(int id) {
 
 void keyboard(unsigned char key, int x, int y) {
 	const float INC = 0.5f;
+	progressive.stop();
 	switch (key) {
 	case 'A':
 	case 'a':	currLight = 0;
@@ -170,19 +185,23 @@ void keyboard(unsigned char key, int x, int y) {
 				std::cout << lights[currLight]->lightPosition << std::endl;
 				break;
 	case 'J':
-	case 'j':	spotLight->spotDirection.x += (isupper(key) ? INC : -INC);
+	case 'j':	spotLight->setDirection(spotLight->spotDirection + (isupper(key) ? INC : -INC) * glm::vec3(1, 0, 0));
 				std::cout << spotLight->spotDirection << std::endl;
 				break;
 	case 'K':
-	case 'k':	spotLight->spotDirection.y += (isupper(key) ? INC : -INC);
+	case 'k':	spotLight->setDirection(spotLight->spotDirection + (isupper(key) ? INC : -INC) * glm::vec3(0, 1, 0));
 				std::cout << spotLight->spotDirection << std::endl;
 				break;
 	case 'L':
-	case 'l':	spotLight->spotDirection.z += (isupper(key) ? INC : -INC);
+	case 'l':	spotLight->setDirection(spotLight->spotDirection + (isupper(key) ? INC : -INC) * glm::vec3(0, 0, 1));
 				std::cout << spotLight->spotDirection << std::endl;
 				break;
 	case 'F':	
-	case 'f':	incrementClamp(spotLight->fov, isupper(key) ? 0.2f : -0.2f, 0.1f, M_PI); 
+	case 'f':	{
+					float fov = spotLight->fov;
+					incrementClamp(fov, isupper(key) ? 0.2f : -0.2f, 0.1f, M_PI);
+					spotLight->setFOV(fov);
+				}
 				std::cout << spotLight->fov << std::endl;
 				break;
 	case 'P':
@@ -206,10 +225,23 @@ void keyboard(unsigned char key, int x, int y) {
 				rayTrace.antiAliasing = antiAliasing;
 				std::cout << "Anti aliasing: " << antiAliasing << std::endl;
 				break;
+	case '/':	rayTrace.russianRoulette = !rayTrace.russianRoulette;
+				std::cout << "Russian roulette: " << (rayTrace.russianRoulette ? "ON" : "OFF") << std::endl;
+				break;
+	case '*':	rayTrace.adaptiveAntiAliasing = !rayTrace.adaptiveAntiAliasing;
+				std::cout << "Adaptive anti aliasing: " << (rayTrace.adaptiveAntiAliasing ? "ON" : "OFF") << std::endl;
+				break;
 
 	case '0':	
 	case '1':	
-	case '2':	numReflections = key - '0';
+	case '2':
+	case '3':
+	case '4':
+	case '5':
+	case '6':
+	case '7':
+	case '8':
+	case '9':	numReflections = key - '0';
 				std::cout << "Num reflections: " << numReflections << std::endl;
 				break;
 	case 'd':	isAnimated = !isAnimated;
@@ -228,6 +260,7 @@ void keyboard(unsigned char key, int x, int y) {
 
 void special(int key, int x, int y) {
 	const float INC = 0.5f;
+	progressive.stop();
 	switch (key) {
 		case GLUT_KEY_PAGE_DOWN: break;
 		case GLUT_KEY_PAGE_UP: break;
@@ -0,0 +1,75 @@
+#include "QuadricForm.h"
+
+/**
+ * @fn	unsigned quadricTerms(const QuadricParameters &params)
+ * @brief	Finds the parameters of a quadric that are not zero.
+ * @param	params	The quadric parameters.
+ * @return	One QuadricTerm bit per non-zero parameter.
+ */
+
+unsigned quadricTerms(const QuadricParameters &params) {
+	const float values[] = { params.A, params.B, params.C, params.D, params.E,
+							params.F, params.G, params.H, params.I, params.J };
+	unsigned terms = 0;
+	for (int i = 0; i < 10; i++) {
+		if (values[i] != 0.0f) {
+			terms |= 1u << i;
+		}
+	}
+	return terms;
+}
+
+/*
+ * The specialized sets of terms, smallest first, with the full form last, so
+ * that the first one that covers a set of terms is the cheapest.
+ */
+
+static const unsigned formTerms[] = {
+	QUADRIC_CYLINDER_X_TERMS, QUADRIC_CYLINDER_Y_TERMS, QUADRIC_CYLINDER_Z_TERMS,
+	QUADRIC_CONE_TERMS, QUADRIC_ELLIPSOID_TERMS, QUADRIC_ALL_TERMS
+};
+
+/**
+ * @fn	unsigned quadricFormTerms(unsigned terms)
+ * @brief	Finds the smallest specialized set of terms that includes the given
+ * 			ones.
+ * @param	terms	The terms that must be computed.
+ * @return	One of the QUADRIC_..._TERMS constants.
+ */
+
+unsigned quadricFormTerms(unsigned terms) {
+	for (unsigned form : formTerms) {
+		if ((terms & ~form) == 0) {
+			return form;
+		}
+	}
+	return QUADRIC_ALL_TERMS;
+}
+
+#define QUADRIC_FORM(TERMS) { TERMS, quadricCoefficients<TERMS>, quadricGradient<TERMS> }
+
+static const QuadricForm forms[] = {
+	QUADRIC_FORM(QUADRIC_CYLINDER_X_TERMS),
+	QUADRIC_FORM(QUADRIC_CYLINDER_Y_TERMS),
+	QUADRIC_FORM(QUADRIC_CYLINDER_Z_TERMS),
+	QUADRIC_FORM(QUADRIC_CONE_TERMS),
+	QUADRIC_FORM(QUADRIC_ELLIPSOID_TERMS),
+	QUADRIC_FORM(QUADRIC_ALL_TERMS)
+};
+
+/**
+ * @fn	const QuadricForm &QuadricForm::select(const QuadricParameters &params)
+ * @brief	Picks the instantiation to use for a quadric.
+ * @param	params	The quadric parameters.
+ * @return	The smallest form that covers the non-zero parameters.
+ */
+
+const QuadricForm &QuadricForm::select(const QuadricParameters &params) {
+	unsigned terms = quadricFormTerms(quadricTerms(params));
+	for (const QuadricForm &form : forms) {
+		if (form.terms == terms) {
+			return form;
+		}
+	}
+	return forms[sizeof(forms) / sizeof(forms[0]) - 1];
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include "IShape.h"
+
+/**
+ * @enum	QuadricTerm
+ * @brief	One bit per quadric parameter. A set of terms says which parameters
+ * 			of a quadric may be non-zero.
+ */
+
+enum QuadricTerm : unsigned {
+	QUADRIC_A = 1u << 0,
+	QUADRIC_B = 1u << 1,
+	QUADRIC_C = 1u << 2,
+	QUADRIC_D = 1u << 3,
+	QUADRIC_E = 1u << 4,
+	QUADRIC_F = 1u << 5,
+	QUADRIC_G = 1u << 6,
+	QUADRIC_H = 1u << 7,
+	QUADRIC_I = 1u << 8,
+	QUADRIC_J = 1u << 9
+};
+
+/*
+ * The sets of terms that have a specialized form. Every other set of terms
+ * uses the full form.
+ */
+
+const unsigned QUADRIC_ALL_TERMS = 0x3FF;
+const unsigned QUADRIC_CYLINDER_X_TERMS = QUADRIC_B | QUADRIC_C | QUADRIC_J;
+const unsigned QUADRIC_CYLINDER_Y_TERMS = QUADRIC_A | QUADRIC_C | QUADRIC_J;
+const unsigned QUADRIC_CYLINDER_Z_TERMS = QUADRIC_A | QUADRIC_B | QUADRIC_J;
+const unsigned QUADRIC_CONE_TERMS = QUADRIC_A | QUADRIC_B | QUADRIC_C;
+const unsigned QUADRIC_ELLIPSOID_TERMS = QUADRIC_A | QUADRIC_B | QUADRIC_C | QUADRIC_J;
+
+unsigned quadricTerms(const QuadricParameters &params);
+unsigned quadricFormTerms(unsigned terms);
+
+/**
+ * @fn	template <unsigned TERMS> void quadricCoefficients(const QuadricParameters &q, float twoA, float twoB, float twoC, const glm::vec3 &Ro, const glm::vec3 &Rd, float &Aq, float &Bq, float &Cq)
+ * @brief	Computes Aq, Bq and Cq for a quadric whose non-zero parameters are
+ * 			all in TERMS. The other terms are left out at compile time. The
+ * 			terms kept are added in the same order as the full form, and a
+ * 			zero term adds exactly zero, so the result is the same.
+ * @param 		  	q   	The quadric parameters.
+ * @param 		  	twoA	2*A.
+ * @param 		  	twoB	2*B.
+ * @param 		  	twoC	2*C.
+ * @param 		  	Ro  	Ray origin, relative to the quadric's center.
+ * @param 		  	Rd  	Ray direction.
+ * @param [in,out]	Aq  	The aq.
+ * @param [in,out]	Bq  	The bq.
+ * @param [in,out]	Cq  	The cq.
+ */
+
+template <unsigned TERMS>
+void quadricCoefficients(const QuadricParameters &q, float twoA, float twoB, float twoC,
+						const glm::vec3 &Ro, const glm::vec3 &Rd, float &Aq, float &Bq, float &Cq) {
+	Aq = (TERMS & QUADRIC_A) ? q.A * (Rd.x*Rd.x) : 0.0f;
+	if (TERMS & QUADRIC_B) Aq += q.B * (Rd.y*Rd.y);
+	if (TERMS & QUADRIC_C) Aq += q.C * (Rd.z*Rd.z);
+	if (TERMS & QUADRIC_D) Aq += q.D * (Rd.x * Rd.y);
+	if (TERMS & QUADRIC_E) Aq += q.E * (Rd.x * Rd.z);
+	if (TERMS & QUADRIC_F) Aq += q.F * (Rd.y * Rd.z);
+
+	Bq = (TERMS & QUADRIC_A) ? twoA * Ro.x*Rd.x : 0.0f;
+	if (TERMS & QUADRIC_B) Bq += twoB * Ro.y*Rd.y;
+	if (TERMS & QUADRIC_C) Bq += twoC * Ro.z*Rd.z;
+	if (TERMS & QUADRIC_D) Bq += q.D * (Ro.x * Rd.y + Ro.y * Rd.x);
+	if (TERMS & QUADRIC_E) Bq += q.E * (Ro.x * Rd.z + Ro.z * Rd.x);
+	if (TERMS & QUADRIC_F) Bq += q.F * (Ro.y * Rd.z + Ro.z * Rd.y);
+	if (TERMS & QUADRIC_G) Bq += q.G * Rd.x;
+	if (TERMS & QUADRIC_H) Bq += q.H * Rd.y;
+	if (TERMS & QUADRIC_I) Bq += q.I * Rd.z;
+
+	Cq = (TERMS & QUADRIC_A) ? q.A * (Ro.x * Ro.x) : 0.0f;
+	if (TERMS & QUADRIC_B) Cq += q.B * (Ro.y * Ro.y);
+	if (TERMS & QUADRIC_C) Cq += q.C * (Ro.z * Ro.z);
+	if (TERMS & QUADRIC_D) Cq += q.D * (Ro.x * Ro.y);
+	if (TERMS & QUADRIC_E) Cq += q.E * (Ro.x * Ro.z);
+	if (TERMS & QUADRIC_F) Cq += q.F * (Ro.y * Ro.z);
+	if (TERMS & QUADRIC_G) Cq += q.G * Ro.x;
+	if (TERMS & QUADRIC_H) Cq += q.H * Ro.y;
+	if (TERMS & QUADRIC_I) Cq += q.I * Ro.z;
+	if (TERMS & QUADRIC_J) Cq += q.J;
+}
+
+/**
+ * @fn	template <unsigned TERMS> glm::vec3 quadricGradient(const QuadricParameters &q, float twoA, float twoB, float twoC, const glm::vec3 &pt)
+ * @brief	The gradient of a quadric whose non-zero parameters are all in
+ * 			TERMS, with the other terms left out at compile time.
+ * @param	q   	The quadric parameters.
+ * @param	twoA	2*A.
+ * @param	twoB	2*B.
+ * @param	twoC	2*C.
+ * @param	pt  	The point, relative to the quadric's center.
+ * @return	The gradient, unnormalized.
+ */
+
+template <unsigned TERMS>
+glm::vec3 quadricGradient(const QuadricParameters &q, float twoA, float twoB, float twoC, const glm::vec3 &pt) {
+	float x = (TERMS & QUADRIC_A) ? twoA * pt.x : 0.0f;
+	if (TERMS & QUADRIC_D) x += q.D * pt.y;
+	if (TERMS & QUADRIC_E) x += q.E * pt.z;
+	if (TERMS & QUADRIC_G) x += q.G;
+
+	float y = (TERMS & QUADRIC_B) ? twoB * pt.y : 0.0f;
+	if (TERMS & QUADRIC_D) y += q.D * pt.x;
+	if (TERMS & QUADRIC_F) y += q.F * pt.z;
+	if (TERMS & QUADRIC_H) y += q.H;
+
+	float z = (TERMS & QUADRIC_C) ? twoC * pt.z : 0.0f;
+	if (TERMS & QUADRIC_E) z += q.E * pt.x;
+	if (TERMS & QUADRIC_F) z += q.F * pt.y;
+	if (TERMS & QUADRIC_I) z += q.I;
+	return glm::vec3(x, y, z);
+}
+
+/**
+ * @struct	QuadricForm
+ * @brief	One instantiation of quadricCoefficients and quadricGradient.
+ * 			IQuadricSurface picks the smallest one that covers its parameters
+ * 			when it is constructed.
+ */
+
+struct QuadricForm {
+	typedef void (*Coefficients)(const QuadricParameters &q, float twoA, float twoB, float twoC,
+								const glm::vec3 &Ro, const glm::vec3 &Rd, float &Aq, float &Bq, float &Cq);
+	typedef glm::vec3 (*Gradient)(const QuadricParameters &q, float twoA, float twoB, float twoC,
+								const glm::vec3 &pt);
+	unsigned terms;				//!< the terms this form computes
+	Coefficients coefficients;	//!< quadricCoefficients<terms>
+	Gradient gradient;			//!< quadricGradient<terms>
+
+	static const QuadricForm &select(const QuadricParameters &params);
+};
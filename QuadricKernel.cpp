@@ -0,0 +1,368 @@
+#include <cfloat>
+#include <cmath>
+#include "QuadricKernel.h"
+#include "QuadricForm.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define QUADRIC_KERNEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+/**
+ * @fn	void QuadricSoA::resize(int n)
+ * @brief	Makes room for n quadrics, plus padding. New entries are all zero.
+ * @param	n	Number of quadrics.
+ */
+
+void QuadricSoA::resize(int n) {
+	std::vector<float> *arrays[] = { &A, &B, &C, &D, &E, &F, &G, &H, &I, &J,
+									&twoA, &twoB, &twoC, &cx, &cy, &cz };
+	for (std::vector<float> *a : arrays) {
+		a->assign(n + PAD, 0.0f);
+	}
+	terms.assign(n + PAD, 0);
+}
+
+/**
+ * @fn	void QuadricSoA::set(int index, const QuadricParameters &params, const glm::vec3 &center)
+ * @brief	Stores one quadric.
+ * @param	index 	Index of the quadric.
+ * @param	params	The quadric parameters.
+ * @param	center	The center of the quadric.
+ */
+
+void QuadricSoA::set(int index, const QuadricParameters &params, const glm::vec3 &center) {
+	A[index] = params.A;
+	B[index] = params.B;
+	C[index] = params.C;
+	D[index] = params.D;
+	E[index] = params.E;
+	F[index] = params.F;
+	G[index] = params.G;
+	H[index] = params.H;
+	I[index] = params.I;
+	J[index] = params.J;
+	twoA[index] = 2.0f * params.A;
+	twoB[index] = 2.0f * params.B;
+	twoC[index] = 2.0f * params.C;
+	cx[index] = center.x;
+	cy[index] = center.y;
+	cz[index] = center.z;
+	terms[index] = quadricFormTerms(quadricTerms(params));
+}
+
+/*
+ * All kernels are templates on a set of QuadricTerms, like quadricCoefficients,
+ * and evaluate the terms in that set in the same order as quadricCoefficients
+ * and quadratic(), without fused multiply-adds. Terms whose parameter is zero
+ * add exactly zero, so the roots are bit for bit those of the scalar code
+ * whichever set a block is intersected with.
+ */
+
+template <unsigned TERMS>
+static void intersectScalar(const QuadricSoA &q, int first, int count,
+							const glm::vec3 &o, const glm::vec3 &d, QuadricHits &hits) {
+	hits.hitMask = hits.twoMask = 0;
+	for (int lane = 0; lane < count; lane++) {
+		int i = first + lane;
+		float ox = o.x - q.cx[i], oy = o.y - q.cy[i], oz = o.z - q.cz[i];
+		QuadricParameters params(q.A[i], q.B[i], q.C[i], q.D[i], q.E[i],
+								q.F[i], q.G[i], q.H[i], q.I[i], q.J[i]);
+		float Aq, Bq, Cq;
+		quadricCoefficients<TERMS>(params, q.twoA[i], q.twoB[i], q.twoC[i],
+									glm::vec3(ox, oy, oz), d, Aq, Bq, Cq);
+
+		float roots[2];
+		int numRoots = quadratic(Aq, Bq, Cq, roots);
+		int numPositive = 0;
+		hits.t0[lane] = hits.t1[lane] = FLT_MAX;
+		for (int r = 0; r < numRoots; r++) {
+			if (roots[r] > 0) {
+				(numPositive == 0 ? hits.t0 : hits.t1)[lane] = roots[r];
+				numPositive++;
+			}
+		}
+		if (numPositive > 0) hits.hitMask |= 1u << lane;
+		if (numPositive > 1) hits.twoMask |= 1u << lane;
+	}
+}
+
+#ifdef QUADRIC_KERNEL_X86
+
+static inline __m128 select(__m128 mask, __m128 ifTrue, __m128 ifFalse) {
+	return _mm_or_ps(_mm_and_ps(mask, ifTrue), _mm_andnot_ps(mask, ifFalse));
+}
+
+/**
+ * @fn	template <unsigned TERMS> static void intersectSSE(const QuadricSoA &q, int first, int count, const glm::vec3 &o, const glm::vec3 &d, QuadricHits &hits)
+ * @brief	Intersects a ray with 4 quadrics using SSE2. Lanes at or beyond count
+ * 			are computed but left out of the masks.
+ */
+
+template <unsigned TERMS>
+static void intersectSSE(const QuadricSoA &q, int first, int count,
+						const glm::vec3 &o, const glm::vec3 &d, QuadricHits &hits) {
+	const int i = first;
+	const __m128 dx = _mm_set1_ps(d.x), dy = _mm_set1_ps(d.y), dz = _mm_set1_ps(d.z);
+	const __m128 A = _mm_loadu_ps(&q.A[i]), B = _mm_loadu_ps(&q.B[i]), C = _mm_loadu_ps(&q.C[i]);
+	const __m128 D = _mm_loadu_ps(&q.D[i]), E = _mm_loadu_ps(&q.E[i]), F = _mm_loadu_ps(&q.F[i]);
+	const __m128 G = _mm_loadu_ps(&q.G[i]), H = _mm_loadu_ps(&q.H[i]), I = _mm_loadu_ps(&q.I[i]);
+	const __m128 ox = _mm_sub_ps(_mm_set1_ps(o.x), _mm_loadu_ps(&q.cx[i]));
+	const __m128 oy = _mm_sub_ps(_mm_set1_ps(o.y), _mm_loadu_ps(&q.cy[i]));
+	const __m128 oz = _mm_sub_ps(_mm_set1_ps(o.z), _mm_loadu_ps(&q.cz[i]));
+
+	const __m128 zero = _mm_setzero_ps();
+
+	__m128 Aq = (TERMS & QUADRIC_A) ? _mm_mul_ps(A, _mm_mul_ps(dx, dx)) : zero;
+	if (TERMS & QUADRIC_B) Aq = _mm_add_ps(Aq, _mm_mul_ps(B, _mm_mul_ps(dy, dy)));
+	if (TERMS & QUADRIC_C) Aq = _mm_add_ps(Aq, _mm_mul_ps(C, _mm_mul_ps(dz, dz)));
+	if (TERMS & QUADRIC_D) Aq = _mm_add_ps(Aq, _mm_mul_ps(D, _mm_mul_ps(dx, dy)));
+	if (TERMS & QUADRIC_E) Aq = _mm_add_ps(Aq, _mm_mul_ps(E, _mm_mul_ps(dx, dz)));
+	if (TERMS & QUADRIC_F) Aq = _mm_add_ps(Aq, _mm_mul_ps(F, _mm_mul_ps(dy, dz)));
+
+	__m128 Bq = (TERMS & QUADRIC_A) ? _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(&q.twoA[i]), ox), dx) : zero;
+	if (TERMS & QUADRIC_B) Bq = _mm_add_ps(Bq, _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(&q.twoB[i]), oy), dy));
+	if (TERMS & QUADRIC_C) Bq = _mm_add_ps(Bq, _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(&q.twoC[i]), oz), dz));
+	if (TERMS & QUADRIC_D) Bq = _mm_add_ps(Bq, _mm_mul_ps(D, _mm_add_ps(_mm_mul_ps(ox, dy), _mm_mul_ps(oy, dx))));
+	if (TERMS & QUADRIC_E) Bq = _mm_add_ps(Bq, _mm_mul_ps(E, _mm_add_ps(_mm_mul_ps(ox, dz), _mm_mul_ps(oz, dx))));
+	if (TERMS & QUADRIC_F) Bq = _mm_add_ps(Bq, _mm_mul_ps(F, _mm_add_ps(_mm_mul_ps(oy, dz), _mm_mul_ps(oz, dy))));
+	if (TERMS & QUADRIC_G) Bq = _mm_add_ps(Bq, _mm_mul_ps(G, dx));
+	if (TERMS & QUADRIC_H) Bq = _mm_add_ps(Bq, _mm_mul_ps(H, dy));
+	if (TERMS & QUADRIC_I) Bq = _mm_add_ps(Bq, _mm_mul_ps(I, dz));
+
+	__m128 Cq = (TERMS & QUADRIC_A) ? _mm_mul_ps(A, _mm_mul_ps(ox, ox)) : zero;
+	if (TERMS & QUADRIC_B) Cq = _mm_add_ps(Cq, _mm_mul_ps(B, _mm_mul_ps(oy, oy)));
+	if (TERMS & QUADRIC_C) Cq = _mm_add_ps(Cq, _mm_mul_ps(C, _mm_mul_ps(oz, oz)));
+	if (TERMS & QUADRIC_D) Cq = _mm_add_ps(Cq, _mm_mul_ps(D, _mm_mul_ps(ox, oy)));
+	if (TERMS & QUADRIC_E) Cq = _mm_add_ps(Cq, _mm_mul_ps(E, _mm_mul_ps(ox, oz)));
+	if (TERMS & QUADRIC_F) Cq = _mm_add_ps(Cq, _mm_mul_ps(F, _mm_mul_ps(oy, oz)));
+	if (TERMS & QUADRIC_G) Cq = _mm_add_ps(Cq, _mm_mul_ps(G, ox));
+	if (TERMS & QUADRIC_H) Cq = _mm_add_ps(Cq, _mm_mul_ps(H, oy));
+	if (TERMS & QUADRIC_I) Cq = _mm_add_ps(Cq, _mm_mul_ps(I, oz));
+	if (TERMS & QUADRIC_J) Cq = _mm_add_ps(Cq, _mm_loadu_ps(&q.J[i]));
+
+	const __m128 noHit = _mm_set1_ps(FLT_MAX);
+	__m128 disc = _mm_sub_ps(_mm_mul_ps(Bq, Bq), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(4.0f), Aq), Cq));
+	__m128 root = _mm_sqrt_ps(_mm_max_ps(disc, zero));
+	__m128 negB = _mm_xor_ps(Bq, _mm_set1_ps(-0.0f));
+	__m128 twoAq = _mm_mul_ps(_mm_set1_ps(2.0f), Aq);
+	__m128 rA = _mm_div_ps(_mm_add_ps(negB, root), twoAq);
+	__m128 rB = _mm_div_ps(_mm_sub_ps(negB, root), twoAq);
+
+	// std::min(rA, rB) and std::max(rA, rB), exactly as quadratic() picks them
+	__m128 lo = select(_mm_cmplt_ps(rB, rA), rB, rA);
+	__m128 hi = select(_mm_cmplt_ps(rA, rB), rB, rA);
+
+	__m128 two = _mm_cmpgt_ps(disc, zero);
+	__m128 one = _mm_cmpeq_ps(disc, zero);
+	__m128 root0 = select(one, rA, lo);
+	__m128 p0 = _mm_and_ps(_mm_or_ps(one, two), _mm_cmpgt_ps(root0, zero));
+	__m128 p1 = _mm_and_ps(two, _mm_cmpgt_ps(hi, zero));
+	__m128 both = _mm_and_ps(p0, p1);
+
+	_mm_storeu_ps(hits.t0, select(p0, root0, select(p1, hi, noHit)));
+	_mm_storeu_ps(hits.t1, select(both, hi, noHit));
+	unsigned laneMask = (1u << count) - 1;
+	hits.hitMask = _mm_movemask_ps(_mm_or_ps(p0, p1)) & laneMask;
+	hits.twoMask = _mm_movemask_ps(both) & laneMask;
+}
+
+/**
+ * @fn	template <unsigned TERMS> static void intersectAVX2(const QuadricSoA &q, int first, int count, const glm::vec3 &o, const glm::vec3 &d, QuadricHits &hits)
+ * @brief	Intersects a ray with 8 quadrics using AVX2. Lanes at or beyond count
+ * 			are computed but left out of the masks.
+ */
+
+template <unsigned TERMS>
+TARGET_AVX2
+static void intersectAVX2(const QuadricSoA &q, int first, int count,
+						const glm::vec3 &o, const glm::vec3 &d, QuadricHits &hits) {
+	const int i = first;
+	const __m256 dx = _mm256_set1_ps(d.x), dy = _mm256_set1_ps(d.y), dz = _mm256_set1_ps(d.z);
+	const __m256 A = _mm256_loadu_ps(&q.A[i]), B = _mm256_loadu_ps(&q.B[i]), C = _mm256_loadu_ps(&q.C[i]);
+	const __m256 D = _mm256_loadu_ps(&q.D[i]), E = _mm256_loadu_ps(&q.E[i]), F = _mm256_loadu_ps(&q.F[i]);
+	const __m256 G = _mm256_loadu_ps(&q.G[i]), H = _mm256_loadu_ps(&q.H[i]), I = _mm256_loadu_ps(&q.I[i]);
+	const __m256 ox = _mm256_sub_ps(_mm256_set1_ps(o.x), _mm256_loadu_ps(&q.cx[i]));
+	const __m256 oy = _mm256_sub_ps(_mm256_set1_ps(o.y), _mm256_loadu_ps(&q.cy[i]));
+	const __m256 oz = _mm256_sub_ps(_mm256_set1_ps(o.z), _mm256_loadu_ps(&q.cz[i]));
+
+	const __m256 zero = _mm256_setzero_ps();
+
+	__m256 Aq = (TERMS & QUADRIC_A) ? _mm256_mul_ps(A, _mm256_mul_ps(dx, dx)) : zero;
+	if (TERMS & QUADRIC_B) Aq = _mm256_add_ps(Aq, _mm256_mul_ps(B, _mm256_mul_ps(dy, dy)));
+	if (TERMS & QUADRIC_C) Aq = _mm256_add_ps(Aq, _mm256_mul_ps(C, _mm256_mul_ps(dz, dz)));
+	if (TERMS & QUADRIC_D) Aq = _mm256_add_ps(Aq, _mm256_mul_ps(D, _mm256_mul_ps(dx, dy)));
+	if (TERMS & QUADRIC_E) Aq = _mm256_add_ps(Aq, _mm256_mul_ps(E, _mm256_mul_ps(dx, dz)));
+	if (TERMS & QUADRIC_F) Aq = _mm256_add_ps(Aq, _mm256_mul_ps(F, _mm256_mul_ps(dy, dz)));
+
+	__m256 Bq = (TERMS & QUADRIC_A) ? _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(&q.twoA[i]), ox), dx) : zero;
+	if (TERMS & QUADRIC_B) Bq = _mm256_add_ps(Bq, _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(&q.twoB[i]), oy), dy));
+	if (TERMS & QUADRIC_C) Bq = _mm256_add_ps(Bq, _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(&q.twoC[i]), oz), dz));
+	if (TERMS & QUADRIC_D) Bq = _mm256_add_ps(Bq, _mm256_mul_ps(D, _mm256_add_ps(_mm256_mul_ps(ox, dy), _mm256_mul_ps(oy, dx))));
+	if (TERMS & QUADRIC_E) Bq = _mm256_add_ps(Bq, _mm256_mul_ps(E, _mm256_add_ps(_mm256_mul_ps(ox, dz), _mm256_mul_ps(oz, dx))));
+	if (TERMS & QUADRIC_F) Bq = _mm256_add_ps(Bq, _mm256_mul_ps(F, _mm256_add_ps(_mm256_mul_ps(oy, dz), _mm256_mul_ps(oz, dy))));
+	if (TERMS & QUADRIC_G) Bq = _mm256_add_ps(Bq, _mm256_mul_ps(G, dx));
+	if (TERMS & QUADRIC_H) Bq = _mm256_add_ps(Bq, _mm256_mul_ps(H, dy));
+	if (TERMS & QUADRIC_I) Bq = _mm256_add_ps(Bq, _mm256_mul_ps(I, dz));
+
+	__m256 Cq = (TERMS & QUADRIC_A) ? _mm256_mul_ps(A, _mm256_mul_ps(ox, ox)) : zero;
+	if (TERMS & QUADRIC_B) Cq = _mm256_add_ps(Cq, _mm256_mul_ps(B, _mm256_mul_ps(oy, oy)));
+	if (TERMS & QUADRIC_C) Cq = _mm256_add_ps(Cq, _mm256_mul_ps(C, _mm256_mul_ps(oz, oz)));
+	if (TERMS & QUADRIC_D) Cq = _mm256_add_ps(Cq, _mm256_mul_ps(D, _mm256_mul_ps(ox, oy)));
+	if (TERMS & QUADRIC_E) Cq = _mm256_add_ps(Cq, _mm256_mul_ps(E, _mm256_mul_ps(ox, oz)));
+	if (TERMS & QUADRIC_F) Cq = _mm256_add_ps(Cq, _mm256_mul_ps(F, _mm256_mul_ps(oy, oz)));
+	if (TERMS & QUADRIC_G) Cq = _mm256_add_ps(Cq, _mm256_mul_ps(G, ox));
+	if (TERMS & QUADRIC_H) Cq = _mm256_add_ps(Cq, _mm256_mul_ps(H, oy));
+	if (TERMS & QUADRIC_I) Cq = _mm256_add_ps(Cq, _mm256_mul_ps(I, oz));
+	if (TERMS & QUADRIC_J) Cq = _mm256_add_ps(Cq, _mm256_loadu_ps(&q.J[i]));
+
+	const __m256 noHit = _mm256_set1_ps(FLT_MAX);
+	__m256 disc = _mm256_sub_ps(_mm256_mul_ps(Bq, Bq), _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(4.0f), Aq), Cq));
+	__m256 root = _mm256_sqrt_ps(_mm256_max_ps(disc, zero));
+	__m256 negB = _mm256_xor_ps(Bq, _mm256_set1_ps(-0.0f));
+	__m256 twoAq = _mm256_mul_ps(_mm256_set1_ps(2.0f), Aq);
+	__m256 rA = _mm256_div_ps(_mm256_add_ps(negB, root), twoAq);
+	__m256 rB = _mm256_div_ps(_mm256_sub_ps(negB, root), twoAq);
+
+	__m256 lo = _mm256_blendv_ps(rA, rB, _mm256_cmp_ps(rB, rA, _CMP_LT_OQ));
+	__m256 hi = _mm256_blendv_ps(rA, rB, _mm256_cmp_ps(rA, rB, _CMP_LT_OQ));
+
+	__m256 two = _mm256_cmp_ps(disc, zero, _CMP_GT_OQ);
+	__m256 one = _mm256_cmp_ps(disc, zero, _CMP_EQ_OQ);
+	__m256 root0 = _mm256_blendv_ps(lo, rA, one);
+	__m256 p0 = _mm256_and_ps(_mm256_or_ps(one, two), _mm256_cmp_ps(root0, zero, _CMP_GT_OQ));
+	__m256 p1 = _mm256_and_ps(two, _mm256_cmp_ps(hi, zero, _CMP_GT_OQ));
+	__m256 both = _mm256_and_ps(p0, p1);
+
+	_mm256_storeu_ps(hits.t0, _mm256_blendv_ps(_mm256_blendv_ps(noHit, hi, p1), root0, p0));
+	_mm256_storeu_ps(hits.t1, _mm256_blendv_ps(noHit, hi, both));
+	unsigned laneMask = (1u << count) - 1;
+	hits.hitMask = _mm256_movemask_ps(_mm256_or_ps(p0, p1)) & laneMask;
+	hits.twoMask = _mm256_movemask_ps(both) & laneMask;
+}
+
+/**
+ * @fn	static int detectKernelWidth()
+ * @brief	Checks, once, which instruction sets the CPU and OS support.
+ * @return	8 if AVX2 can be used, otherwise 4 (SSE2 is always there).
+ */
+
+static int detectKernelWidth() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool avx2 = false;
+	if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+#else
+	__builtin_cpu_init();
+	bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+	return avx2 ? 8 : 4;
+}
+
+#else
+
+static int detectKernelWidth() {
+	return 1;
+}
+
+#endif
+
+static const int kernelWidth = detectKernelWidth();
+
+/**
+ * @fn	int quadricKernelWidth()
+ * @brief	The number of quadrics the fastest available kernel handles at once.
+ * @return	8 (AVX2), 4 (SSE2) or 1 (scalar, on other CPUs).
+ */
+
+int quadricKernelWidth() {
+	return kernelWidth;
+}
+
+/**
+ * @fn	template <unsigned TERMS> static void intersectWith(const QuadricSoA &quadrics, int first, int count, const glm::vec3 &origin, const glm::vec3 &direction, QuadricHits &hits)
+ * @brief	intersectQuadrics, with the kernels specialized for TERMS.
+ */
+
+template <unsigned TERMS>
+static void intersectWith(const QuadricSoA &quadrics, int first, int count,
+						const glm::vec3 &origin, const glm::vec3 &direction,
+						QuadricHits &hits) {
+#ifdef QUADRIC_KERNEL_X86
+	if (count > 4 && kernelWidth == 8) {
+		intersectAVX2<TERMS>(quadrics, first, count, origin, direction, hits);
+		return;
+	}
+	{
+		intersectSSE<TERMS>(quadrics, first, count < 4 ? count : 4, origin, direction, hits);
+		if (count > 4) {
+			QuadricHits rest;
+			intersectSSE<TERMS>(quadrics, first + 4, count - 4, origin, direction, rest);
+			for (int lane = 0; lane < 4; lane++) {
+				hits.t0[lane + 4] = rest.t0[lane];
+				hits.t1[lane + 4] = rest.t1[lane];
+			}
+			hits.hitMask |= rest.hitMask << 4;
+			hits.twoMask |= rest.twoMask << 4;
+		}
+		return;
+	}
+#endif
+	intersectScalar<TERMS>(quadrics, first, count, origin, direction, hits);
+}
+
+/**
+ * @fn	void intersectQuadrics(const QuadricSoA &quadrics, int first, int count, const glm::vec3 &origin, const glm::vec3 &direction, QuadricHits &hits)
+ * @brief	Intersects one ray with quadrics [first, first + count), using the
+ * 			widest kernel the CPU supports, specialized for the smallest set of
+ * 			terms that covers every quadric in the block.
+ * @param 		  	quadrics 	The packed quadrics.
+ * @param 		  	first	 	Index of the first quadric.
+ * @param 		  	count	 	Number of quadrics; at most 8.
+ * @param 		  	origin   	Origin of the ray.
+ * @param 		  	direction	Direction of the ray (normalized, as in Ray).
+ * @param [in,out]	hits	 	The positive roots of each quadric, in lane order.
+ */
+
+void intersectQuadrics(const QuadricSoA &quadrics, int first, int count,
+						const glm::vec3 &origin, const glm::vec3 &direction,
+						QuadricHits &hits) {
+	unsigned terms = 0;
+	for (int lane = 0; lane < count; lane++) {
+		terms |= quadrics.terms[first + lane];
+	}
+	switch (quadricFormTerms(terms)) {
+	case QUADRIC_CYLINDER_X_TERMS:
+		intersectWith<QUADRIC_CYLINDER_X_TERMS>(quadrics, first, count, origin, direction, hits);
+		break;
+	case QUADRIC_CYLINDER_Y_TERMS:
+		intersectWith<QUADRIC_CYLINDER_Y_TERMS>(quadrics, first, count, origin, direction, hits);
+		break;
+	case QUADRIC_CYLINDER_Z_TERMS:
+		intersectWith<QUADRIC_CYLINDER_Z_TERMS>(quadrics, first, count, origin, direction, hits);
+		break;
+	case QUADRIC_CONE_TERMS:
+		intersectWith<QUADRIC_CONE_TERMS>(quadrics, first, count, origin, direction, hits);
+		break;
+	case QUADRIC_ELLIPSOID_TERMS:
+		intersectWith<QUADRIC_ELLIPSOID_TERMS>(quadrics, first, count, origin, direction, hits);
+		break;
+	default:
+		intersectWith<QUADRIC_ALL_TERMS>(quadrics, first, count, origin, direction, hits);
+		break;
+	}
+}
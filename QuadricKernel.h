@@ -0,0 +1,48 @@
+#pragma once
+#include <vector>
+#include "IShape.h"
+
+/**
+ * @struct	QuadricSoA
+ * @brief	Quadric parameters and centers for many quadrics, stored as one array
+ * 			per parameter (structure of arrays) so that a block of consecutive
+ * 			quadrics loads straight into SIMD registers. The arrays are padded
+ * 			so a full block can be read starting at any valid index. Each
+ * 			quadric also records which terms it needs, and a block is
+ * 			intersected by a kernel specialized for the terms of its lanes.
+ */
+
+struct QuadricSoA {
+	static const int PAD = 8;	//!< extra entries after the last quadric
+	std::vector<float> A, B, C, D, E, F, G, H, I, J;
+	std::vector<float> twoA, twoB, twoC;
+	std::vector<float> cx, cy, cz;
+	std::vector<unsigned> terms;	//!< quadricFormTerms of each quadric's non-zero parameters
+
+	void resize(int n);
+	void set(int index, const QuadricParameters &params, const glm::vec3 &center);
+	int size() const { return A.empty() ? 0 : (int)A.size() - PAD; }
+};
+
+/**
+ * @struct	QuadricHits
+ * @brief	Result of intersecting one ray with a block of up to 8 quadrics. For
+ * 			each lane, the positive roots in ascending order, exactly as
+ * 			IQuadricSurface::findPositiveRoots would report them.
+ */
+
+struct QuadricHits {
+	float t0[8];		//!< first positive root, or FLT_MAX if none
+	float t1[8];		//!< second positive root, or FLT_MAX if none
+	unsigned hitMask;	//!< bit i set iff lane i has at least one positive root
+	unsigned twoMask;	//!< bit i set iff lane i has two positive roots
+
+	int numRoots(int lane) const {
+		return ((hitMask >> lane) & 1) + ((twoMask >> lane) & 1);
+	}
+};
+
+void intersectQuadrics(const QuadricSoA &quadrics, int first, int count,
+						const glm::vec3 &origin, const glm::vec3 &direction,
+						QuadricHits &hits);
+int quadricKernelWidth();
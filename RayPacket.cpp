@@ -0,0 +1,106 @@
+#include "RayPacket.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define RAY_PACKET_SSE
+#include <emmintrin.h>
+#endif
+
+/**
+ * @fn	RayPacket::RayPacket()
+ * @brief	Constructs an empty packet.
+ */
+
+RayPacket::RayPacket() : count(0) {
+}
+
+/**
+ * @fn	void RayPacket::set(int lane, const glm::vec3 &origin, const glm::vec3 &direction)
+ * @brief	Stores one ray of the packet. The packet grows to include lane.
+ * @param	lane	 	Lane of the ray, less than SIZE.
+ * @param	origin   	Origin of the ray.
+ * @param	direction	Direction of the ray.
+ */
+
+void RayPacket::set(int lane, const glm::vec3 &origin, const glm::vec3 &direction) {
+	ox[lane] = origin.x;
+	oy[lane] = origin.y;
+	oz[lane] = origin.z;
+	ix[lane] = 1.0f / direction.x;
+	iy[lane] = 1.0f / direction.y;
+	iz[lane] = 1.0f / direction.z;
+	if (lane >= count) count = lane + 1;
+}
+
+/**
+ * @fn	void RayPacket::pad()
+ * @brief	Fills the unused lanes with copies of the first ray, so that SIMD
+ * 			code can process all lanes without reading garbage.
+ */
+
+void RayPacket::pad() {
+	for (int lane = count; lane < SIZE; lane++) {
+		ox[lane] = ox[0];
+		oy[lane] = oy[0];
+		oz[lane] = oz[0];
+		ix[lane] = ix[0];
+		iy[lane] = iy[0];
+		iz[lane] = iz[0];
+	}
+}
+
+#ifdef RAY_PACKET_SSE
+
+/**
+ * @fn	static inline void slab(__m128 lo, __m128 hi, __m128 o, __m128 inv, __m128 &tNear, __m128 &tFar)
+ * @brief	One slab of the box test, for 4 rays. Written with the same
+ * 			comparisons as AABB::intersect, so every ray gets exactly the answer
+ * 			the single ray test would give, NaNs included.
+ */
+
+static inline void slab(__m128 lo, __m128 hi, __m128 o, __m128 inv, __m128 &tNear, __m128 &tFar) {
+	__m128 t0 = _mm_mul_ps(_mm_sub_ps(lo, o), inv);
+	__m128 t1 = _mm_mul_ps(_mm_sub_ps(hi, o), inv);
+	__m128 swap = _mm_cmplt_ps(inv, _mm_setzero_ps());
+	__m128 near = _mm_or_ps(_mm_and_ps(swap, t1), _mm_andnot_ps(swap, t0));
+	__m128 far = _mm_or_ps(_mm_and_ps(swap, t0), _mm_andnot_ps(swap, t1));
+	tNear = _mm_max_ps(near, tNear);	// near > tNear ? near : tNear
+	tFar = _mm_min_ps(far, tFar);		// far < tFar ? far : tFar
+}
+
+#endif
+
+/**
+ * @fn	unsigned RayPacket::intersect(const AABB &box, const float tMax[SIZE], unsigned active, float tEnter[SIZE]) const
+ * @brief	Slab test of every ray in the packet against a box.
+ * @param 		  	box   	The box.
+ * @param 		  	tMax  	Per ray, intersections beyond tMax are ignored.
+ * @param 		  	active	Mask of the rays to test.
+ * @param [in,out]	tEnter	Per ray, the t value where it enters the box.
+ * @return	Mask of the active rays that overlap the box.
+ */
+
+unsigned RayPacket::intersect(const AABB &box, const float tMax[SIZE], unsigned active, float tEnter[SIZE]) const {
+	unsigned result = 0;
+#ifdef RAY_PACKET_SSE
+	for (int base = 0; base < SIZE; base += 4) {
+		if (((active >> base) & 0xF) == 0) continue;
+		__m128 tNear = _mm_setzero_ps();
+		__m128 tFar = _mm_loadu_ps(tMax + base);
+		slab(_mm_set1_ps(box.lo.x), _mm_set1_ps(box.hi.x), _mm_loadu_ps(ox + base), _mm_loadu_ps(ix + base), tNear, tFar);
+		slab(_mm_set1_ps(box.lo.y), _mm_set1_ps(box.hi.y), _mm_loadu_ps(oy + base), _mm_loadu_ps(iy + base), tNear, tFar);
+		slab(_mm_set1_ps(box.lo.z), _mm_set1_ps(box.hi.z), _mm_loadu_ps(oz + base), _mm_loadu_ps(iz + base), tNear, tFar);
+		_mm_storeu_ps(tEnter + base, tNear);
+		result |= (unsigned)_mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) << base;
+	}
+#else
+	for (int lane = 0; lane < SIZE; lane++) {
+		if (((active >> lane) & 1) == 0) continue;
+		glm::vec3 origin(ox[lane], oy[lane], oz[lane]);
+		glm::vec3 invDir(ix[lane], iy[lane], iz[lane]);
+		if (box.intersect(origin, invDir, tMax[lane], tEnter[lane])) {
+			result |= 1u << lane;
+		}
+	}
+#endif
+	return result & active;
+}
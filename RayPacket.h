@@ -0,0 +1,23 @@
+#pragma once
+#include "AABB.h"
+
+/**
+ * @struct	RayPacket
+ * @brief	A small group of rays stored as one array per coordinate (structure
+ * 			of arrays), so that a bounding box can be tested against all of them
+ * 			at once with SIMD. Lanes at or beyond count hold copies of the first
+ * 			ray and are never reported as hits.
+ */
+
+struct RayPacket {
+	static const int SIZE = 8;	//!< maximum number of rays in a packet
+	int count;					//!< number of rays in the packet
+	float ox[SIZE], oy[SIZE], oz[SIZE];	//!< ray origins
+	float ix[SIZE], iy[SIZE], iz[SIZE];	//!< 1 / ray directions, per component
+
+	RayPacket();
+	void set(int lane, const glm::vec3 &origin, const glm::vec3 &direction);
+	void pad();
+	unsigned allLanes() const { return (1u << count) - 1; }
+	unsigned intersect(const AABB &box, const float tMax[SIZE], unsigned active, float tEnter[SIZE]) const;
+};
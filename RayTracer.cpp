@@ -1,4 +1,8 @@
-#include "RayTracer.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <cstring>
+#include "Raytracer.h"
 #include "IShape.h"
 
 /**
@@ -12,47 +16,448 @@ RayTracer::RayTracer(const color &defa)
 }
 
 /**
- * @fn	void RayTracer::raytraceScene(FrameBuffer &frameBuffer, int depth, const IScene &theScene) const
- * @brief	Raytrace scene
+ * @fn	RenderStats RayTracer::raytraceScene(FrameBuffer &frameBuffer, int depth, const IScene &theScene) const
+ * @brief	Raytrace scene. The window is split into tiles that are traced in
+ * 			parallel; every pixel is written by exactly one thread, so the
+ * 			framebuffer needs no locking and the image matches a single
+ * 			threaded render. Nothing is drawn to the screen; callers with a
+ * 			window follow up with FrameBuffer::showColorBuffer. With adaptive
+ * 			anti-aliasing, a first pass traces one sample per pixel, and a
+ * 			second pass, run once all of the first is done, supersamples the
+ * 			pixels that differ from a neighbor. With wavefront on, each tile is
+ * 			traced in stages by wavefrontTile instead.
  * @param [in,out]	frameBuffer	Framebuffer.
  * @param 		  	depth	   	The current depth of recursion.
  * @param 		  	theScene   	The scene.
+ * @return	The rays cast and intersection tests done, summed over all threads.
  */
 
-void RayTracer::raytraceScene(FrameBuffer &frameBuffer, int depth,
+RenderStats RayTracer::raytraceScene(FrameBuffer &frameBuffer, int depth,
 	const IScene &theScene) const {
+	const int W = frameBuffer.getWindowWidth();
+	const int H = frameBuffer.getWindowHeight();
+	RenderStats frameStats;
+	if (adaptiveAntiAliasing) {
+		std::vector<color> centers(W * H);
+		std::vector<int> objectIds(W * H);
+		frameStats += runTiles(W, H, [&](const Tile &tile) {
+			traceTileCenters(tile, depth, theScene, W, centers, objectIds);
+		});
+		frameStats += runTiles(W, H, [&](const Tile &tile) {
+			refineTile(frameBuffer, tile, depth, theScene, centers, objectIds);
+		});
+	} else {
+		const bool stages = wavefront && (antiAliasing == 1 || antiAliasing == 3);
+		frameStats += runTiles(W, H, [&](const Tile &tile) {
+			if (stages) {
+				wavefrontTile(frameBuffer, tile, depth, theScene);
+			} else {
+				raytraceTile(frameBuffer, tile, depth, theScene);
+			}
+		});
+	}
+	return frameStats;
+}
+
+/**
+ * @fn	RenderStats RayTracer::raytraceBlocks(FrameBuffer &frameBuffer, int blockSize, int depth, const IScene &theScene) const
+ * @brief	Quick, blocky preview: traces one ray through the middle of each
+ * 			blockSize x blockSize block of pixels and fills the whole block with
+ * 			its color. Blocks are laid out from the corner of each tile.
+ * @param [in,out]	frameBuffer	Framebuffer.
+ * @param 		  	blockSize  	Width and height of the blocks, in pixels.
+ * @param 		  	depth	   	The current depth of recursion.
+ * @param 		  	theScene   	The scene.
+ * @return	The rays cast and intersection tests done, summed over all threads.
+ */
+
+RenderStats RayTracer::raytraceBlocks(FrameBuffer &frameBuffer, int blockSize, int depth,
+	const IScene &theScene) const {
+	return runTiles(frameBuffer.getWindowWidth(), frameBuffer.getWindowHeight(), [&](const Tile &tile) {
+		const RaytracingCamera &camera = *theScene.camera;
+		std::vector<Ray> rays;
+		for (int y = tile.y0; y < tile.y1; y += blockSize) {
+			for (int x = tile.x0; x < tile.x1; x += blockSize) {
+				int sx = std::min(x + blockSize / 2, tile.x1 - 1);
+				int sy = std::min(y + blockSize / 2, tile.y1 - 1);
+				rays.push_back(camera.getRay((float)sx, (float)sy));
+			}
+		}
+		RenderStats::local().primaryRays += rays.size();
+		std::vector<color> colors(rays.size());
+		std::vector<int> ids(rays.size());
+		traceSamples(rays, depth, theScene, colors.data(), ids.data());
+
+		int sample = 0;
+		for (int y = tile.y0; y < tile.y1; y += blockSize) {
+			for (int x = tile.x0; x < tile.x1; x += blockSize) {
+				for (int py = y; py < std::min(y + blockSize, tile.y1); py++) {
+					for (int px = x; px < std::min(x + blockSize, tile.x1); px++) {
+						frameBuffer.setColor(px, py, colors[sample]);
+					}
+				}
+				sample++;
+			}
+		}
+	});
+}
+
+/**
+ * @fn	RenderStats RayTracer::runTiles(int width, int height, const std::function<void(const Tile &)> &work) const
+ * @brief	Splits a window into tiles and calls work on each, in parallel,
+ * 			adding up the counts of the work done. Once cancel is raised, the
+ * 			tiles that have not started are skipped.
+ * @param	width 	Width of the window.
+ * @param	height	Height of the window.
+ * @param	work  	Traces one tile.
+ * @return	The rays cast and intersection tests done, summed over all threads.
+ */
+
+RenderStats RayTracer::runTiles(int width, int height, const std::function<void(const Tile &)> &work) const {
+	TileScheduler scheduler(width, height, tileSize);
+	RenderStats stats;
+	std::mutex statsMutex;
+	scheduler.run(numThreads, [&](const Tile &tile) {
+		if (cancel != nullptr && cancel->load(std::memory_order_relaxed)) {
+			return;
+		}
+		RenderStats before = RenderStats::local();
+		work(tile);
+		RenderStats tileStats = RenderStats::local() - before;
+		std::lock_guard<std::mutex> lock(statsMutex);
+		stats += tileStats;
+	});
+	return stats;
+}
+
+/**
+ * @fn	void RayTracer::raytraceTile(FrameBuffer &frameBuffer, const Tile &tile, int depth, const IScene &theScene) const
+ * @brief	Raytrace the pixels of one tile. With packets on, all camera rays of
+ * 			the tile are generated first, in the same order tracePixel uses,
+ * 			and traced RayPacket::SIZE at a time; neighboring rays are close
+ * 			together, so a packet mostly shares one path through the BVH. The
+ * 			samples are then averaged per pixel exactly as tracePixel does.
+ * @param [in,out]	frameBuffer	Framebuffer.
+ * @param 		  	tile	   	The tile to trace.
+ * @param 		  	depth	   	The current depth of recursion.
+ * @param 		  	theScene   	The scene.
+ */
+
+void RayTracer::raytraceTile(FrameBuffer &frameBuffer, const Tile &tile, int depth, const IScene &theScene) const {
+	if (!usePackets || (antiAliasing != 1 && antiAliasing != 3)) {
+		for (int y = tile.y0; y < tile.y1; ++y) {
+			for (int x = tile.x0; x < tile.x1; ++x) {
+				frameBuffer.setColor(x, y, tracePixel(x, y, depth, theScene));
+			}
+		}
+		return;
+	}
+
+	std::vector<Ray> rays;
+	tileCameraRays(tile, theScene, rays);
+	RenderStats::local().primaryRays += rays.size();
+	std::vector<color> colors(rays.size());
+	for (unsigned int first = 0; first < rays.size(); first += RayPacket::SIZE) {
+		int count = std::min(RayPacket::SIZE, (int)(rays.size() - first));
+		tracePacket(&rays[first], count, depth, theScene, &colors[first]);
+	}
+	writeTileSamples(frameBuffer, tile, colors);
+}
+
+/**
+ * @fn	void RayTracer::tileCameraRays(const Tile &tile, const IScene &theScene, std::vector<Ray> &rays) const
+ * @brief	Generates the camera rays of a tile, pixel by pixel in scanline
+ * 			order, with the antiAliasing x antiAliasing samples of each pixel in
+ * 			the order tracePixel uses. antiAliasing must be 1 or 3.
+ * @param 		  	tile	The tile.
+ * @param 		  	theScene	The scene.
+ * @param [in,out]	rays	Receives the rays.
+ */
+
+void RayTracer::tileCameraRays(const Tile &tile, const IScene &theScene, std::vector<Ray> &rays) const {
 	const RaytracingCamera &camera = *theScene.camera;
-	const std::vector<VisibleIShapePtr> &objs = theScene.visibleObjects;
-	const std::vector<PositionalLightPtr> &lights = theScene.lights;
+	const float indexDSX = 1.0f / (float)antiAliasing;
+	const float indexDSY = 1.0f / (float)antiAliasing;
+	for (int y = tile.y0; y < tile.y1; ++y) {
+		for (int x = tile.x0; x < tile.x1; ++x) {
+			if (antiAliasing == 1) {
+				rays.push_back(camera.getRay((float)x, (float)y));
+			} else {
+				for (int i = -1; i < 2; i++) {
+					for (int j = -1; j < 2; j++) {
+						rays.push_back(camera.getRay(x + indexDSX * i, y + indexDSY * j));
+					}
+				}
+			}
+		}
+	}
+}
 
-	for (int y = 0; y < frameBuffer.getWindowHeight(); ++y) {
-		for (int x = 0; x < frameBuffer.getWindowWidth(); ++x) {
+/**
+ * @fn	void RayTracer::writeTileSamples(FrameBuffer &frameBuffer, const Tile &tile, const std::vector<color> &colors) const
+ * @brief	Averages the samples of each pixel of a tile, as tracePixel does,
+ * 			and writes the pixels. The samples are in the order of
+ * 			tileCameraRays.
+ * @param [in,out]	frameBuffer	Framebuffer.
+ * @param 		  	tile	   	The tile.
+ * @param 		  	colors	   	The color of each sample.
+ */
+
+void RayTracer::writeTileSamples(FrameBuffer &frameBuffer, const Tile &tile, const std::vector<color> &colors) const {
+	const int samplesPerPixel = antiAliasing * antiAliasing;
+	int sample = 0;
+	for (int y = tile.y0; y < tile.y1; ++y) {
+		for (int x = tile.x0; x < tile.x1; ++x) {
 			color colorForPixel;
 			if (antiAliasing == 1) {
-
-				Ray ray = camera.getRay((float)x, (float)y);
-				colorForPixel = traceIndividualRay(ray, theScene, depth);
-			}
-			else if (antiAliasing == 3) {
-				float indexDSX = 1.0f / (float)antiAliasing;
-				float indexDSY = 1.0f / (float)antiAliasing;
-				
-				for (int i = -1; i < 2; i++)
-				{
-					for (int j = -1; j < 2; j++)
-					{
-						Ray ray = camera.getRay(x + indexDSX * i, y + indexDSY * j);
-						colorForPixel += traceIndividualRay(ray, theScene, depth);
-					}
+				colorForPixel = colors[sample++];
+			} else {
+				for (int s = 0; s < samplesPerPixel; s++) {
+					colorForPixel += colors[sample++];
 				}
-				
-				colorForPixel =colorForPixel/ (float)(antiAliasing*antiAliasing);
+				colorForPixel = colorForPixel / (float)samplesPerPixel;
 			}
 			frameBuffer.setColor(x, y, colorForPixel);
 		}
 	}
+}
+
+/**
+ * @fn	static bool samplesDiffer(const color &a, int idA, const color &b, int idB, float threshold)
+ * @brief	Decides whether two samples are different enough to need more
+ * 			samples between them: they see different objects, or some color
+ * 			channel differs by more than threshold.
+ */
+
+static bool samplesDiffer(const color &a, int idA, const color &b, int idB, float threshold) {
+	return idA != idB || std::abs(a.r - b.r) > threshold ||
+			std::abs(a.g - b.g) > threshold || std::abs(a.b - b.b) > threshold;
+}
+
+/**
+ * @fn	void RayTracer::traceTileCenters(const Tile &tile, int depth, const IScene &theScene, int width, std::vector<color> &centers, std::vector<int> &objectIds) const
+ * @brief	First pass of adaptive anti-aliasing: traces one ray through each
+ * 			pixel of a tile, and keeps its color and the object it hit.
+ * @param 		  	tile	 	The tile to trace.
+ * @param 		  	depth	 	The current depth of recursion.
+ * @param 		  	theScene 	The scene.
+ * @param 		  	width	 	Width of the window.
+ * @param [in,out]	centers  	Color of every pixel of the window.
+ * @param [in,out]	objectIds	Object seen through every pixel of the window.
+ */
+
+void RayTracer::traceTileCenters(const Tile &tile, int depth, const IScene &theScene, int width,
+								std::vector<color> &centers, std::vector<int> &objectIds) const {
+	const RaytracingCamera &camera = *theScene.camera;
+	std::vector<Ray> rays;
+	for (int y = tile.y0; y < tile.y1; ++y) {
+		for (int x = tile.x0; x < tile.x1; ++x) {
+			rays.push_back(camera.getRay((float)x, (float)y));
+		}
+	}
+	RenderStats::local().primaryRays += rays.size();
+	std::vector<color> colors(rays.size());
+	std::vector<int> ids(rays.size());
+	traceSamples(rays, depth, theScene, colors.data(), ids.data());
 
-	frameBuffer.showColorBuffer();
+	int sample = 0;
+	for (int y = tile.y0; y < tile.y1; ++y) {
+		for (int x = tile.x0; x < tile.x1; ++x) {
+			centers[y * width + x] = colors[sample];
+			objectIds[y * width + x] = ids[sample];
+			sample++;
+		}
+	}
+}
+
+/**
+ * @fn	void RayTracer::refineTile(FrameBuffer &frameBuffer, const Tile &tile, int depth, const IScene &theScene, const std::vector<color> &centers, const std::vector<int> &objectIds) const
+ * @brief	Second pass of adaptive anti-aliasing. A pixel that differs from
+ * 			one of its four neighbors is supersampled by refineSample; every
+ * 			other pixel keeps its single sample.
+ * @param [in,out]	frameBuffer	Framebuffer.
+ * @param 		  	tile	   	The tile to refine.
+ * @param 		  	depth	   	The current depth of recursion.
+ * @param 		  	theScene   	The scene.
+ * @param 		  	centers	   	Color of every pixel, from the first pass.
+ * @param 		  	objectIds  	Object seen through every pixel, from the first pass.
+ */
+
+void RayTracer::refineTile(FrameBuffer &frameBuffer, const Tile &tile, int depth, const IScene &theScene,
+							const std::vector<color> &centers, const std::vector<int> &objectIds) const {
+	const int W = frameBuffer.getWindowWidth();
+	const int H = frameBuffer.getWindowHeight();
+	for (int y = tile.y0; y < tile.y1; ++y) {
+		for (int x = tile.x0; x < tile.x1; ++x) {
+			const int index = y * W + x;
+			bool refine = false;
+			const int neighbors[4][2] = { { x - 1, y }, { x + 1, y }, { x, y - 1 }, { x, y + 1 } };
+			for (int n = 0; n < 4 && !refine; n++) {
+				int nx = neighbors[n][0], ny = neighbors[n][1];
+				if (nx < 0 || nx >= W || ny < 0 || ny >= H) continue;
+				refine = samplesDiffer(centers[index], objectIds[index],
+										centers[ny * W + nx], objectIds[ny * W + nx], adaptiveThreshold);
+			}
+			if (refine && adaptiveMaxRate >= 3) {
+				frameBuffer.setColor(x, y, refineSample((float)x, (float)y, 1.0f, adaptiveMaxRate,
+														centers[index], objectIds[index], depth, theScene));
+			} else {
+				frameBuffer.setColor(x, y, centers[index]);
+			}
+		}
+	}
+}
+
+/**
+ * @fn	color RayTracer::refineSample(float x, float y, float size, int rate, const color &centerColor, int centerId, int depth, const IScene &theScene) const
+ * @brief	Supersamples a square of the image with a 3x3 grid, reusing the
+ * 			sample already traced at its center. The grid is the one the fixed
+ * 			3x3 anti-aliasing uses, so one level of refinement gives exactly its
+ * 			result. If the nine samples differ and rate allows, each of the nine
+ * 			cells is refined again in the same way.
+ * @param	x		   	x coordinate of the center of the square.
+ * @param	y		   	y coordinate of the center of the square.
+ * @param	size	   	Width of the square, in pixels.
+ * @param	rate	   	Most samples per axis the square may still take.
+ * @param	centerColor	Color of the sample at the center.
+ * @param	centerId   	Object seen by the sample at the center.
+ * @param	depth	   	The current depth of recursion.
+ * @param	theScene   	The scene.
+ * @return	The average color over the square.
+ */
+
+color RayTracer::refineSample(float x, float y, float size, int rate, const color &centerColor, int centerId,
+								int depth, const IScene &theScene) const {
+	const RaytracingCamera &camera = *theScene.camera;
+	const float step = size / 3.0f;
+	std::vector<Ray> rays;
+	rays.reserve(8);
+	for (int i = -1; i < 2; i++) {
+		for (int j = -1; j < 2; j++) {
+			if (i != 0 || j != 0) {
+				rays.push_back(camera.getRay(x + step * i, y + step * j));
+			}
+		}
+	}
+	RenderStats::local().primaryRays += rays.size();
+	color ringColors[8];
+	int ringIds[8];
+	traceSamples(rays, depth, theScene, ringColors, ringIds);
+
+	color colors[9];
+	int ids[9];
+	bool varies = false;
+	for (int k = 0, ring = 0; k < 9; k++) {
+		if (k == 4) {
+			colors[k] = centerColor;
+			ids[k] = centerId;
+		} else {
+			colors[k] = ringColors[ring];
+			ids[k] = ringIds[ring];
+			ring++;
+			varies = varies || samplesDiffer(colors[k], ids[k], centerColor, centerId, adaptiveThreshold);
+		}
+	}
+
+	color result;
+	for (int k = 0; k < 9; k++) {
+		if (varies && rate >= 9) {
+			int i = k / 3 - 1, j = k % 3 - 1;
+			result += refineSample(x + step * i, y + step * j, step, rate / 3, colors[k], ids[k], depth, theScene);
+		} else {
+			result += colors[k];
+		}
+	}
+	return result / 9.0f;
+}
+
+/**
+ * @fn	void RayTracer::traceSamples(const std::vector<Ray> &rays, int depth, const IScene &theScene, color colors[], int objectIds[]) const
+ * @brief	Traces camera rays, in packets if they are enabled, and reports both
+ * 			the color and the object hit for each.
+ * @param 		  	rays	 	The rays.
+ * @param 		  	depth	 	The current depth of recursion.
+ * @param 		  	theScene 	The scene.
+ * @param [in,out]	colors   	The color of each ray.
+ * @param [in,out]	objectIds	The object each ray hit, or -1.
+ */
+
+void RayTracer::traceSamples(const std::vector<Ray> &rays, int depth, const IScene &theScene, color colors[], int objectIds[]) const {
+	for (unsigned int first = 0; first < rays.size(); first += RayPacket::SIZE) {
+		int count = std::min(RayPacket::SIZE, (int)(rays.size() - first));
+		HitRecord hits[RayPacket::SIZE];
+		if (usePackets) {
+			theScene.findClosestIntersections(&rays[first], count, hits);
+		} else {
+			for (int i = 0; i < count; i++) {
+				hits[i] = theScene.findClosestIntersection(rays[first + i]);
+			}
+		}
+		for (int i = 0; i < count; i++) {
+			colors[first + i] = shadeHit(rays[first + i], hits[i], theScene, depth);
+			objectIds[first + i] = hits[i].objectId;
+		}
+	}
+}
+
+/**
+ * @fn	void RayTracer::tracePacket(const Ray *rays, int count, int depth, const IScene &theScene, color colors[]) const
+ * @brief	Traces a packet of camera rays. The closest hits are found for the
+ * 			whole packet at once; shading, shadow rays and reflections then
+ * 			proceed one ray at a time, since after a bounce the rays no longer
+ * 			travel together.
+ * @param 		  	rays	 	The rays.
+ * @param 		  	count	 	Number of rays, at most RayPacket::SIZE.
+ * @param 		  	depth	 	The current depth of recursion.
+ * @param 		  	theScene 	The scene.
+ * @param [in,out]	colors   	The color of each ray.
+ */
+
+void RayTracer::tracePacket(const Ray *rays, int count, int depth, const IScene &theScene, color colors[]) const {
+	HitRecord hits[RayPacket::SIZE];
+	theScene.findClosestIntersections(rays, count, hits);
+	for (int i = 0; i < count; i++) {
+		colors[i] = shadeHit(rays[i], hits[i], theScene, depth);
+	}
+}
+
+/**
+ * @fn	color RayTracer::tracePixel(int x, int y, int depth, const IScene &theScene) const
+ * @brief	Computes the color of pixel (x, y), anti-aliased if requested.
+ * @param	x			The x coordinate.
+ * @param	y			The y coordinate.
+ * @param	depth   	The current depth of recursion.
+ * @param	theScene	The scene.
+ * @return	The color of the pixel.
+ */
+
+color RayTracer::tracePixel(int x, int y, int depth, const IScene &theScene) const {
+	const RaytracingCamera &camera = *theScene.camera;
+	RenderStats &stats = RenderStats::local();
+	color colorForPixel;
+	if (antiAliasing == 1) {
+
+		Ray ray = camera.getRay((float)x, (float)y);
+		stats.primaryRays++;
+		colorForPixel = traceIndividualRay(ray, theScene, depth);
+	}
+	else if (antiAliasing == 3) {
+		float indexDSX = 1.0f / (float)antiAliasing;
+		float indexDSY = 1.0f / (float)antiAliasing;
+		
+		for (int i = -1; i < 2; i++)
+		{
+			for (int j = -1; j < 2; j++)
+			{
+				Ray ray = camera.getRay(x + indexDSX * i, y + indexDSY * j);
+				stats.primaryRays++;
+				colorForPixel += traceIndividualRay(ray, theScene, depth);
+			}
+		}
+		
+		colorForPixel =colorForPixel/ (float)(antiAliasing*antiAliasing);
+	}
+	return colorForPixel;
 }
 
 
@@ -66,77 +471,586 @@ void RayTracer::raytraceScene(FrameBuffer &frameBuffer, int depth,
  */
 
 color RayTracer::traceIndividualRay(const Ray &ray, const IScene &theScene, int recursionLevel) const {
-	HitRecord theHit = VisibleIShape::findIntersection(ray, theScene.visibleObjects);
-	HitRecord transHit = VisibleIShape::findIntersection(ray, theScene.transparentObjects);
-	color result = { 0,0,0 };
-	
-	if (theHit.t < FLT_MAX) {
+	return shadeHit(ray, theScene.findClosestIntersection(ray), theScene, recursionLevel);
+}
 
-		if (theHit.texture != nullptr) {  // if object has a texture, use it
-			float u = glm::clamp(theHit.u, 0.0f, 1.0f);
-			float v = glm::clamp(theHit.v, 0.0f, 1.0f);
-			color textureColor = theHit.texture->getPixel(u, v);
-			result+= getLightColor(ray,theScene,theHit,result)*0.5f + textureColor*0.5f;
-		}
-		else {			// otherwise, compute color normally
-						// Here, compute color normally
-			result += getLightColor(ray,theScene,theHit,result);
+/**
+ * @fn	static float rouletteSample(const Ray &ray, int bounce)
+ * @brief	A number in [0, 1) for deciding Russian roulette. It is a hash of
+ * 			the ray and the bounce rather than a random number, so renders are
+ * 			repeatable and do not depend on which thread traced which tile.
+ */
+
+static float rouletteSample(const Ray &ray, int bounce) {
+	const float values[6] = { ray.origin.x, ray.origin.y, ray.origin.z,
+								ray.direction.x, ray.direction.y, ray.direction.z };
+	unsigned int h = 2166136261u ^ (unsigned int)bounce;
+	for (int i = 0; i < 6; i++) {
+		unsigned int bits;
+		std::memcpy(&bits, &values[i], sizeof(bits));
+		h = (h ^ bits) * 16777619u;
+	}
+	h ^= h >> 16;
+	h *= 0x7FEB352Du;
+	h ^= h >> 15;
+	return (h >> 8) * (1.0f / 16777216.0f);
+}
+
+/**
+ * @fn	color RayTracer::shadeHit(const Ray &ray, const HitRecord &theHit, const IScene &theScene, int recursionLevel) const
+ * @brief	Computes the color seen along a ray, given its closest hit. The
+ * 			reflections are followed in a loop rather than by recursion; each
+ * 			bounce adds half as much as the one before. The loop stops after
+ * 			recursionLevel bounces, on a miss, or once the weight of the next
+ * 			bounce drops below minThroughput, since it could no longer change the
+ * 			8 bit result. With Russian roulette on, bounces past
+ * 			rouletteMinDepth continue only with probability REFLECTION_WEIGHT,
+ * 			and the survivors are weighted up to compensate.
+ * @param	ray			  	The ray.
+ * @param	theHit		  	The closest hit along the ray.
+ * @param	theScene	  	The scene.
+ * @param	recursionLevel	Most reflections to follow.
+ * @return	The color to be displayed as a result of this ray.
+ */
+
+color RayTracer::shadeHit(const Ray &ray, const HitRecord &theHit, const IScene &theScene, int recursionLevel) const {
+	const float REFLECTION_WEIGHT = 0.5f;
+	color result = shadeLocal(ray, theHit, theScene);
+	Ray currentRay = ray;
+	HitRecord hit = theHit;
+	float weight = 1.0f;
+	for (int bounce = 1; bounce <= recursionLevel && hit.t < FLT_MAX; bounce++) {
+		weight *= REFLECTION_WEIGHT;
+		if (weight < minThroughput) {
+			break;
 		}
-		if (transHit.t < FLT_MAX) {
-			if (theHit.t > transHit.t) {
-				Material material = transHit.material;
-				result += result * (1 - material.alpha) + material.alpha*(material.ambient);
+		if (russianRoulette && bounce > rouletteMinDepth) {
+			if (rouletteSample(currentRay, bounce) >= REFLECTION_WEIGHT) {
+				break;
 			}
+			weight /= REFLECTION_WEIGHT;
 		}
-		
+
+		glm::vec3 reflectionDirection = (currentRay.direction - 2 * glm::dot(currentRay.direction,hit.surfaceNormal)*hit.surfaceNormal);
+		currentRay = Ray(hit.interceptPoint+EPSILON*hit.surfaceNormal, reflectionDirection);
+		RenderStats::local().reflectionRays++;
+		hit = theScene.findClosestIntersection(currentRay);
+		result += shadeLocal(currentRay, hit, theScene) * weight;
 	}
-	else {
+	return result;
+}
+
+/**
+ * @fn	color RayTracer::shadeLocal(const Ray &ray, const HitRecord &theHit, const IScene &theScene) const
+ * @brief	Computes the color of a hit without reflections: lighting, texture
+ * 			and any transparent object in front of it.
+ * @param	ray			The ray.
+ * @param	theHit  	The closest hit along the ray.
+ * @param	theScene	The scene.
+ * @return	The color at the hit; black if the ray hit nothing.
+ */
+
+color RayTracer::shadeLocal(const Ray &ray, const HitRecord &theHit, const IScene &theScene) const {
+	color result = { 0,0,0 };
+	if (theHit.t == FLT_MAX) {
 		return result;
 	}
+	HitRecord transHit = VisibleIShape::findIntersection(ray, theScene.transparentObjects);
+	return combineLocal(theHit, transHit, getLightColor(ray, theScene, theHit, result), theScene);
+}
 
-	
-
+/**
+ * @fn	color RayTracer::combineLocal(const HitRecord &theHit, const HitRecord &transHit, const color &lightColor, const IScene &theScene) const
+ * @brief	The last step of shadeLocal, once the lights have been added up:
+ * 			mixes in the texture and the transparent object in front, if any.
+ * @param	theHit	  	The closest hit along the ray.
+ * @param	transHit  	The closest transparent object along the ray.
+ * @param	lightColor	The light reaching the hit, from getLightColor.
+ * @param	theScene  	The scene.
+ * @return	The color at the hit.
+ */
 
-	if (recursionLevel == 0) {
-		return result;
+color RayTracer::combineLocal(const HitRecord &theHit, const HitRecord &transHit, const color &lightColor, const IScene &theScene) const {
+	color result = { 0,0,0 };
+	if (theHit.textureId >= 0) {  // if object has a texture, use it
+		float u = glm::clamp(theHit.u, 0.0f, 1.0f);
+		float v = glm::clamp(theHit.v, 0.0f, 1.0f);
+		color textureColor = theScene.textures[theHit.textureId]->getPixel(u, v);
+		result += lightColor*0.5f + textureColor*0.5f;
 	}
-	else {
-		
-		glm::vec3 reflectionDirection = (ray.direction - 2 * glm::dot(ray.direction,theHit.surfaceNormal)*theHit.surfaceNormal);
-		Ray reflectionRay(theHit.interceptPoint+EPSILON*theHit.surfaceNormal, reflectionDirection);
-		result = result+traceIndividualRay(reflectionRay, theScene, recursionLevel - 1)*0.5f;
-		
+	else {			// otherwise, compute color normally
+		result += lightColor;
+	}
+	if (transHit.t < FLT_MAX) {
+		if (theHit.t > transHit.t) {
+			const Material &material = theScene.materials[transHit.materialId];
+			result += result * (1 - material.alpha) + material.alpha*(material.ambient);
+		}
 	}
 	return result;
+}
 
+/**
+ * @fn	void RayTracer::selectLights(const HitRecord &theHit, const IScene &theScene, std::vector<int> &lights, color &culledAmbient) const
+ * @brief	Picks the lights to evaluate at a hit: all of them, or with
+ * 			useLightTree, those the scene's light tree finds significant.
+ * @param 		  	theHit		 	The hit.
+ * @param 		  	theScene	 	The scene.
+ * @param [in,out]	lights		 	Receives the indices of the lights, in increasing order.
+ * @param [in,out]	culledAmbient	Receives the ambient color of the lights skipped.
+ */
+
+void RayTracer::selectLights(const HitRecord &theHit, const IScene &theScene, std::vector<int> &lights, color &culledAmbient) const {
+	if (useLightTree && !theScene.lightTree.isEmpty()) {
+		theScene.lightTree.select(theHit.interceptPoint, theHit.surfaceNormal, theScene.materials[theHit.materialId],
+									lightCutoff, lights, culledAmbient);
+		return;
+	}
+	lights.clear();
+	for (unsigned int i = 0; i < theScene.lights.size(); i++) {
+		lights.push_back(i);
+	}
+	culledAmbient = color(0, 0, 0);
+}
+
+/**
+ * @fn	bool RayTracer::castsShadowRay(const PositionalLight &light, const HitRecord &theHit, const Material &material) const
+ * @brief	The per light pre-pass of shading: decides, before any shadow ray,
+ * 			whether the light could add more than its ambient term to the hit
+ * 			if it were not blocked. It could not if it is off, if the spot cone
+ * 			misses the hit, if the surface faces away from it, or if N.L,
+ * 			attenuation and the cone bring its diffuse and specular terms below
+ * 			shadowCutoff in every channel. The light is then shaded as if in
+ * 			shadow, which adds exactly its ambient term (nothing if it is off
+ * 			or the cone misses).
+ * @param	light   	The light.
+ * @param	theHit  	The hit.
+ * @param	material	The material at the hit.
+ * @return	true iff a shadow ray toward the light is worth casting.
+ */
+
+bool RayTracer::castsShadowRay(const PositionalLight &light, const HitRecord &theHit, const Material &material) const {
+	if (!light.isOn) return false;
+	const glm::vec3 toLight = light.lightPosition - theHit.interceptPoint;
+	const float nDotL = glm::dot(theHit.surfaceNormal, toLight);
+	if (nDotL <= 0.0f) return false;
+	const float cone = light.coneFactor(theHit.interceptPoint);
+	if (cone <= 0.0f) return false;
+	const float distance = glm::length(toLight);
+	const float attenuation = light.attenuationIsTurnedOn ? light.attenuationParams.factor(distance) : 1.0f;
+	// The specular term is at most the product of the colors; the diffuse one is exact.
+	const color bound = (material.diffuse * light.lightColorComponents.diffuse * (nDotL / distance)
+						+ material.specular * light.lightColorComponents.specular) * (attenuation * cone);
+	return std::max(bound.r, std::max(bound.g, bound.b)) >= shadowCutoff;
+}
+
+/**
+ * @fn	bool RayTracer::inShadow(const Ray &shadowRay, float distanceToLight, int light, const IScene &theScene) const
+ * @brief	Determines if a shadow ray toward a light is blocked. With
+ * 			useOccluderCache, each thread remembers the object that last
+ * 			blocked each light and tests it first; the remembered index is
+ * 			only a hint, so a stale one from another scene or frame costs one
+ * 			test and nothing else.
+ * @param	shadowRay	   	The shadow ray.
+ * @param	distanceToLight	Distance from the ray's origin to the light.
+ * @param	light		   	Index of the light in theScene.lights.
+ * @param	theScene	   	The scene.
+ * @return	true iff something blocks the ray before the light.
+ */
+
+bool RayTracer::inShadow(const Ray &shadowRay, float distanceToLight, int light, const IScene &theScene) const {
+	if (!useOccluderCache) {
+		return theScene.isOccluded(shadowRay, distanceToLight);
+	}
+	thread_local std::vector<int> lastOccluders;
+	if (lastOccluders.size() < theScene.lights.size()) {
+		lastOccluders.resize(theScene.lights.size(), -1);
+	}
+	return theScene.isOccluded(shadowRay, distanceToLight, lastOccluders[light]);
+}
+
+/**
+ * @fn	static float stratumJitter(const glm::vec3 &point, int light, int sample)
+ * @brief	A number in [0, 1) that depends only on its arguments, for placing
+ * 			samples within their strata. Hashing the point instead of drawing
+ * 			from a generator keeps images the same from run to run, whatever
+ * 			the thread count or pipeline.
+ */
+
+static float stratumJitter(const glm::vec3 &point, int light, int sample) {
+	unsigned int bits[3];
+	std::memcpy(bits, &point[0], sizeof(bits));
+	unsigned int h = 2166136261u;
+	const unsigned int words[5] = { bits[0], bits[1], bits[2], (unsigned int)light, (unsigned int)sample };
+	for (unsigned int word : words) {
+		h = (h ^ word) * 16777619u;
+	}
+	h ^= h >> 15;
+	h *= 0x2c1b3c6du;
+	h ^= h >> 12;
+	return (h >> 8) * (1.0f / 16777216.0f);
+}
+
+/**
+ * @fn	color RayTracer::areaLightColor(const AreaLight &light, int lightIndex, const HitRecord &theHit, const Material &material, const IScene &theScene) const
+ * @brief	The color an area light adds at a hit, with soft shadows. The
+ * 			four corner strata are sampled first. If their shadow rays agree,
+ * 			the hit is fully lit or fully blocked and their mean is used; only
+ * 			hits in a penumbra go on to sample every other stratum. Samples
+ * 			behind the surface are taken as blocked, without a shadow ray.
+ * @param	light	  	The light.
+ * @param	lightIndex	Index of the light in theScene.lights.
+ * @param	theHit	  	The hit.
+ * @param	material  	The material at the hit.
+ * @param	theScene  	The scene.
+ * @return	The light's color at the hit.
+ */
 
+color RayTracer::areaLightColor(const AreaLight &light, int lightIndex, const HitRecord &theHit, const Material &material,
+								const IScene &theScene) const {
+	if (!light.isOn) return black;
+	RenderStats &stats = RenderStats::local();
+	const glm::vec3 &point = theHit.interceptPoint;
+	const int n = std::max(1, light.samplesPerAxis);
+	color sum(0, 0, 0);
+	int taken = 0, lit = 0;
+	auto sample = [&](int i, int j) {
+		const int stratum = i * n + j;
+		const glm::vec3 position = light.pointAt((i + stratumJitter(point, lightIndex, 2 * stratum)) / n,
+												(j + stratumJitter(point, lightIndex, 2 * stratum + 1)) / n);
+		const glm::vec3 toLight = position - point;
+		bool blocked = true;
+		if (glm::dot(theHit.surfaceNormal, toLight) > 0.0f) {
+			stats.shadowRays++;
+			Ray shadowRay(point + EPSILON * theHit.surfaceNormal, toLight);
+			blocked = inShadow(shadowRay, glm::length(toLight), lightIndex, theScene);
+		} else {
+			stats.shadowRaysAvoided++;
+		}
+		sum += light.illuminateFrom(position, point, theHit.surfaceNormal, material, theScene.camera->cameraFrame, blocked);
+		taken++;
+		lit += blocked ? 0 : 1;
+	};
 
+	const int last = n - 1;
+	sample(0, 0);
+	if (n > 1) {
+		sample(0, last);
+		sample(last, 0);
+		sample(last, last);
+	}
+	if (lit == 0 || lit == taken) {
+		return sum / (float)taken;
+	}
+	stats.areaLightRefinements++;
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < n; j++) {
+			if ((i == 0 || i == last) && (j == 0 || j == last)) continue;
+			sample(i, j);
+		}
+	}
+	return sum / (float)taken;
 }
 
-color RayTracer::getLightColor(const Ray &ray, const IScene &theScene, HitRecord &theHit,color &result) const{
+color RayTracer::getLightColor(const Ray &ray, const IScene &theScene, const HitRecord &theHit,color &result) const{
 	color finalResult=result;
-	for each (PositionalLightPtr light1 in theScene.lights)
+	const Material &material = theScene.materials[theHit.materialId];
+	thread_local std::vector<int> selected;
+	color culledAmbient;
+	selectLights(theHit, theScene, selected, culledAmbient);
+	RenderStats &stats = RenderStats::local();
+	for (int light : selected)
 	{
-		bool isShadow = false;
-		color resultColor;
+		PositionalLightPtr light1 = theScene.lights[light];
+		if (const AreaLight *area = light1->asAreaLight()) {
+			finalResult += areaLightColor(*area, light, theHit, material, theScene);
+			continue;
+		}
+		bool isShadow = true;
+		if (castsShadowRay(*light1, theHit, material)) {
+			stats.shadowRays++;
+			glm::vec3 shadowDirection1 = light1->lightPosition - theHit.interceptPoint;
+			Ray shadowRay1(theHit.interceptPoint + EPSILON * theHit.surfaceNormal, shadowDirection1);
+			float disShadowToLight1 = glm::distance(theHit.interceptPoint, light1->lightPosition);
+			isShadow = inShadow(shadowRay1, disShadowToLight1, light, theScene);
+		} else {
+			stats.shadowRaysAvoided++;
+		}
+
+		finalResult += light1->illuminate(theHit.interceptPoint, theHit.surfaceNormal, material, theScene.camera->cameraFrame, isShadow);
+	}
+	if (useLightTree) {
+		finalResult += ambientColor(material.ambient, culledAmbient);
+	}
+
+	return finalResult;
+}
+
+/**
+ * @fn	static double secondsSince(std::chrono::steady_clock::time_point start)
+ * @brief	Time elapsed since start, in seconds.
+ */
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @fn	static int directionOctant(const Ray &ray)
+ * @brief	Which of the eight octants a ray points into: one bit per negative
+ * 			direction component.
+ */
+
+static int directionOctant(const Ray &ray) {
+	return (ray.direction.x < 0 ? 1 : 0) | (ray.direction.y < 0 ? 2 : 0) | (ray.direction.z < 0 ? 4 : 0);
+}
 
-		glm::vec3 shadowDirection1 = light1->lightPosition - theHit.interceptPoint;
-		Ray shadowRay1(theHit.interceptPoint + EPSILON * theHit.surfaceNormal, shadowDirection1);
-		HitRecord shadowHit1 = VisibleIShape::findIntersection(shadowRay1, theScene.visibleObjects);
-		float disShadowToLight1 = glm::distance(theHit.interceptPoint, light1->lightPosition);
-		if (shadowHit1.t < disShadowToLight1) {
-			isShadow = true;
-			resultColor = light1->illuminate(theHit.interceptPoint, theHit.surfaceNormal, theHit.material, theScene.camera->cameraFrame, isShadow);
+/**
+ * @fn	void RayTracer::wavefrontTile(FrameBuffer &frameBuffer, const Tile &tile, int depth, const IScene &theScene) const
+ * @brief	Raytrace the pixels of one tile in stages rather than one ray at a
+ * 			time. Each camera sample starts a path, and the paths still going
+ * 			are kept in a queue. Every stage runs over the whole queue before
+ * 			the next one starts, so the same code and the same shapes are
+ * 			worked on back to back: all camera rays are intersected, all hits
+ * 			shaded, all their shadow rays tested, then all reflection rays
+ * 			generated and intersected, and so on until no path is left. Each
+ * 			path does the arithmetic of shadeHit, in the same order, so the
+ * 			image is the same as that of raytraceTile.
+ * @param [in,out]	frameBuffer	Framebuffer.
+ * @param 		  	tile	   	The tile to trace.
+ * @param 		  	depth	   	Most reflections to follow.
+ * @param 		  	theScene   	The scene.
+ */
+
+void RayTracer::wavefrontTile(FrameBuffer &frameBuffer, const Tile &tile, int depth, const IScene &theScene) const {
+	const float REFLECTION_WEIGHT = 0.5f;
+	RenderStats &stats = RenderStats::local();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<Ray> rays;
+	tileCameraRays(tile, theScene, rays);
+	stats.primaryRays += rays.size();
+	std::vector<int> queue(rays.size());
+	for (unsigned int i = 0; i < queue.size(); i++) {
+		queue[i] = i;
+	}
+	std::vector<HitRecord> hits(rays.size());
+	std::vector<color> colors(rays.size());
+	std::vector<float> weights(rays.size(), 1.0f);
+	intersectQueue(queue, rays, hits, theScene, stats.primaryStage);
+	stats.primaryStage.seconds += secondsSince(start);
+
+	for (int bounce = 1; !queue.empty(); bounce++) {
+		shadeQueue(queue, rays, hits, weights, colors, theScene);
+		if (bounce > depth) {
+			break;
 		}
-		else {
-			isShadow = false;
-			resultColor = light1->illuminate(theHit.interceptPoint, theHit.surfaceNormal, theHit.material, theScene.camera->cameraFrame, isShadow);
+
+		start = std::chrono::steady_clock::now();
+		int kept = 0;
+		for (int path : queue) {
+			float weight = weights[path] * REFLECTION_WEIGHT;
+			if (weight < minThroughput) {
+				continue;
+			}
+			if (russianRoulette && bounce > rouletteMinDepth) {
+				if (rouletteSample(rays[path], bounce) >= REFLECTION_WEIGHT) {
+					continue;
+				}
+				weight /= REFLECTION_WEIGHT;
+			}
+			const HitRecord &hit = hits[path];
+			glm::vec3 reflectionDirection = (rays[path].direction - 2 * glm::dot(rays[path].direction,hit.surfaceNormal)*hit.surfaceNormal);
+			rays[path] = Ray(hit.interceptPoint+EPSILON*hit.surfaceNormal, reflectionDirection);
+			weights[path] = weight;
+			queue[kept++] = path;
 		}
+		queue.resize(kept);
+		stats.reflectionRays += kept;
+		intersectQueue(queue, rays, hits, theScene, stats.reflectionStage);
+		stats.reflectionStage.seconds += secondsSince(start);
+	}
+	writeTileSamples(frameBuffer, tile, colors);
+}
 
+/**
+ * @fn	void RayTracer::intersectQueue(std::vector<int> &queue, const std::vector<Ray> &rays, std::vector<HitRecord> &hits, const IScene &theScene, StageStats &stage) const
+ * @brief	The intersection stage of wavefrontTile. The queue is first binned
+ * 			by direction octant, keeping the order within each bin, and each bin
+ * 			is traced in packets of RayPacket::SIZE, so a packet's rays head the
+ * 			same way and mostly share one path through the BVH. Paths whose ray
+ * 			hits nothing are then dropped from the queue; they add no more color.
+ * @param [in,out]	queue   	The paths to trace, as indices into rays and hits.
+ * @param 		  	rays		The current ray of each path.
+ * @param [in,out]	hits		Receives the closest hit of each path in the queue.
+ * @param 		  	theScene	The scene.
+ * @param [in,out]	stage   	Counts the batch, its rays and the packet lanes used.
+ */
 
-		finalResult += resultColor;
+void RayTracer::intersectQueue(std::vector<int> &queue, const std::vector<Ray> &rays, std::vector<HitRecord> &hits,
+	const IScene &theScene, StageStats &stage) const {
+	if (queue.empty()) {
+		return;
 	}
+	int binEnd[8] = { 0 };
+	for (int path : queue) {
+		binEnd[directionOctant(rays[path])]++;
+	}
+	int binStart[8];
+	for (int octant = 0, first = 0; octant < 8; octant++) {
+		binStart[octant] = first;
+		first += binEnd[octant];
+		binEnd[octant] = binStart[octant];
+	}
+	std::vector<int> binned(queue.size());
+	for (int path : queue) {
+		binned[binEnd[directionOctant(rays[path])]++] = path;
+	}
+	queue.swap(binned);
 
-	return finalResult;
+	stage.batches++;
+	stage.rays += queue.size();
+	std::vector<Ray> packet;
+	packet.reserve(RayPacket::SIZE);
+	for (int octant = 0; octant < 8; octant++) {
+		for (int first = binStart[octant]; first < binEnd[octant]; first += RayPacket::SIZE) {
+			int count = std::min(RayPacket::SIZE, binEnd[octant] - first);
+			HitRecord packetHits[RayPacket::SIZE];
+			packet.clear();
+			for (int i = 0; i < count; i++) {
+				packet.push_back(rays[queue[first + i]]);
+			}
+			if (usePackets) {
+				theScene.findClosestIntersections(packet.data(), count, packetHits);
+				stage.lanes += RayPacket::SIZE;
+			} else {
+				for (int i = 0; i < count; i++) {
+					packetHits[i] = theScene.findClosestIntersection(packet[i]);
+				}
+			}
+			for (int i = 0; i < count; i++) {
+				hits[queue[first + i]] = packetHits[i];
+			}
+		}
+	}
+
+	int kept = 0;
+	for (int path : queue) {
+		if (hits[path].t < FLT_MAX) {
+			queue[kept++] = path;
+		}
+	}
+	queue.resize(kept);
 }
 
+/**
+ * @fn	void RayTracer::shadeQueue(std::vector<int> &queue, const std::vector<Ray> &rays, const std::vector<HitRecord> &hits, const std::vector<float> &weights, std::vector<color> &colors, const IScene &theScene) const
+ * @brief	The shading and shadow stages of wavefrontTile, which together do
+ * 			what shadeLocal does for every path in the queue. The queue is
+ * 			sorted by the object hit, so hits on the same shape and material
+ * 			are shaded together. The shadow rays of all hits, toward the lights
+ * 			selectLights picks for each and castsShadowRay lets through, are
+ * 			sorted light by light and tested in one pass; the lights are then
+ * 			added up for each hit in the order getLightColor uses. Area lights
+ * 			decide how many shadow rays to cast from the first ones' results,
+ * 			so they are sampled during the final shading instead.
+ * @param [in,out]	queue   	The paths that hit something; sorted by object.
+ * @param 		  	rays		The current ray of each path.
+ * @param 		  	hits		The closest hit of each path.
+ * @param 		  	weights 	The weight of each path's current bounce.
+ * @param [in,out]	colors  	Each path's color; the shaded hits are added in.
+ * @param 		  	theScene	The scene.
+ */
+
+void RayTracer::shadeQueue(std::vector<int> &queue, const std::vector<Ray> &rays, const std::vector<HitRecord> &hits,
+	const std::vector<float> &weights, std::vector<color> &colors, const IScene &theScene) const {
+	RenderStats &stats = RenderStats::local();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::stable_sort(queue.begin(), queue.end(), [&](int a, int b) {
+		return hits[a].objectId < hits[b].objectId;
+	});
+
+	const int numHits = (int)queue.size();
+	std::vector<HitRecord> transHits;
+	transHits.reserve(numHits);
+	for (int path : queue) {
+		transHits.push_back(VisibleIShape::findIntersection(rays[path], theScene.transparentObjects));
+	}
+	// The lights of hit q are hitLights[firstLight[q]] to hitLights[firstLight[q + 1] - 1].
+	std::vector<int> hitLights, firstLight(numHits + 1), selected;
+	std::vector<color> culledAmbients(numHits);
+	for (int q = 0; q < numHits; q++) {
+		firstLight[q] = (int)hitLights.size();
+		selectLights(hits[queue[q]], theScene, selected, culledAmbients[q]);
+		hitLights.insert(hitLights.end(), selected.begin(), selected.end());
+	}
+	firstLight[numHits] = (int)hitLights.size();
+	// Light i of hitLights gets shadow ray shadowOf[i], or none if -1.
+	std::vector<int> shadowOf(hitLights.size(), -1), shadowLights;
+	int numAreaLights = 0;
+	std::vector<Ray> shadowRays;
+	std::vector<float> shadowDistances;
+	shadowRays.reserve(hitLights.size());
+	shadowDistances.reserve(hitLights.size());
+	for (int q = 0; q < numHits; q++) {
+		const HitRecord &hit = hits[queue[q]];
+		const Material &material = theScene.materials[hit.materialId];
+		for (int i = firstLight[q]; i < firstLight[q + 1]; i++) {
+			const PositionalLight &light = *theScene.lights[hitLights[i]];
+			if (light.asAreaLight() != nullptr) {
+				numAreaLights++;
+				continue;
+			}
+			if (!castsShadowRay(light, hit, material)) continue;
+			shadowOf[i] = (int)shadowRays.size();
+			shadowLights.push_back(hitLights[i]);
+			shadowRays.push_back(Ray(hit.interceptPoint + EPSILON * hit.surfaceNormal, light.lightPosition - hit.interceptPoint));
+			shadowDistances.push_back(glm::distance(hit.interceptPoint, light.lightPosition));
+		}
+	}
+	std::vector<int> shadowOrder(shadowRays.size());
+	for (unsigned int i = 0; i < shadowOrder.size(); i++) {
+		shadowOrder[i] = i;
+	}
+	std::stable_sort(shadowOrder.begin(), shadowOrder.end(), [&](int a, int b) {
+		return shadowLights[a] < shadowLights[b];
+	});
+	stats.shadowRays += shadowRays.size();
+	stats.shadowRaysAvoided += hitLights.size() - numAreaLights - shadowRays.size();
+	stats.shadeStage.batches++;
+	stats.shadeStage.rays += numHits;
+	stats.shadeStage.seconds += secondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	std::vector<char> occluded(shadowRays.size());
+	for (int i : shadowOrder) {
+		occluded[i] = inShadow(shadowRays[i], shadowDistances[i], shadowLights[i], theScene);
+	}
+	if (!shadowRays.empty()) {
+		stats.shadowStage.batches++;
+		stats.shadowStage.rays += shadowRays.size();
+	}
+	stats.shadowStage.seconds += secondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	for (int q = 0; q < numHits; q++) {
+		const int path = queue[q];
+		const HitRecord &hit = hits[path];
+		const Material &material = theScene.materials[hit.materialId];
+		color lightColor = { 0,0,0 };
+		for (int i = firstLight[q]; i < firstLight[q + 1]; i++) {
+			const PositionalLight &light = *theScene.lights[hitLights[i]];
+			if (const AreaLight *area = light.asAreaLight()) {
+				lightColor += areaLightColor(*area, hitLights[i], hit, material, theScene);
+				continue;
+			}
+			lightColor += light.illuminate(hit.interceptPoint, hit.surfaceNormal, material,
+										theScene.camera->cameraFrame, shadowOf[i] < 0 || occluded[shadowOf[i]] != 0);
+		}
+		if (useLightTree) {
+			lightColor += ambientColor(material.ambient, culledAmbients[q]);
+		}
+		colors[path] += combineLocal(hit, transHits[q], lightColor, theScene) * weights[path];
+	}
+	stats.shadeStage.seconds += secondsSince(start);
+}
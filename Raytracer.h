@@ -1,9 +1,12 @@
 #pragma once
 
+#include <atomic>
 #include "Utilities.h"
 #include "FrameBuffer.h"
 #include "Camera.h"
 #include "IScene.h"
+#include "TileScheduler.h"
+#include "RenderStats.h"
 
 /**
  * @struct	RayTracer
@@ -13,11 +16,54 @@
 struct RayTracer {
 	color defaultColor;
 	int antiAliasing=1;
+	int tileSize=16;		//!< Width and height of the tiles handed to worker threads.
+	int numThreads=0;		//!< Number of worker threads; 0 uses all hardware threads.
+	bool usePackets=true;	//!< Trace camera rays in packets of RayPacket::SIZE.
+	bool wavefront=false;	//!< Trace each tile in stages over queues of rays; see wavefrontTile.
+	bool adaptiveAntiAliasing=false;	//!< Supersample only where neighboring pixels differ; overrides antiAliasing.
+	float adaptiveThreshold=0.1f;		//!< Largest color channel difference that is not refined.
+	int adaptiveMaxRate=3;				//!< Most samples per axis per pixel when refining: 3, 9, 27, ...
+	float minThroughput=1.0f/255.0f;	//!< Reflections whose weight falls below this are not traced.
+	bool russianRoulette=false;			//!< Randomly end reflections past rouletteMinDepth.
+	int rouletteMinDepth=2;				//!< Reflections always traced before Russian roulette starts.
+	bool useLightTree=false;			//!< Light each hit only with the lights IScene::lightTree selects.
+	float lightCutoff=1.0f/512.0f;		//!< With useLightTree, lights that can add less than this to a channel add only their ambient term.
+	bool useOccluderCache=true;			//!< Test each shadow ray first against the object that last blocked its light.
+	float shadowCutoff=1.0f/512.0f;		//!< Lights that, unblocked, would add less than this to every channel get no shadow ray and are shaded as blocked.
+	const std::atomic<bool> *cancel=nullptr;	//!< Once *cancel is true, tiles not yet started are skipped.
 	RayTracer(const color &defaultColor);
-	void raytraceScene(FrameBuffer &frameBuffer, int depth,
+	RenderStats raytraceScene(FrameBuffer &frameBuffer, int depth,
 						const IScene &theScene) const;
-	color getLightColor(const Ray & ray, const IScene & theScene, HitRecord & theHit, color  &result)const;
+	RenderStats raytraceBlocks(FrameBuffer &frameBuffer, int blockSize, int depth,
+						const IScene &theScene) const;
+	color getLightColor(const Ray & ray, const IScene & theScene, const HitRecord & theHit, color  &result)const;
 protected:
+	RenderStats runTiles(int width, int height, const std::function<void(const Tile &)> &work) const;
+	void raytraceTile(FrameBuffer &frameBuffer, const Tile &tile, int depth, const IScene &theScene) const;
+	void tileCameraRays(const Tile &tile, const IScene &theScene, std::vector<Ray> &rays) const;
+	void writeTileSamples(FrameBuffer &frameBuffer, const Tile &tile, const std::vector<color> &colors) const;
+	void wavefrontTile(FrameBuffer &frameBuffer, const Tile &tile, int depth, const IScene &theScene) const;
+	void intersectQueue(std::vector<int> &queue, const std::vector<Ray> &rays, std::vector<HitRecord> &hits,
+						const IScene &theScene, StageStats &stage) const;
+	void shadeQueue(std::vector<int> &queue, const std::vector<Ray> &rays, const std::vector<HitRecord> &hits,
+					const std::vector<float> &weights, std::vector<color> &colors, const IScene &theScene) const;
+	void traceTileCenters(const Tile &tile, int depth, const IScene &theScene, int width,
+						std::vector<color> &centers, std::vector<int> &objectIds) const;
+	void refineTile(FrameBuffer &frameBuffer, const Tile &tile, int depth, const IScene &theScene,
+					const std::vector<color> &centers, const std::vector<int> &objectIds) const;
+	color refineSample(float x, float y, float size, int rate, const color &centerColor, int centerId,
+						int depth, const IScene &theScene) const;
+	void traceSamples(const std::vector<Ray> &rays, int depth, const IScene &theScene, color colors[], int objectIds[]) const;
+	color tracePixel(int x, int y, int depth, const IScene &theScene) const;
+	void tracePacket(const Ray *rays, int count, int depth, const IScene &theScene, color colors[]) const;
 	color traceIndividualRay(const Ray &ray, const IScene &theScene, int recursionLevel) const;
+	color shadeHit(const Ray &ray, const HitRecord &theHit, const IScene &theScene, int recursionLevel) const;
+	color shadeLocal(const Ray &ray, const HitRecord &theHit, const IScene &theScene) const;
+	color combineLocal(const HitRecord &theHit, const HitRecord &transHit, const color &lightColor, const IScene &theScene) const;
+	void selectLights(const HitRecord &theHit, const IScene &theScene, std::vector<int> &lights, color &culledAmbient) const;
+	bool castsShadowRay(const PositionalLight &light, const HitRecord &theHit, const Material &material) const;
+	color areaLightColor(const AreaLight &light, int lightIndex, const HitRecord &theHit, const Material &material,
+						const IScene &theScene) const;
+	bool inShadow(const Ray &shadowRay, float distanceToLight, int light, const IScene &theScene) const;
 	
 };
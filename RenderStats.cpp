@@ -0,0 +1,91 @@
+#include "RenderStats.h"
+
+/**
+ * @fn	StageStats &StageStats::operator += (const StageStats &other)
+ * @brief	Adds another set of counts to these.
+ * @param	other	The counts to add.
+ * @return	These counts.
+ */
+
+StageStats &StageStats::operator += (const StageStats &other) {
+	batches += other.batches;
+	rays += other.rays;
+	lanes += other.lanes;
+	seconds += other.seconds;
+	return *this;
+}
+
+/**
+ * @fn	StageStats StageStats::operator - (const StageStats &other) const
+ * @brief	The work done between an earlier snapshot and these counts.
+ * @param	other	The earlier snapshot.
+ * @return	The difference.
+ */
+
+StageStats StageStats::operator - (const StageStats &other) const {
+	StageStats result;
+	result.batches = batches - other.batches;
+	result.rays = rays - other.rays;
+	result.lanes = lanes - other.lanes;
+	result.seconds = seconds - other.seconds;
+	return result;
+}
+
+/**
+ * @fn	RenderStats &RenderStats::operator += (const RenderStats &other)
+ * @brief	Adds another set of counts to these.
+ * @param	other	The counts to add.
+ * @return	These counts.
+ */
+
+RenderStats &RenderStats::operator += (const RenderStats &other) {
+	primaryRays += other.primaryRays;
+	shadowRays += other.shadowRays;
+	shadowRaysAvoided += other.shadowRaysAvoided;
+	areaLightRefinements += other.areaLightRefinements;
+	reflectionRays += other.reflectionRays;
+	intersectionTests += other.intersectionTests;
+	occluderCacheTests += other.occluderCacheTests;
+	occluderCacheHits += other.occluderCacheHits;
+	primaryStage += other.primaryStage;
+	shadeStage += other.shadeStage;
+	shadowStage += other.shadowStage;
+	reflectionStage += other.reflectionStage;
+	return *this;
+}
+
+/**
+ * @fn	RenderStats RenderStats::operator - (const RenderStats &other) const
+ * @brief	The work done between an earlier snapshot and these counts.
+ * @param	other	The earlier snapshot.
+ * @return	The difference.
+ */
+
+RenderStats RenderStats::operator - (const RenderStats &other) const {
+	RenderStats result;
+	result.primaryRays = primaryRays - other.primaryRays;
+	result.shadowRays = shadowRays - other.shadowRays;
+	result.shadowRaysAvoided = shadowRaysAvoided - other.shadowRaysAvoided;
+	result.areaLightRefinements = areaLightRefinements - other.areaLightRefinements;
+	result.reflectionRays = reflectionRays - other.reflectionRays;
+	result.intersectionTests = intersectionTests - other.intersectionTests;
+	result.occluderCacheTests = occluderCacheTests - other.occluderCacheTests;
+	result.occluderCacheHits = occluderCacheHits - other.occluderCacheHits;
+	result.primaryStage = primaryStage - other.primaryStage;
+	result.shadeStage = shadeStage - other.shadeStage;
+	result.shadowStage = shadowStage - other.shadowStage;
+	result.reflectionStage = reflectionStage - other.reflectionStage;
+	return result;
+}
+
+/**
+ * @fn	RenderStats &RenderStats::local()
+ * @brief	The calling thread's counters. They only ever grow; take a snapshot
+ * 			before some work and subtract it afterwards.
+ * @return	The counters of the calling thread.
+ */
+
+RenderStats &RenderStats::local() {
+	thread_local RenderStats stats;
+	return stats;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+/**
+ * @struct	StageStats
+ * @brief	Counts for one stage of the wavefront pipeline (see
+ * 			RayTracer::wavefront). Each stage takes a queue of rays and
+ * 			processes all of it before the next stage starts.
+ */
+
+struct StageStats {
+	long long batches = 0;		//!< queues processed
+	long long rays = 0;			//!< rays taken from the queues, over all batches
+	long long lanes = 0;		//!< packet lanes issued for them; 0 if not traced in packets
+	double seconds = 0.0;		//!< time spent in the stage, summed over threads
+
+	double meanQueueSize() const { return batches > 0 ? (double)rays / batches : 0.0; }
+	double occupancy() const { return lanes > 0 ? (double)rays / lanes : 0.0; }
+	StageStats &operator += (const StageStats &other);
+	StageStats operator - (const StageStats &other) const;
+};
+
+/**
+ * @struct	RenderStats
+ * @brief	Counts the work done while rendering. Every thread counts into its
+ * 			own copy, returned by local(), so counting needs no locking; the
+ * 			ray tracer adds the per thread counts up at the end of each tile.
+ */
+
+struct RenderStats {
+	long long primaryRays = 0;			//!< camera rays
+	long long shadowRays = 0;			//!< rays cast toward a light
+	long long shadowRaysAvoided = 0;	//!< lights shaded without a shadow ray, their contribution known beforehand
+	long long areaLightRefinements = 0;	//!< area lights whose first samples disagreed, so all strata were sampled
+	long long reflectionRays = 0;		//!< rays spawned by reflections
+	long long intersectionTests = 0;	//!< ray-object tests, SIMD lanes included
+	long long occluderCacheTests = 0;	//!< shadow rays first tested against their light's last occluder
+	long long occluderCacheHits = 0;	//!< of those, the ones it blocked
+	StageStats primaryStage;			//!< wavefront: camera rays, generated and intersected
+	StageStats shadeStage;				//!< wavefront: hits shaded, shadow rays queued
+	StageStats shadowStage;				//!< wavefront: shadow rays tested
+	StageStats reflectionStage;			//!< wavefront: reflection rays, generated and intersected
+
+	long long totalRays() const { return primaryRays + shadowRays + reflectionRays; }
+	double occluderCacheHitRate() const { return occluderCacheTests > 0 ? (double)occluderCacheHits / occluderCacheTests : 0.0; }
+	RenderStats &operator += (const RenderStats &other);
+	RenderStats operator - (const RenderStats &other) const;
+	static RenderStats &local();
+};
@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <typeinfo>
+#include "ShapeArrays.h"
+
+/**
+ * @fn	ShapeKind ShapeArrays::kindOf(const IShape *shape)
+ * @brief	Which array a shape goes in. Only the exact types listed in
+ * 			ShapeKind are compiled; a subclass may override any of their
+ * 			routines, so it is left to IShape.
+ * @param	shape	The shape.
+ * @return	The kind of the shape.
+ */
+
+ShapeKind ShapeArrays::kindOf(const IShape *shape) {
+	const std::type_info &type = typeid(*shape);
+	if (type == typeid(ISphere) || type == typeid(IEllipsoid) || type == typeid(IQuadricSurface) ||
+		type == typeid(ICylinderX) || type == typeid(ICylinderY) || type == typeid(IConeY)) {
+		return SHAPE_QUADRIC;
+	}
+	if (type == typeid(ITriangle)) return SHAPE_TRIANGLE;
+	if (type == typeid(IPlane)) return SHAPE_PLANE;
+	return SHAPE_OTHER;
+}
+
+/**
+ * @fn	void ShapeArrays::build(const std::vector<VisibleIShapePtr> &visibleObjects, const std::vector<int> &order)
+ * @brief	Compiles some of the visible objects. The entries are made in the
+ * 			given order, so the caller decides which entries are adjacent.
+ * @param	visibleObjects	All the visible objects.
+ * @param	order		  	Indices of the objects to compile, in entry order.
+ */
+
+void ShapeArrays::build(const std::vector<VisibleIShapePtr> &visibleObjects, const std::vector<int> &order) {
+	*this = ShapeArrays();
+	const int N = (int)order.size();
+	int numTriangles = 0, numPlanes = 0;
+	for (int entry = 0; entry < N; entry++) {
+		const IShape *shape = visibleObjects[order[entry]]->shape;
+		ShapeKind kind = kindOf(shape);
+		objects.push_back(order[entry]);
+		kinds.push_back((unsigned char)kind);
+		if (kind == SHAPE_QUADRIC) {
+			items.push_back(entry);
+		} else if (kind == SHAPE_TRIANGLE) {
+			items.push_back(numTriangles++);
+		} else if (kind == SHAPE_PLANE) {
+			items.push_back(numPlanes++);
+		} else {
+			items.push_back((int)others.size());
+			others.push_back(shape);
+		}
+	}
+
+	quadrics.resize(N);
+	ranges.resize(N);
+	planePoints.resize(numPlanes);
+	planeNormals.resize(numPlanes);
+	std::vector<glm::vec3> *triangleArrays[] = { &triA, &triB, &triC, &triAB, &triBC, &triCA,
+												&triNormals, &triPlanePoints, &triPlaneNormals };
+	for (std::vector<glm::vec3> *a : triangleArrays) {
+		a->resize(numTriangles);
+	}
+	triNormalLength2.resize(numTriangles);
+	for (int entry = 0; entry < N; entry++) {
+		update(entry, visibleObjects[order[entry]]->shape);
+	}
+}
+
+/**
+ * @fn	void ShapeArrays::update(int entry, const IShape *shape)
+ * @brief	Compiles one entry's shape again, after it moved or changed size.
+ * 			The shape must be the entry's object, so its kind is the same.
+ * @param	entry	The entry.
+ * @param	shape	The entry's shape.
+ */
+
+void ShapeArrays::update(int entry, const IShape *shape) {
+	const int item = items[entry];
+	switch (kinds[entry]) {
+	case SHAPE_QUADRIC: {
+		const IQuadricSurface *quadric = shape->asQuadric();
+		quadrics.set(entry, quadric->getParameters(), quadric->center);
+		QuadricRange &range = ranges[entry];
+		range = QuadricRange();
+		if (const ICylinderY *cylinder = dynamic_cast<const ICylinderY *>(shape)) {
+			range.axis = 1;
+			range.low = cylinder->center.y - cylinder->length / 2;
+			range.high = cylinder->center.y + cylinder->length / 2;
+		} else if (const ICylinderX *cylinder = dynamic_cast<const ICylinderX *>(shape)) {
+			range.axis = 0;
+			range.inclusive = true;
+			range.low = cylinder->center.x - cylinder->length / 2;
+			range.high = cylinder->center.x + cylinder->length / 2;
+		} else if (const IConeY *cone = dynamic_cast<const IConeY *>(shape)) {
+			range.axis = 1;
+			range.low = cone->center.y - cone->length / 2;
+			range.high = cone->center.y;
+		}
+		break;
+	}
+	case SHAPE_TRIANGLE: {
+		const ITriangle *triangle = static_cast<const ITriangle *>(shape);
+		const glm::vec3 &a = triangle->a, &b = triangle->b, &c = triangle->c;
+		glm::vec3 n = glm::cross(b - a, c - a);
+		triA[item] = a;
+		triB[item] = b;
+		triC[item] = c;
+		triAB[item] = b - a;
+		triBC[item] = c - b;
+		triCA[item] = a - c;
+		triNormals[item] = n;
+		triNormalLength2[item] = std::pow(glm::length(n), 2.0f);
+		triPlanePoints[item] = triangle->plane.a;
+		triPlaneNormals[item] = triangle->plane.n;
+		break;
+	}
+	case SHAPE_PLANE: {
+		const IPlane *plane = static_cast<const IPlane *>(shape);
+		planePoints[item] = plane->a;
+		planeNormals[item] = plane->n;
+		break;
+	}
+	default:
+		others[item] = shape;
+		break;
+	}
+}
+
+/**
+ * @fn	void ShapeArrays::intersect(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const
+ * @brief	Intersects a range of entries and keeps the closest hit. The range
+ * 			is split into runs of one kind, and each run is handed to the loop
+ * 			for its kind; entries sorted by kind make one run per kind. Ties go
+ * 			to the lower object index, whatever the order of the entries.
+ * @param 		  	first   	First entry.
+ * @param 		  	count   	Number of entries.
+ * @param 		  	ray			The ray.
+ * @param [in,out]	closestT	t of the closest hit so far.
+ * @param [in,out]	hitIndex	Object index of the closest hit so far.
+ */
+
+void ShapeArrays::intersect(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const {
+	const int end = first + count;
+	for (int runStart = first; runStart < end; ) {
+		int runEnd = runStart + 1;
+		while (runEnd < end && kinds[runEnd] == kinds[runStart]) {
+			runEnd++;
+		}
+		switch (kinds[runStart]) {
+		case SHAPE_QUADRIC:	intersectQuadrics(runStart, runEnd - runStart, ray, closestT, hitIndex); break;
+		case SHAPE_TRIANGLE:	intersectTriangles(runStart, runEnd - runStart, ray, closestT, hitIndex); break;
+		case SHAPE_PLANE:	intersectPlanes(runStart, runEnd - runStart, ray, closestT, hitIndex); break;
+		default:			intersectOthers(runStart, runEnd - runStart, ray, closestT, hitIndex); break;
+		}
+		runStart = runEnd;
+	}
+}
+
+/**
+ * @fn	void ShapeArrays::intersectQuadrics(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const
+ * @brief	Intersects a run of quadrics. The roots are found 8 at a time by the
+ * 			SIMD kernel; each quadric's range then picks the visible root.
+ */
+
+void ShapeArrays::intersectQuadrics(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const {
+	for (int block = first; block < first + count; block += 8) {
+		int n = std::min(8, first + count - block);
+		QuadricHits hits;
+		::intersectQuadrics(quadrics, block, n, ray.origin, ray.direction, hits);
+		for (int lane = 0; lane < n; lane++) {
+			if (((hits.hitMask >> lane) & 1) == 0) continue;
+			const QuadricRange &range = ranges[block + lane];
+			const float roots[2] = { hits.t0[lane], hits.t1[lane] };
+			const int numRoots = hits.numRoots(lane);
+			for (int r = 0; r < numRoots; r++) {
+				if (range.contains(ray, roots[r])) {
+					int index = objects[block + lane];
+					if (roots[r] < closestT || (roots[r] == closestT && index < hitIndex)) {
+						closestT = roots[r];
+						hitIndex = index;
+					}
+					break;
+				}
+			}
+		}
+	}
+}
+
+/**
+ * @fn	void ShapeArrays::intersectTriangles(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const
+ * @brief	Intersects a run of triangles.
+ */
+
+void ShapeArrays::intersectTriangles(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const {
+	for (int entry = first; entry < first + count; entry++) {
+		float t = triangleT(items[entry], ray);
+		int index = objects[entry];
+		if (t > 0 && (t < closestT || (t == closestT && index < hitIndex))) {
+			closestT = t;
+			hitIndex = index;
+		}
+	}
+}
+
+/**
+ * @fn	void ShapeArrays::intersectPlanes(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const
+ * @brief	Intersects a run of planes.
+ */
+
+void ShapeArrays::intersectPlanes(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const {
+	for (int entry = first; entry < first + count; entry++) {
+		float t = planeT(items[entry], ray);
+		int index = objects[entry];
+		if (t > 0 && (t < closestT || (t == closestT && index < hitIndex))) {
+			closestT = t;
+			hitIndex = index;
+		}
+	}
+}
+
+/**
+ * @fn	void ShapeArrays::intersectOthers(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const
+ * @brief	Intersects a run of shapes without an array of their own, through
+ * 			IShape::findClosestT.
+ */
+
+void ShapeArrays::intersectOthers(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const {
+	for (int entry = first; entry < first + count; entry++) {
+		float t = others[items[entry]]->findClosestT(ray);
+		int index = objects[entry];
+		if (t > 0 && (t < closestT || (t == closestT && index < hitIndex))) {
+			closestT = t;
+			hitIndex = index;
+		}
+	}
+}
+
+/**
+ * @fn	float ShapeArrays::planeT(int item, const Ray &ray) const
+ * @brief	IPlane::findClosestIntersection, reduced to t.
+ * @param	item	Index of the plane.
+ * @param	ray 	The ray.
+ * @return	The t value, or FLT_MAX if the ray misses or starts past the plane.
+ */
+
+float ShapeArrays::planeT(int item, const Ray &ray) const {
+	const glm::vec3 &n = planeNormals[item];
+	float denom = glm::dot(ray.direction, n);
+	if (denom == 0) return FLT_MAX;
+	float t = glm::dot(planePoints[item] - ray.origin, n) / denom;
+	return t < 0 ? FLT_MAX : t;
+}
+
+/**
+ * @fn	float ShapeArrays::triangleT(int item, const Ray &ray) const
+ * @brief	ITriangle::findClosestIntersection, reduced to t, with the normal,
+ * 			edges and squared area that ITriangle::inside recomputes for every
+ * 			ray taken from the arrays.
+ * @param	item	Index of the triangle.
+ * @param	ray 	The ray.
+ * @return	The t value, or FLT_MAX if the ray misses.
+ */
+
+float ShapeArrays::triangleT(int item, const Ray &ray) const {
+	const glm::vec3 &planeNormal = triPlaneNormals[item];
+	float denom = glm::dot(ray.direction, planeNormal);
+	if (denom == 0) return FLT_MAX;
+	float t = glm::dot(triPlanePoints[item] - ray.origin, planeNormal) / denom;
+	if (t < 0) return FLT_MAX;
+
+	glm::vec3 pt = ray.getPoint(t);
+	const glm::vec3 &n = triNormals[item];
+	const float n2 = triNormalLength2[item];
+	float alpha = glm::dot(n, glm::cross(triBC[item], pt - triB[item])) / n2;
+	float beta = glm::dot(n, glm::cross(triCA[item], pt - triC[item])) / n2;
+	float gamma = glm::dot(n, glm::cross(triAB[item], pt - triA[item])) / n2;
+	bool inside = inRangeExclusive(beta, 0, 1) && inRangeExclusive(gamma, 0, 1) && inRangeExclusive(alpha, 0, 1);
+	return inside ? t : FLT_MAX;
+}
+
+/**
+ * @fn	bool ShapeArrays::occludes(int entry, const Ray &ray, float tMax) const
+ * @brief	Determines if one entry blocks a shadow ray somewhere in (0, tMax),
+ * 			as IShape::occludes does for its shape.
+ * @param	entry	The entry.
+ * @param	ray  	The ray.
+ * @param	tMax 	Intersections at or beyond tMax do not count.
+ * @return	true iff the entry's shape blocks the ray.
+ */
+
+bool ShapeArrays::occludes(int entry, const Ray &ray, float tMax) const {
+	switch (kinds[entry]) {
+	case SHAPE_QUADRIC: {
+		QuadricHits hits;
+		::intersectQuadrics(quadrics, entry, 1, ray.origin, ray.direction, hits);
+		const float roots[2] = { hits.t0[0], hits.t1[0] };
+		for (int r = 0; r < hits.numRoots(0) && roots[r] < tMax; r++) {
+			if (ranges[entry].contains(ray, roots[r])) {
+				return true;
+			}
+		}
+		return false;
+	}
+	case SHAPE_TRIANGLE: {
+		float t = triangleT(items[entry], ray);
+		return t > 0 && t < tMax;
+	}
+	case SHAPE_PLANE: {
+		float t = planeT(items[entry], ray);
+		return t > 0 && t < tMax;
+	}
+	default:
+		return others[items[entry]]->occludes(ray, tMax);
+	}
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <vector>
+#include "IShape.h"
+#include "QuadricKernel.h"
+
+/**
+ * @enum	ShapeKind
+ * @brief	The shape types that ShapeArrays stores in arrays of their own. The
+ * 			order is the order in which they are tested.
+ */
+
+enum ShapeKind {
+	SHAPE_QUADRIC,		//!< ISphere, IEllipsoid, ICylinderX, ICylinderY, IConeY, IQuadricSurface
+	SHAPE_TRIANGLE,		//!< ITriangle
+	SHAPE_PLANE,		//!< IPlane
+	SHAPE_OTHER			//!< anything else, tested through IShape
+};
+
+/**
+ * @struct	QuadricRange
+ * @brief	The part of a quadric that belongs to a finite shape: the roots whose
+ * 			point lies between low and high along one axis. This is what the
+ * 			finite cylinders and cones do in their selectRoot overrides.
+ */
+
+struct QuadricRange {
+	int axis = -1;				//!< 0, 1 or 2 for x, y or z; -1 if every root counts
+	bool inclusive = false;		//!< true if low and high themselves are in range
+	float low = 0.0f;			//!< lower end of the range
+	float high = 0.0f;			//!< upper end of the range
+
+	bool contains(const Ray &ray, float t) const {
+		if (axis < 0) return true;
+		float x = ray.origin[axis] + t * ray.direction[axis];
+		return inclusive ? (x <= high && x >= low) : (x < high && x > low);
+	}
+};
+
+/**
+ * @struct	ShapeArrays
+ * @brief	A list of visible objects compiled into one contiguous array per
+ * 			shape type, so that each type is tested in a loop of its own with no
+ * 			virtual calls. The IShape classes remain the way scenes are built;
+ * 			IScene compiles them into ShapeArrays in buildBVH. Each entry keeps
+ * 			the index of its object, and hits are reported by object index.
+ * 			Every test does the same arithmetic as the IShape it replaces, so
+ * 			the results are identical.
+ */
+
+struct ShapeArrays {
+	std::vector<int> objects;			//!< object index of each entry
+	std::vector<unsigned char> kinds;	//!< ShapeKind of each entry
+	std::vector<int> items;				//!< index of each entry in the arrays of its kind
+
+	QuadricSoA quadrics;				//!< by entry, so runs of entries are SIMD blocks; zero for other kinds
+	std::vector<QuadricRange> ranges;	//!< by entry
+
+	std::vector<glm::vec3> planePoints;		//!< point on each plane
+	std::vector<glm::vec3> planeNormals;	//!< normal of each plane
+
+	std::vector<glm::vec3> triA, triB, triC;	//!< triangle vertices
+	std::vector<glm::vec3> triAB, triBC, triCA;	//!< triangle edges b-a, c-b and a-c
+	std::vector<glm::vec3> triNormals;			//!< cross(b-a, c-a), unnormalized
+	std::vector<float> triNormalLength2;		//!< squared length of triNormals
+	std::vector<glm::vec3> triPlanePoints;		//!< point on the triangle's plane
+	std::vector<glm::vec3> triPlaneNormals;		//!< unit normal of the triangle's plane
+
+	std::vector<const IShape *> others;		//!< shapes of every other type
+
+	void build(const std::vector<VisibleIShapePtr> &visibleObjects, const std::vector<int> &order);
+	void update(int entry, const IShape *shape);
+	int size() const { return (int)objects.size(); }
+	void intersect(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const;
+	bool occludes(int entry, const Ray &ray, float tMax) const;
+	static ShapeKind kindOf(const IShape *shape);
+protected:
+	void intersectQuadrics(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const;
+	void intersectTriangles(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const;
+	void intersectPlanes(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const;
+	void intersectOthers(int first, int count, const Ray &ray, float &closestT, int &hitIndex) const;
+	float triangleT(int item, const Ray &ray) const;
+	float planeT(int item, const Ray &ray) const;
+};
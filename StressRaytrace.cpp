@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Defs.h"
+#include "IShape.h"
+#include "IScene.h"
+#include "Light.h"
+#include "Image.h"
+#include "Camera.h"
+#include "RayPacket.h"
+#include "TileScheduler.h"
+
+/*
+ * Stress test for the read-only queries on a built scene. Builds the scene of
+ * ProjectRaytrace.cpp, traces a reference set of camera and shadow rays on one
+ * thread, then has a number of threads repeat the same queries on the same
+ * scene at the same time and compares every answer to the reference. Exits
+ * with 1 if any thread gets a different answer. Usage:
+ *
+ *   StressRaytrace [-threads n] [-iterations n] [-w width] [-h height]
+ *
+ * The queries are IScene::findClosestIntersection, findClosestIntersections
+ * (packets), and isOccluded with and without a last occluder (which is kept
+ * per thread, as RayTracer::inShadow does). To check it with ThreadSanitizer
+ * on Linux, build it with the library sources, i.e., every .cpp but the other
+ * mains, and run it:
+ *
+ *   g++ -std=c++17 -g -O1 -fsanitize=thread -pthread -I<glm> -o StressRaytrace \
+ *       StressRaytrace.cpp $(ls *.cpp | grep -v -e Raytrace -e Exercise -e FrameExamples -e main.cpp) \
+ *       -lglut -lGLU -lGL
+ *   TSAN_OPTIONS="halt_on_error=1 exitcode=66" ./StressRaytrace -threads 8
+ *
+ * With those options the first race ThreadSanitizer reports stops the run
+ * with exit code 66.
+ */
+
+struct StressOptions {
+	int width = WINDOW_WIDTH / 4;
+	int height = WINDOW_HEIGHT / 4;
+	int numThreads = 0;
+	int iterations = 20;
+};
+
+/**
+ * @struct	QueryResults
+ * @brief	The answers to all the queries, in order. Two runs agree iff these
+ * 			are the same.
+ */
+
+struct QueryResults {
+	std::vector<HitRecord> hits;			//!< findClosestIntersection, one per camera ray
+	std::vector<HitRecord> packetHits;		//!< findClosestIntersections, one per camera ray
+	std::vector<bool> occluded;				//!< isOccluded, one per shadow ray
+	std::vector<bool> occludedCached;		//!< isOccluded with the last occluder, one per shadow ray
+};
+
+Image im("usflag.ppm");
+
+std::vector<PositionalLightPtr> lights = {
+						new PositionalLight(glm::vec3(3, 30, 10), pureWhiteLight),
+						new SpotLight(glm::vec3(2, 30, 4), glm::vec3(0,-1,0), glm::radians(45.0f), pureWhiteLight)
+};
+
+PerspectiveCamera pCamera(glm::vec3(0, 10, 10), ORIGIN3D, Y_AXIS, M_PI_2);
+IScene scene(&pCamera, false);
+
+IShape *plane = new IPlane(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+IPlane *plane2 = new IPlane(glm::vec3(0.0f, -2.0f, -4.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+ISphere *sphere = new ISphere(glm::vec3(-6.0f, 3.0f, 0.0f), 6.0f);
+IEllipsoid *ellipsoid = new IEllipsoid(glm::vec3(-3.0f, 2.0f, 11.0f), glm::vec3(4.0f, 4.0f, 3.0f));
+ICylinderX *cylinderX = new ICylinderX(glm::vec3(16.0f, 2.0f, 8.0f), 2.0f, 8.0f);
+ICloseCylinderY *closedCylinderY = new ICloseCylinderY(glm::vec3(10.0f, 6.0f, 0.0f), 4.0f, 12.0f);
+IConeY *coneY = new IConeY(glm::vec3(20.0f, 6.0f, 0.0f), 1.0f, 8.0f);
+
+void buildScene() {
+	scene.addObject(new VisibleIShape(plane, tin));
+	scene.addObject(new VisibleIShape(sphere, polishedSilver));
+	scene.addObject(new VisibleIShape(ellipsoid, redPlastic));
+	scene.addObject(new VisibleIShape(cylinderX, cyanRubber));
+	scene.addObject(new VisibleIShape(coneY, gold));
+
+	scene.addTransparentObject(new VisibleIShape(plane2, red), 0.4f);
+
+	VisibleIShapePtr p;
+	p = new VisibleIShape(closedCylinderY, gold);
+	p->setTexture(&im);
+	scene.addObject(p);
+
+	scene.addObject(lights[0]);
+	scene.addObject(lights[1]);
+
+	scene.buildBVH();
+}
+
+/**
+ * @fn	void makeRays(int width, int height, std::vector<Ray> &cameraRays, std::vector<Ray> &shadowRays, std::vector<float> &shadowDistances, std::vector<int> &shadowLights)
+ * @brief	Makes the rays to query: one camera ray per pixel, and a ray toward
+ * 			each light from every point those rays hit. The shadow rays are
+ * 			made from a single threaded trace, so every thread asks the same.
+ * @param 		  	width		   	Width of the image, in pixels.
+ * @param 		  	height		   	Height of the image, in pixels.
+ * @param [in,out]	cameraRays	   	Receives the camera rays.
+ * @param [in,out]	shadowRays	   	Receives the shadow rays.
+ * @param [in,out]	shadowDistances	Receives the distance to the light of each shadow ray.
+ * @param [in,out]	shadowLights   	Receives the index of the light of each shadow ray.
+ */
+
+void makeRays(int width, int height, std::vector<Ray> &cameraRays,
+				std::vector<Ray> &shadowRays, std::vector<float> &shadowDistances, std::vector<int> &shadowLights) {
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			cameraRays.push_back(pCamera.getRay((float)x, (float)y));
+		}
+	}
+	for (const Ray &ray : cameraRays) {
+		HitRecord hit = scene.findClosestIntersection(ray);
+		if (hit.t == FLT_MAX) continue;
+		glm::vec3 origin = hit.interceptPoint + EPSILON * hit.surfaceNormal;
+		for (unsigned int light = 0; light < scene.lights.size(); light++) {
+			glm::vec3 toLight = scene.lights[light]->lightPosition - origin;
+			shadowRays.push_back(Ray(origin, toLight));
+			shadowDistances.push_back(glm::length(toLight));
+			shadowLights.push_back(light);
+		}
+	}
+}
+
+/**
+ * @fn	void runQueries(const std::vector<Ray> &cameraRays, const std::vector<Ray> &shadowRays, const std::vector<float> &shadowDistances, const std::vector<int> &shadowLights, QueryResults &results)
+ * @brief	Asks the scene every query once, in order.
+ * @param 		  	cameraRays	   	The camera rays.
+ * @param 		  	shadowRays	   	The shadow rays.
+ * @param 		  	shadowDistances	Distance to the light of each shadow ray.
+ * @param 		  	shadowLights   	Index of the light of each shadow ray.
+ * @param [in,out]	results		   	Receives the answers.
+ */
+
+void runQueries(const std::vector<Ray> &cameraRays, const std::vector<Ray> &shadowRays,
+				const std::vector<float> &shadowDistances, const std::vector<int> &shadowLights, QueryResults &results) {
+	const int numRays = (int)cameraRays.size();
+	results.hits.resize(numRays);
+	results.packetHits.resize(numRays);
+	for (int i = 0; i < numRays; i++) {
+		results.hits[i] = scene.findClosestIntersection(cameraRays[i]);
+	}
+	for (int first = 0; first < numRays; first += RayPacket::SIZE) {
+		int count = numRays - first < RayPacket::SIZE ? numRays - first : RayPacket::SIZE;
+		scene.findClosestIntersections(&cameraRays[first], count, &results.packetHits[first]);
+	}
+
+	const int numShadowRays = (int)shadowRays.size();
+	results.occluded.resize(numShadowRays);
+	results.occludedCached.resize(numShadowRays);
+	std::vector<int> lastOccluders(scene.lights.size(), -1);
+	for (int i = 0; i < numShadowRays; i++) {
+		results.occluded[i] = scene.isOccluded(shadowRays[i], shadowDistances[i]);
+		results.occludedCached[i] = scene.isOccluded(shadowRays[i], shadowDistances[i], lastOccluders[shadowLights[i]]);
+	}
+}
+
+/**
+ * @fn	bool sameHit(const HitRecord &a, const HitRecord &b)
+ * @brief	Tells whether two hits are exactly the same. The scene is not
+ * 			changed while the threads run, so there is no tolerance. (u,v)
+ * 			are only compared on textured hits, the only ones that have them.
+ * @param	a	A hit.
+ * @param	b	Another hit.
+ * @return	True iff every field the hit fills in is bit for bit the same.
+ */
+
+bool sameHit(const HitRecord &a, const HitRecord &b) {
+	if (a.t == FLT_MAX || b.t == FLT_MAX) {
+		return a.t == b.t;
+	}
+	return std::memcmp(&a.t, &b.t, sizeof(float)) == 0 &&
+			std::memcmp(&a.interceptPoint, &b.interceptPoint, sizeof(glm::vec3)) == 0 &&
+			std::memcmp(&a.surfaceNormal, &b.surfaceNormal, sizeof(glm::vec3)) == 0 &&
+			a.materialId == b.materialId && a.textureId == b.textureId && a.objectId == b.objectId &&
+			(a.textureId < 0 ||
+			 (std::memcmp(&a.u, &b.u, sizeof(float)) == 0 && std::memcmp(&a.v, &b.v, sizeof(float)) == 0));
+}
+
+/**
+ * @fn	int countMismatches(const QueryResults &reference, const QueryResults &results)
+ * @brief	Counts the answers that differ from the reference.
+ * @param	reference	The single threaded answers.
+ * @param	results  	The answers of one thread.
+ * @return	The number of differences.
+ */
+
+int countMismatches(const QueryResults &reference, const QueryResults &results) {
+	int mismatches = 0;
+	for (unsigned int i = 0; i < reference.hits.size(); i++) {
+		if (!sameHit(reference.hits[i], results.hits[i])) mismatches++;
+		if (!sameHit(reference.packetHits[i], results.packetHits[i])) mismatches++;
+	}
+	for (unsigned int i = 0; i < reference.occluded.size(); i++) {
+		if (reference.occluded[i] != results.occluded[i]) mismatches++;
+		if (reference.occludedCached[i] != results.occludedCached[i]) mismatches++;
+	}
+	return mismatches;
+}
+
+/**
+ * @fn	bool parseOptions(int argc, char *argv[], StressOptions &options)
+ * @brief	Parses the command line.
+ * @param 		  	argc   	Number of arguments.
+ * @param 		  	argv   	The arguments.
+ * @param [in,out]	options	Receives the options given on the command line.
+ * @return	True iff the command line was valid.
+ */
+
+bool parseOptions(int argc, char *argv[], StressOptions &options) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (i + 1 < argc && (arg == "-threads" || arg == "-iterations" || arg == "-w" || arg == "-h")) {
+			int value = std::atoi(argv[++i]);
+			if (arg == "-threads") options.numThreads = value;
+			else if (arg == "-iterations") options.iterations = value;
+			else if (arg == "-w") options.width = value;
+			else options.height = value;
+		} else {
+			return false;
+		}
+	}
+	return options.width > 0 && options.height > 0 && options.iterations > 0;
+}
+
+int main(int argc, char *argv[]) {
+	StressOptions options;
+	if (!parseOptions(argc, argv, options)) {
+		std::cerr << "Usage: " << argv[0] << " [-threads n] [-iterations n] [-w width] [-h height]" << std::endl;
+		return 1;
+	}
+	int numThreads = options.numThreads > 0 ? options.numThreads : std::max(2, TileScheduler::defaultThreadCount());
+
+	buildScene();
+	pCamera.calculateViewingParameters(options.width / 2, options.height);
+	pCamera.changeConfiguration(glm::vec3(12, 20, 18), ORIGIN3D, Y_AXIS);
+
+	std::vector<Ray> cameraRays, shadowRays;
+	std::vector<float> shadowDistances;
+	std::vector<int> shadowLights;
+	makeRays(options.width, options.height, cameraRays, shadowRays, shadowDistances, shadowLights);
+
+	QueryResults reference;
+	runQueries(cameraRays, shadowRays, shadowDistances, shadowLights, reference);
+
+	std::vector<int> mismatches(numThreads, 0);
+	std::atomic<int> ready(0);
+	auto worker = [&](int w) {
+		ready++;
+		while (ready.load() < numThreads) {
+			std::this_thread::yield();		// start together, so the queries overlap
+		}
+		for (int iteration = 0; iteration < options.iterations; iteration++) {
+			QueryResults results;
+			runQueries(cameraRays, shadowRays, shadowDistances, shadowLights, results);
+			mismatches[w] += countMismatches(reference, results);
+		}
+	};
+	std::vector<std::thread> threads;
+	for (int w = 0; w < numThreads; w++) {
+		threads.push_back(std::thread(worker, w));
+	}
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	int totalMismatches = 0;
+	for (int w = 0; w < numThreads; w++) {
+		if (mismatches[w] > 0) {
+			std::printf("Thread %d: %d answers differ from the single threaded ones\n", w, mismatches[w]);
+		}
+		totalMismatches += mismatches[w];
+	}
+	std::printf("%d threads x %d iterations, %d camera rays, %d shadow rays: %s\n",
+				numThreads, options.iterations, (int)cameraRays.size(), (int)shadowRays.size(),
+				totalMismatches == 0 ? "all answers agree" : "MISMATCH");
+	return totalMismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include <cstdint>
+#include "TileScheduler.h"
+
+/**
+ * @struct	TileRun
+ * @brief	A worker's run of tile indices. Head and tail are packed into one
+ * 			64 bit word so that the owner (popping the head) and thieves
+ * 			(popping the tail) can both claim a tile with a single CAS.
+ */
+
+struct TileRun {
+	std::atomic<uint64_t> headTail;
+
+	static uint64_t pack(uint32_t head, uint32_t tail) {
+		return ((uint64_t)tail << 32) | head;
+	}
+
+	/**
+	 * @fn	bool popFront(int &index)
+	 * @brief	Claims the next tile from the front of the run (owner side).
+	 * @param [in,out]	index	The claimed tile index.
+	 * @return	true iff a tile was claimed.
+	 */
+
+	bool popFront(int &index) {
+		uint64_t cur = headTail.load(std::memory_order_relaxed);
+		for (;;) {
+			uint32_t head = (uint32_t)cur;
+			uint32_t tail = (uint32_t)(cur >> 32);
+			if (head >= tail) return false;
+			if (headTail.compare_exchange_weak(cur, pack(head + 1, tail), std::memory_order_acq_rel)) {
+				index = (int)head;
+				return true;
+			}
+		}
+	}
+
+	/**
+	 * @fn	bool popBack(int &index)
+	 * @brief	Steals the last tile of the run (thief side).
+	 * @param [in,out]	index	The stolen tile index.
+	 * @return	true iff a tile was stolen.
+	 */
+
+	bool popBack(int &index) {
+		uint64_t cur = headTail.load(std::memory_order_relaxed);
+		for (;;) {
+			uint32_t head = (uint32_t)cur;
+			uint32_t tail = (uint32_t)(cur >> 32);
+			if (head >= tail) return false;
+			if (headTail.compare_exchange_weak(cur, pack(head, tail - 1), std::memory_order_acq_rel)) {
+				index = (int)(tail - 1);
+				return true;
+			}
+		}
+	}
+};
+
+/**
+ * @fn	TileScheduler::TileScheduler(int width, int height, int tileSize)
+ * @brief	Splits a width x height window into tiles. Tiles along the right and
+ * 			top edges are clipped to the window.
+ * @param	width   	Width of window.
+ * @param	height  	Height of window.
+ * @param	tileSize	Width and height of a tile, in pixels.
+ */
+
+TileScheduler::TileScheduler(int width, int height, int tileSize) {
+	tileSize = std::max(tileSize, 1);
+	for (int y = 0; y < height; y += tileSize) {
+		for (int x = 0; x < width; x += tileSize) {
+			Tile tile = { x, y, std::min(x + tileSize, width), std::min(y + tileSize, height) };
+			tiles.push_back(tile);
+		}
+	}
+}
+
+/**
+ * @fn	int TileScheduler::defaultThreadCount()
+ * @brief	Number of hardware threads, or 1 if that cannot be determined.
+ * @return	The default number of worker threads.
+ */
+
+int TileScheduler::defaultThreadCount() {
+	return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+/**
+ * @fn	void TileScheduler::run(int numThreads, const std::function<void(const Tile &)> &work) const
+ * @brief	Calls work once for every tile, spread across numThreads threads.
+ * 			Returns once all tiles are done. The calling thread acts as worker 0.
+ * @param	numThreads	Number of workers; 0 or less uses defaultThreadCount().
+ * @param	work	  	Renders one tile. Must be safe to call concurrently on
+ * 						different tiles.
+ */
+
+void TileScheduler::run(int numThreads, const std::function<void(const Tile &)> &work) const {
+	const int N = (int)tiles.size();
+	if (numThreads <= 0) {
+		numThreads = defaultThreadCount();
+	}
+	numThreads = std::max(1, std::min(numThreads, N));
+
+	if (numThreads == 1) {
+		for (int i = 0; i < N; i++) {
+			work(tiles[i]);
+		}
+		return;
+	}
+
+	std::unique_ptr<TileRun[]> runs(new TileRun[numThreads]);
+	for (int w = 0; w < numThreads; w++) {
+		uint32_t begin = (uint32_t)((int64_t)N * w / numThreads);
+		uint32_t end = (uint32_t)((int64_t)N * (w + 1) / numThreads);
+		runs[w].headTail.store(TileRun::pack(begin, end), std::memory_order_relaxed);
+	}
+
+	auto worker = [&](int self) {
+		int index;
+		while (runs[self].popFront(index)) {
+			work(tiles[index]);
+		}
+		for (int i = 1; i < numThreads; i++) {
+			TileRun &victim = runs[(self + i) % numThreads];
+			while (victim.popBack(index)) {
+				work(tiles[index]);
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int w = 1; w < numThreads; w++) {
+		threads.push_back(std::thread(worker, w));
+	}
+	worker(0);
+	for (unsigned int i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+}
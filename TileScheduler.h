@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <functional>
+
+/**
+ * @struct	Tile
+ * @brief	A rectangular block of pixels, [x0, x1) by [y0, y1).
+ */
+
+struct Tile {
+	int x0, y0;		//!< lower left corner (inclusive)
+	int x1, y1;		//!< upper right corner (exclusive)
+};
+
+/**
+ * @struct	TileScheduler
+ * @brief	Splits a window into tiles and hands them out to a pool of worker
+ * 			threads. Each worker owns a contiguous run of tiles, which it takes
+ * 			from the front. A worker that runs out steals from the back of the
+ * 			other workers' runs, so uneven tiles do not leave cores idle.
+ */
+
+struct TileScheduler {
+	TileScheduler(int width, int height, int tileSize);
+	void run(int numThreads, const std::function<void(const Tile &)> &work) const;
+	const std::vector<Tile> &getTiles() const { return tiles; }
+	static int defaultThreadCount();
+protected:
+	std::vector<Tile> tiles;	//!< All tiles, in scanline order.
+};
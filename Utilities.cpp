@@ -2,7 +2,7 @@
 #include <iomanip>
 #include<algorithm>
 #include <math.h>
-#include "defs.h"
+#include "Defs.h"
 #include "Utilities.h"
 
 /**
@@ -524,18 +524,11 @@ void map(float x, float xLow, float xHigh, float yLow, float yHigh, float &y) {
 
 std::vector<float> quadratic(float A, float B, float C) {
 	std::vector<float> result;
+	float roots[2];
+	int numRoots = quadratic(A, B, C, roots);
 
-	if ((B*B - 4 * A*C) > 0) {
-		float fResult = (-B + sqrt(B*B - 4 * A*C)) / (2 * A);
-		float sResult = (-B - sqrt(B*B - 4 * A*C)) / (2 * A);
-		result.push_back(std::min(fResult, sResult));
-		result.push_back(std::max(fResult, sResult));
-		return result;
-	}
-	else if ((B*B - 4 * A*C) == 0) {
-		float fResult = (-B + sqrt(B*B - 4 * A*C)) / (2 * A);
-		result.push_back(fResult);
-		return result;
+	for (int i = 0; i < numRoots; i++) {
+		result.push_back(roots[i]);
 	}
 	return result;
 }
@@ -553,14 +546,16 @@ std::vector<float> quadratic(float A, float B, float C) {
 */
 
 int quadratic(float A, float B, float C, float roots[2]) {
-	if ((B*B - 4 * A*C) > 0){
-		float fResult = (-B + sqrt(B*B - 4 * A*C)) / (2 * A);
-		float sResult = (-B - sqrt(B*B - 4 * A*C)) / (2 * A);
+	float discriminant = B*B - 4 * A*C;
+	if (discriminant > 0){
+		float root = sqrt(discriminant);
+		float fResult = (-B + root) / (2 * A);
+		float sResult = (-B - root) / (2 * A);
 		roots[0] = std::min(fResult, sResult);
 		roots[1] = std::max(fResult, sResult);
 		return 2;
-	}else if ((B*B - 4 * A*C) == 0) {
-		float fResult = (-B + sqrt(B*B - 4 * A*C)) / (2 * A);
+	}else if (discriminant == 0) {
+		float fResult = (-B + sqrt(discriminant)) / (2 * A);
 		roots[0] = fResult;
 		return 1;
 	}